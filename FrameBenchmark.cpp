@@ -0,0 +1,148 @@
+#include "FrameBenchmark.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+FrameBenchmark::FrameBenchmark(void)
+{
+	this->n_warmup_frames = 0;
+	this->n_frames = 0;
+	this->active = false;
+}
+
+uint32_t FrameBenchmark::add_series(const std::string& name, const std::string& unit)
+{
+	if (this->active)
+		throw std::logic_error("Series must be added before the benchmark is started!");
+	this->series_names.push_back(name);
+	this->series_units.push_back(unit);
+	return static_cast<uint32_t>(this->series_names.size() - 1);
+}
+
+void FrameBenchmark::start(uint64_t n_frames, uint64_t n_warmup_frames)
+{
+	this->n_frames = n_frames;
+	this->n_warmup_frames = n_warmup_frames;
+
+	// preallocate every sample, frames that never get a sample stay NaN
+	this->samples.assign(n_frames * this->series_names.size(), std::numeric_limits<double>::quiet_NaN());
+	this->active = true;
+}
+
+void FrameBenchmark::record(uint64_t frame, uint32_t series, double value)
+{
+	if (!this->active || frame < this->n_warmup_frames)
+		return;
+
+	uint64_t i = frame - this->n_warmup_frames;
+	if (i < this->n_frames)
+		this->samples[i * this->series_names.size() + series] = value;
+}
+
+double FrameBenchmark::percentile(const std::vector<double>& sorted, double p) const
+{
+	// nearest rank method
+	size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+	if (rank > 0) rank--;
+	return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+FrameBenchmark::statistics_t FrameBenchmark::compute_statistics(uint32_t series) const
+{
+	std::vector<double> values;
+	values.reserve(this->n_frames);
+	for (uint64_t i = 0; i < this->n_frames; i++)
+	{
+		double v = this->samples[i * this->series_names.size() + series];
+		if (!std::isnan(v))
+			values.push_back(v);
+	}
+
+	statistics_t stats = {};
+	stats.n_samples = static_cast<uint32_t>(values.size());
+	if (values.empty())
+		return stats;
+
+	std::sort(values.begin(), values.end());
+	double sum = 0.0;
+	for (double v : values)
+		sum += v;
+
+	stats.min = values.front();
+	stats.max = values.back();
+	stats.avg = sum / values.size();
+	stats.p50 = this->percentile(values, 50.0);
+	stats.p95 = this->percentile(values, 95.0);
+	stats.p99 = this->percentile(values, 99.0);
+	return stats;
+}
+
+void FrameBenchmark::print_report(void) const
+{
+	std::cout << std::endl;
+	std::cout << "Benchmark: " << this->n_frames << " frames after " << this->n_warmup_frames << " warm-up frames" << std::endl;
+	std::cout << std::left << std::setw(20) << "series" << std::setw(8) << "unit" << std::right
+			  << std::setw(10) << "min" << std::setw(10) << "avg" << std::setw(10) << "p50"
+			  << std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+
+	std::cout << std::fixed << std::setprecision(3);
+	for (uint32_t i = 0; i < this->series_names.size(); i++)
+	{
+		statistics_t stats = this->compute_statistics(i);
+		std::cout << std::left << std::setw(20) << this->series_names[i] << std::setw(8) << this->series_units[i] << std::right;
+
+		// series that were never recorded (e.g. present in headless mode) have no statistics
+		if (stats.n_samples == 0)
+		{
+			for (uint32_t j = 0; j < 6; j++)
+				std::cout << std::setw(10) << "n/a";
+			std::cout << std::endl;
+			continue;
+		}
+		std::cout << std::setw(10) << stats.min << std::setw(10) << stats.avg << std::setw(10) << stats.p50
+				  << std::setw(10) << stats.p95 << std::setw(10) << stats.p99 << std::setw(10) << stats.max << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+}
+
+bool FrameBenchmark::write_json(const char* path) const
+{
+	std::fstream file(path, std::ios::out);
+	if (!file) return false;
+
+	file << std::setprecision(6);
+	file << "{\n";
+	file << "\t\"frames\": " << this->n_frames << ",\n";
+	file << "\t\"warmup_frames\": " << this->n_warmup_frames << ",\n";
+	file << "\t\"series\": {\n";
+	for (uint32_t i = 0; i < this->series_names.size(); i++)
+	{
+		statistics_t stats = this->compute_statistics(i);
+		file << "\t\t\"" << this->series_names[i] << "\": {\n";
+		file << "\t\t\t\"unit\": \"" << this->series_units[i] << "\",\n";
+		if (stats.n_samples == 0)
+			file << "\t\t\t\"min\": null, \"avg\": null, \"p50\": null, \"p95\": null, \"p99\": null, \"max\": null,\n";
+		else
+			file << "\t\t\t\"min\": " << stats.min << ", \"avg\": " << stats.avg << ", \"p50\": " << stats.p50
+				 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << ",\n";
+		file << "\t\t\t\"samples\": [";
+		bool first = true;
+		for (uint64_t f = 0; f < this->n_frames; f++)
+		{
+			double v = this->samples[f * this->series_names.size() + i];
+			if (std::isnan(v)) continue;		// JSON doesn't know NaN
+			file << (first ? "" : ", ") << v;
+			first = false;
+		}
+		file << "]\n";
+		file << "\t\t}" << ((i + 1 < this->series_names.size()) ? "," : "") << "\n";
+	}
+	file << "\t}\n";
+	file << "}\n";
+	file.close();
+	return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/* Collects per-frame timings of multiple named series (e.g. CPU phases of a frame).
+   All samples are stored in a buffer that is allocated once, recording a sample
+   is just a store and never allocates. */
+class FrameBenchmark
+{
+public:
+	struct statistics_t
+	{
+		double min;
+		double avg;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+		uint32_t n_samples;
+	};
+
+private:
+	std::vector<std::string> series_names;
+	std::vector<std::string> series_units;
+	std::vector<double> samples;	// [frame * n_series + series] in the unit of the series, NaN if not recorded
+	uint64_t n_warmup_frames;
+	uint64_t n_frames;
+	bool active;
+
+	double percentile(const std::vector<double>& sorted, double p) const;
+
+public:
+	FrameBenchmark(void);
+	virtual ~FrameBenchmark(void) = default;
+
+	// series must be added before the benchmark is started, returns the index of the series
+	uint32_t add_series(const std::string& name, const std::string& unit = "ms");
+	void start(uint64_t n_frames, uint64_t n_warmup_frames);
+	bool is_active(void) const { return this->active; }
+
+	// frames before the end of the warm-up period and after the last benchmarked frame are ignored
+	void record(uint64_t frame, uint32_t series, double value);
+
+	statistics_t compute_statistics(uint32_t series) const;
+	void print_report(void) const;
+	bool write_json(const char* path) const;
+};
@@ -0,0 +1,247 @@
+#include "FrustumCuller.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define FRUSTUM_CULLER_X86
+	#include <immintrin.h>
+#endif
+
+FrustumCuller::FrustumCuller(void)
+{
+	this->n_objects = 0;
+	this->best_isa = ISA_SCALAR;
+	if (is_supported(ISA_AVX2))
+		this->best_isa = ISA_AVX2;
+	else if (is_supported(ISA_SSE))
+		this->best_isa = ISA_SSE;
+}
+
+void FrustumCuller::extract_planes(const glm::mat4& view_projection, glm::vec4 planes[6])
+{
+	// left, right, bottom, top, near, far. Clip space depth is [0, w], the near plane is the third row alone
+	glm::vec4 rows[4];
+	for (uint32_t i = 0; i < 4; i++)
+		rows[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[2];
+	planes[5] = rows[3] - rows[2];
+	for (uint32_t i = 0; i < 6; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+bool FrustumCuller::is_supported(isa_t isa)
+{
+	switch (isa)
+	{
+	case ISA_SCALAR:
+		return true;
+#if defined(FRUSTUM_CULLER_X86)
+	case ISA_SSE:
+		return __builtin_cpu_supports("sse2");
+	case ISA_AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return false;
+	}
+}
+
+const char* FrustumCuller::get_isa_name(isa_t isa)
+{
+	switch (isa)
+	{
+	case ISA_SCALAR:
+		return "scalar";
+	case ISA_SSE:
+		return "SSE";
+	case ISA_AVX2:
+		return "AVX2";
+	default:
+		return "unknown";
+	}
+}
+
+void FrustumCuller::resize(uint32_t n_objects)
+{
+	// the vector loops read whole registers, the padding is masked out
+	size_t padded = (n_objects + LANES - 1) / LANES * LANES;
+	this->n_objects = n_objects;
+	for (uint32_t i = 0; i < 12; i++)
+		this->transform[i].assign(padded, (i == 0 || i == 5 || i == 10) ? 1.0f : 0.0f);
+	this->center_x.assign(padded, 0.0f);
+	this->center_y.assign(padded, 0.0f);
+	this->center_z.assign(padded, 0.0f);
+	this->radius.assign(padded, 0.0f);
+}
+
+void FrustumCuller::set_transform(uint32_t object, const glm::vec4 rows[3])
+{
+	for (uint32_t row = 0; row < 3; row++)
+		for (uint32_t column = 0; column < 4; column++)
+			this->transform[row * 4 + column][object] = rows[row][column];
+}
+
+void FrustumCuller::get_transform(uint32_t object, glm::vec4 rows[3]) const
+{
+	for (uint32_t row = 0; row < 3; row++)
+		for (uint32_t column = 0; column < 4; column++)
+			rows[row][column] = this->transform[row * 4 + column][object];
+}
+
+void FrustumCuller::set_bounds(uint32_t object, const glm::vec3& center, float radius)
+{
+	this->center_x[object] = center.x;
+	this->center_y[object] = center.y;
+	this->center_z[object] = center.z;
+	this->radius[object] = radius;
+}
+
+void FrustumCuller::update_bounds(const glm::vec4& local_bounds)
+{
+	// plain loops over the arrays, the compiler vectorizes them
+	const float* m[12];
+	for (uint32_t i = 0; i < 12; i++)
+		m[i] = this->transform[i].data();
+	for (uint32_t i = 0; i < this->n_objects; i++)
+	{
+		this->center_x[i] = m[0][i] * local_bounds.x + m[1][i] * local_bounds.y + m[2][i] * local_bounds.z + m[3][i];
+		this->center_y[i] = m[4][i] * local_bounds.x + m[5][i] * local_bounds.y + m[6][i] * local_bounds.z + m[7][i];
+		this->center_z[i] = m[8][i] * local_bounds.x + m[9][i] * local_bounds.y + m[10][i] * local_bounds.z + m[11][i];
+
+		// the longest column of the linear part is the largest scale
+		float scale_x = m[0][i] * m[0][i] + m[4][i] * m[4][i] + m[8][i] * m[8][i];
+		float scale_y = m[1][i] * m[1][i] + m[5][i] * m[5][i] + m[9][i] * m[9][i];
+		float scale_z = m[2][i] * m[2][i] + m[6][i] * m[6][i] + m[10][i] * m[10][i];
+		this->radius[i] = local_bounds.w * std::sqrt(std::max(scale_x, std::max(scale_y, scale_z)));
+	}
+}
+
+uint32_t FrustumCuller::cull(const glm::vec4 planes[6], uint32_t* visible) const
+{
+	return this->cull(planes, visible, this->best_isa);
+}
+
+uint32_t FrustumCuller::cull(const glm::vec4 planes[6], uint32_t* visible, isa_t isa) const
+{
+	switch (isa)
+	{
+	case ISA_AVX2:
+		return this->cull_avx2(planes, visible);
+	case ISA_SSE:
+		return this->cull_sse(planes, visible);
+	default:
+		return this->cull_scalar(planes, visible);
+	}
+}
+
+uint32_t FrustumCuller::cull_scalar(const glm::vec4 planes[6], uint32_t* visible) const
+{
+	uint32_t n_visible = 0;
+	for (uint32_t i = 0; i < this->n_objects; i++)
+	{
+		// same order of operations as the vector loops, all of them return the same list
+		bool inside = true;
+		for (uint32_t p = 0; p < 6; p++)
+		{
+			float distance = (planes[p].x * this->center_x[i] + planes[p].y * this->center_y[i]) + (planes[p].z * this->center_z[i] + planes[p].w);
+			inside &= distance >= -this->radius[i];
+		}
+		visible[n_visible] = i;
+		n_visible += inside ? 1 : 0;
+	}
+	return n_visible;
+}
+
+#if defined(FRUSTUM_CULLER_X86)
+
+__attribute__((target("sse2")))
+uint32_t FrustumCuller::cull_sse(const glm::vec4 planes[6], uint32_t* visible) const
+{
+	__m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+	for (uint32_t p = 0; p < 6; p++)
+	{
+		plane_x[p] = _mm_set1_ps(planes[p].x);
+		plane_y[p] = _mm_set1_ps(planes[p].y);
+		plane_z[p] = _mm_set1_ps(planes[p].z);
+		plane_w[p] = _mm_set1_ps(planes[p].w);
+	}
+
+	uint32_t n_visible = 0;
+	for (uint32_t base = 0; base < this->n_objects; base += 4)
+	{
+		__m128 x = _mm_loadu_ps(this->center_x.data() + base);
+		__m128 y = _mm_loadu_ps(this->center_y.data() + base);
+		__m128 z = _mm_loadu_ps(this->center_z.data() + base);
+		__m128 negative_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(this->radius.data() + base));
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (uint32_t p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane_x[p], x), _mm_mul_ps(plane_y[p], y)), _mm_add_ps(_mm_mul_ps(plane_z[p], z), plane_w[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negative_radius));
+		}
+
+		// one bit per object, the indices of the set bits are appended
+		uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+		if (this->n_objects - base < 4)
+			mask &= (1u << (this->n_objects - base)) - 1;
+		for (; mask != 0; mask &= mask - 1)
+			visible[n_visible++] = base + __builtin_ctz(mask);
+	}
+	return n_visible;
+}
+
+__attribute__((target("avx2")))
+uint32_t FrustumCuller::cull_avx2(const glm::vec4 planes[6], uint32_t* visible) const
+{
+	__m256 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+	for (uint32_t p = 0; p < 6; p++)
+	{
+		plane_x[p] = _mm256_set1_ps(planes[p].x);
+		plane_y[p] = _mm256_set1_ps(planes[p].y);
+		plane_z[p] = _mm256_set1_ps(planes[p].z);
+		plane_w[p] = _mm256_set1_ps(planes[p].w);
+	}
+
+	uint32_t n_visible = 0;
+	for (uint32_t base = 0; base < this->n_objects; base += 8)
+	{
+		__m256 x = _mm256_loadu_ps(this->center_x.data() + base);
+		__m256 y = _mm256_loadu_ps(this->center_y.data() + base);
+		__m256 z = _mm256_loadu_ps(this->center_z.data() + base);
+		__m256 negative_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(this->radius.data() + base));
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (uint32_t p = 0; p < 6; p++)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(plane_x[p], x), _mm256_mul_ps(plane_y[p], y)), _mm256_add_ps(_mm256_mul_ps(plane_z[p], z), plane_w[p]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negative_radius, _CMP_GE_OQ));
+		}
+
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+		if (this->n_objects - base < 8)
+			mask &= (1u << (this->n_objects - base)) - 1;
+		for (; mask != 0; mask &= mask - 1)
+			visible[n_visible++] = base + __builtin_ctz(mask);
+	}
+	return n_visible;
+}
+
+#else
+
+// is_supported never reports the vector loops on other CPUs, cull falls back to the scalar loop anyway
+uint32_t FrustumCuller::cull_sse(const glm::vec4 planes[6], uint32_t* visible) const
+{
+	return this->cull_scalar(planes, visible);
+}
+
+uint32_t FrustumCuller::cull_avx2(const glm::vec4 planes[6], uint32_t* visible) const
+{
+	return this->cull_scalar(planes, visible);
+}
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/* Scene objects in structure-of-arrays layout and a frustum culler over them. Every component
+   of the transforms and of the bounding spheres is stored in its own array, the culler tests
+   4 (SSE) or 8 (AVX2) objects with one instruction per plane and writes the indices of the
+   visible objects into a compact list. The arrays are padded to a multiple of LANES, padding
+   objects are never visible. The instruction set is selected at runtime, other CPUs and
+   compilers fall back to the scalar loop. */
+class FrustumCuller
+{
+public:
+	enum isa_t : uint32_t
+	{
+		ISA_SCALAR = 0,
+		ISA_SSE,
+		ISA_AVX2,
+		N_ISAS
+	};
+
+	static constexpr uint32_t LANES = 8;		// widest vector, objects per AVX2 register
+
+private:
+	uint32_t n_objects;
+	std::vector<float> transform[12];			// [row * 4 + column], rows of affine 3x4 matrices
+	std::vector<float> center_x, center_y, center_z, radius;	// bounding spheres in scene space
+	isa_t best_isa;
+
+	uint32_t cull_scalar(const glm::vec4 planes[6], uint32_t* visible) const;
+	uint32_t cull_sse(const glm::vec4 planes[6], uint32_t* visible) const;
+	uint32_t cull_avx2(const glm::vec4 planes[6], uint32_t* visible) const;
+
+public:
+	FrustumCuller(void);
+	virtual ~FrustumCuller(void) = default;
+
+	// normalized planes out of the rows of a view projection with a depth range of [0, w], the inside is positive
+	static void extract_planes(const glm::mat4& view_projection, glm::vec4 planes[6]);
+	static bool is_supported(isa_t isa);
+	static const char* get_isa_name(isa_t isa);
+
+	// all objects are reset to the identity and an empty sphere
+	void resize(uint32_t n_objects);
+	uint32_t get_object_count(void) const { return this->n_objects; }
+
+	void set_transform(uint32_t object, const glm::vec4 rows[3]);
+	void get_transform(uint32_t object, glm::vec4 rows[3]) const;
+	void set_bounds(uint32_t object, const glm::vec3& center, float radius);
+	// transforms the same local bounding sphere by the transform of every object
+	void update_bounds(const glm::vec4& local_bounds);
+
+	// visible needs room for all objects, returns the number of visible objects. Uses the best supported instruction set
+	uint32_t cull(const glm::vec4 planes[6], uint32_t* visible) const;
+	uint32_t cull(const glm::vec4 planes[6], uint32_t* visible, isa_t isa) const;
+};
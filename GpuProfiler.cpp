@@ -0,0 +1,202 @@
+#include "GpuProfiler.h"
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+GpuProfiler::GpuProfiler(void)
+{
+	this->device = VK_NULL_HANDLE;
+	this->current_frame = 0;
+	this->timestamp_period = 1.0;
+	this->timestamp_mask = 0;
+	this->timestamps_enabled = false;
+	this->statistics_enabled = false;
+}
+
+uint32_t GpuProfiler::add_scope(const std::string& name)
+{
+	if (!this->frames.empty())
+		throw std::logic_error("Scopes must be added before the GPU profiler is created!");
+	this->scope_names.push_back(name);
+	return static_cast<uint32_t>(this->scope_names.size() - 1);
+}
+
+const char* GpuProfiler::get_statistic_name(statistic_t statistic)
+{
+	switch (statistic)
+	{
+	case STAT_INPUT_ASSEMBLY_VERTICES:
+		return "ia_vertices";
+	case STAT_INPUT_ASSEMBLY_PRIMITIVES:
+		return "ia_primitives";
+	case STAT_VERTEX_SHADER_INVOCATIONS:
+		return "vs_invocations";
+	case STAT_CLIPPING_INVOCATIONS:
+		return "clip_invocations";
+	case STAT_CLIPPING_PRIMITIVES:
+		return "clip_primitives";
+	case STAT_FRAGMENT_SHADER_INVOCATIONS:
+		return "fs_invocations";
+	default:
+		return "unknown";
+	}
+}
+
+void GpuProfiler::create(VkDevice device, VkPhysicalDevice physical_device, uint32_t queue_family, uint32_t n_frames, bool timestamps, bool pipeline_statistics)
+{
+	this->device = device;
+	this->current_frame = 0;
+
+	VkPhysicalDeviceProperties properties = {};
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+	uint32_t n_queue_families = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &n_queue_families, nullptr);
+	std::vector<VkQueueFamilyProperties> queue_families(n_queue_families);
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &n_queue_families, queue_families.data());
+
+	// a queue without valid timestamp bits doesn't support timestamps at all
+	uint32_t valid_bits = (queue_family < n_queue_families) ? queue_families[queue_family].timestampValidBits : 0;
+	this->timestamps_enabled = timestamps && (valid_bits > 0) && !this->scope_names.empty();
+	this->timestamp_mask = (valid_bits >= 64) ? std::numeric_limits<uint64_t>::max() : ((1ull << valid_bits) - 1);
+	this->timestamp_period = properties.limits.timestampPeriod;
+	this->statistics_enabled = pipeline_statistics;
+	if (timestamps && valid_bits == 0)
+		std::cerr << "Timestamps are not supported by the graphics queue, GPU times are not measured." << std::endl;
+
+	VkQueryPoolCreateInfo timestamp_pool_info = {};
+	timestamp_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	timestamp_pool_info.pNext = nullptr;
+	timestamp_pool_info.flags = 0;
+	timestamp_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	timestamp_pool_info.queryCount = 2 * this->get_scope_count();
+	timestamp_pool_info.pipelineStatistics = 0;
+
+	VkQueryPoolCreateInfo statistics_pool_info = {};
+	statistics_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	statistics_pool_info.pNext = nullptr;
+	statistics_pool_info.flags = 0;
+	statistics_pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	statistics_pool_info.queryCount = 1;
+	statistics_pool_info.pipelineStatistics = STATISTIC_FLAGS;
+
+	this->frames.resize(n_frames);
+	for (frame_queries_t& frame : this->frames)
+	{
+		frame.timestamp_pool = VK_NULL_HANDLE;
+		frame.statistics_pool = VK_NULL_HANDLE;
+		frame.scopes_written.assign(this->scope_names.size(), false);
+		frame.statistics_written = false;
+		frame.pending = false;
+		frame.frame_number = 0;
+
+		if (this->timestamps_enabled && vkCreateQueryPool(this->device, &timestamp_pool_info, nullptr, &frame.timestamp_pool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create timestamp query pool!");
+		if (this->statistics_enabled && vkCreateQueryPool(this->device, &statistics_pool_info, nullptr, &frame.statistics_pool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create pipeline statistics query pool!");
+	}
+}
+
+void GpuProfiler::destroy(void)
+{
+	for (frame_queries_t& frame : this->frames)
+	{
+		if (frame.timestamp_pool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(this->device, frame.timestamp_pool, nullptr);
+		if (frame.statistics_pool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(this->device, frame.statistics_pool, nullptr);
+	}
+	this->frames.clear();
+}
+
+void GpuProfiler::begin_frame(VkCommandBuffer cmd_buffer, uint32_t frame_index, uint64_t frame_number)
+{
+	if (!this->is_enabled())
+		return;
+
+	// the results of the last use of this slot have been read (or dropped) after the fence wait
+	this->current_frame = frame_index;
+	frame_queries_t& frame = this->frames[frame_index];
+	frame.scopes_written.assign(this->scope_names.size(), false);
+	frame.statistics_written = false;
+	frame.pending = true;
+	frame.frame_number = frame_number;
+
+	// queries must be reset before they are written again
+	if (this->timestamps_enabled)
+		vkCmdResetQueryPool(cmd_buffer, frame.timestamp_pool, 0, 2 * this->get_scope_count());
+	if (this->statistics_enabled)
+		vkCmdResetQueryPool(cmd_buffer, frame.statistics_pool, 0, 1);
+}
+
+void GpuProfiler::begin_scope(VkCommandBuffer cmd_buffer, uint32_t scope)
+{
+	if (!this->timestamps_enabled)
+		return;
+	vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->frames[this->current_frame].timestamp_pool, 2 * scope);
+}
+
+void GpuProfiler::end_scope(VkCommandBuffer cmd_buffer, uint32_t scope)
+{
+	if (!this->timestamps_enabled)
+		return;
+	// written as soon as all previous commands have finished
+	frame_queries_t& frame = this->frames[this->current_frame];
+	vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.timestamp_pool, 2 * scope + 1);
+	frame.scopes_written[scope] = true;
+}
+
+void GpuProfiler::begin_statistics(VkCommandBuffer cmd_buffer)
+{
+	if (!this->statistics_enabled)
+		return;
+	vkCmdBeginQuery(cmd_buffer, this->frames[this->current_frame].statistics_pool, 0, 0);
+}
+
+void GpuProfiler::end_statistics(VkCommandBuffer cmd_buffer)
+{
+	if (!this->statistics_enabled)
+		return;
+	frame_queries_t& frame = this->frames[this->current_frame];
+	vkCmdEndQuery(cmd_buffer, frame.statistics_pool, 0);
+	frame.statistics_written = true;
+}
+
+bool GpuProfiler::resolve(uint32_t frame_index, uint64_t& frame_number, double* scope_ms, uint64_t* statistics)
+{
+	if (!this->is_enabled() || !this->frames[frame_index].pending)
+		return false;
+
+	frame_queries_t& frame = this->frames[frame_index];
+	frame.pending = false;
+	frame_number = frame.frame_number;
+
+	/* No VK_QUERY_RESULT_WAIT_BIT: the fence of the frame has been signaled, so the results are
+	   available. If they are not (VK_NOT_READY), the values are dropped instead of stalling. */
+	for (uint32_t i = 0; i < this->get_scope_count(); i++)
+	{
+		scope_ms[i] = std::numeric_limits<double>::quiet_NaN();
+		if (!this->timestamps_enabled || !frame.scopes_written[i])
+			continue;
+
+		uint64_t timestamps[2];
+		VkResult result = vkGetQueryPoolResults(this->device, frame.timestamp_pool, 2 * i, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS)
+			continue;
+
+		uint64_t ticks = (timestamps[1] - timestamps[0]) & this->timestamp_mask;
+		scope_ms[i] = ticks * this->timestamp_period / 1000000.0;
+	}
+
+	if (this->statistics_enabled && frame.statistics_written)
+	{
+		uint64_t values[N_STATISTICS];
+		VkResult result = vkGetQueryPoolResults(this->device, frame.statistics_pool, 0, 1, sizeof(values), values, sizeof(values), VK_QUERY_RESULT_64_BIT);
+		if (result == VK_SUCCESS)
+		{
+			for (uint32_t i = 0; i < N_STATISTICS; i++)
+				statistics[i] = values[i];
+		}
+	}
+	return true;
+}
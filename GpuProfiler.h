@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/* Measures the GPU time of named scopes with timestamp queries and optionally collects
+   pipeline statistics of the frame. Every frame in flight owns its own query pools.
+   The results of a frame are read after the fence of its frame slot has been waited on,
+   so reading them never stalls the CPU. */
+class GpuProfiler
+{
+public:
+	// order of the pipeline statistics, the same order as the bits in VkQueryPipelineStatisticFlagBits
+	enum statistic_t : uint32_t
+	{
+		STAT_INPUT_ASSEMBLY_VERTICES = 0,
+		STAT_INPUT_ASSEMBLY_PRIMITIVES,
+		STAT_VERTEX_SHADER_INVOCATIONS,
+		STAT_CLIPPING_INVOCATIONS,
+		STAT_CLIPPING_PRIMITIVES,
+		STAT_FRAGMENT_SHADER_INVOCATIONS,
+		N_STATISTICS
+	};
+
+private:
+	struct frame_queries_t
+	{
+		VkQueryPool timestamp_pool;			// two timestamps per scope: begin and end
+		VkQueryPool statistics_pool;
+		std::vector<bool> scopes_written;	// scopes that were recorded into the frame
+		bool statistics_written;
+		bool pending;						// recorded, but the results were not read yet
+		uint64_t frame_number;				// frame the queries belong to
+	};
+
+	VkDevice device;
+	std::vector<std::string> scope_names;
+	std::vector<frame_queries_t> frames;
+	uint32_t current_frame;
+	double timestamp_period;		// nanoseconds per timestamp tick
+	uint64_t timestamp_mask;		// only timestampValidBits of the queue are written
+	bool timestamps_enabled;
+	bool statistics_enabled;
+
+public:
+	GpuProfiler(void);
+	virtual ~GpuProfiler(void) = default;
+
+	// scopes must be added before the profiler is created, returns the index of the scope
+	uint32_t add_scope(const std::string& name);
+	uint32_t get_scope_count(void) const { return static_cast<uint32_t>(this->scope_names.size()); }
+	const std::string& get_scope_name(uint32_t scope) const { return this->scope_names[scope]; }
+	static const char* get_statistic_name(statistic_t statistic);
+
+	// statistics the query pool collects, secondary command buffers inherit the query with these flags
+	static constexpr VkQueryPipelineStatisticFlags STATISTIC_FLAGS = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+																	 VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+																	 VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+																	 VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+																	 VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+																	 VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+	// pipeline statistics require the pipelineStatisticsQuery feature to be enabled on the device
+	void create(VkDevice device, VkPhysicalDevice physical_device, uint32_t queue_family, uint32_t n_frames, bool timestamps, bool pipeline_statistics);
+	void destroy(void);
+	bool is_enabled(void) const { return this->timestamps_enabled || this->statistics_enabled; }
+	bool has_statistics(void) const { return this->statistics_enabled; }
+
+	// must be recorded outside of a render pass, before any scope of the frame
+	void begin_frame(VkCommandBuffer cmd_buffer, uint32_t frame_index, uint64_t frame_number);
+	void begin_scope(VkCommandBuffer cmd_buffer, uint32_t scope);
+	void end_scope(VkCommandBuffer cmd_buffer, uint32_t scope);
+	void begin_statistics(VkCommandBuffer cmd_buffer);
+	void end_statistics(VkCommandBuffer cmd_buffer);
+
+	/* Reads the results of a frame slot, the fence of the slot must have been waited on.
+	   scope_ms must hold get_scope_count() values and statistics N_STATISTICS values.
+	   Scopes that weren't recorded are NaN, statistics are only written if they were recorded.
+	   Returns false if the slot has no results. */
+	bool resolve(uint32_t frame_index, uint64_t& frame_number, double* scope_ms, uint64_t* statistics);
+};
@@ -0,0 +1,275 @@
+#include "Ktx2Texture.h"
+#include "MipChain.h"
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+
+const uint8_t Ktx2Texture::IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };	// «KTX 20»\r\n\x1A\n
+
+Ktx2Texture::Ktx2Texture(void)
+{
+	this->format = VK_FORMAT_UNDEFINED;
+	this->width = 0;
+	this->height = 0;
+}
+
+bool Ktx2Texture::get_format_info(VkFormat format, format_info_t& info)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		info = { 1, 1, 4 };
+		return true;
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+		info = { 4, 4, 8 };
+		return true;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+	case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+	case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+		info = { 4, 4, 16 };
+		return true;
+	default:
+		return false;
+	}
+}
+
+VkDeviceSize Ktx2Texture::get_level_size(VkFormat format, uint32_t width, uint32_t height)
+{
+	format_info_t info;
+	if (!get_format_info(format, info))
+		throw std::invalid_argument("Unsupported KTX2 format!");
+
+	// partial blocks at the border are stored as whole blocks
+	VkDeviceSize blocks_x = (width + info.block_width - 1) / info.block_width;
+	VkDeviceSize blocks_y = (height + info.block_height - 1) / info.block_height;
+	return blocks_x * blocks_y * info.block_size;
+}
+
+bool Ktx2Texture::load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return false;
+
+	size_t file_size = (size_t)file.tellg();
+	std::vector<uint8_t> file_data(file_size);
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(file_data.data()), file_size);
+	file.close();
+
+	header_t header;
+	if (file_size < sizeof(header_t))
+		throw std::runtime_error("KTX2 file is too small: " + path);
+	memcpy(&header, file_data.data(), sizeof(header_t));
+	if (memcmp(header.identifier, IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+		throw std::runtime_error("Not a KTX2 file: " + path);
+	if (header.supercompression_scheme != 0)
+		throw std::runtime_error("Supercompressed KTX2 files are not supported: " + path);
+	if (header.pixel_width == 0 || header.pixel_height == 0 || header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1)
+		throw std::runtime_error("Only 2D KTX2 textures with one layer and one face are supported: " + path);
+	if (header.level_count > MipChain::get_level_count(header.pixel_width, header.pixel_height))
+		throw std::runtime_error("KTX2 file has more levels than the texture can have: " + path);
+
+	this->format = static_cast<VkFormat>(header.vk_format);
+	this->width = header.pixel_width;
+	this->height = header.pixel_height;
+	format_info_t info;
+	if (!get_format_info(this->format, info))
+		throw std::runtime_error("Unsupported format in KTX2 file: " + path);
+
+	// a level count of 0 requests mip generation by the loader, only level 0 is stored then
+	uint32_t n_levels = (header.level_count > 0) ? header.level_count : 1;
+	if (header.level_count == 0 && this->format != VK_FORMAT_R8G8B8A8_UNORM && this->format != VK_FORMAT_R8G8B8A8_SRGB)
+		throw std::runtime_error("Mip levels of block compressed KTX2 files can't be generated: " + path);
+	if (sizeof(header_t) + n_levels * sizeof(level_index_t) > file_size)
+		throw std::runtime_error("KTX2 level index is truncated: " + path);
+
+	// the levels are copied in the order of the level index, so they can be uploaded from one buffer
+	this->levels.clear();
+	this->data.clear();
+	for (uint32_t i = 0; i < n_levels; i++)
+	{
+		level_index_t index;
+		memcpy(&index, file_data.data() + sizeof(header_t) + i * sizeof(level_index_t), sizeof(level_index_t));
+
+		uint32_t level_width = (this->width >> i) > 0 ? (this->width >> i) : 1;
+		uint32_t level_height = (this->height >> i) > 0 ? (this->height >> i) : 1;
+		// written without a sum, a huge offset must not wrap around
+		if (index.byte_length != get_level_size(this->format, level_width, level_height) || index.byte_offset > file_size || index.byte_length > file_size - index.byte_offset)
+			throw std::runtime_error("KTX2 level has an invalid size: " + path);
+
+		this->add_level(file_data.data() + index.byte_offset, index.byte_length);
+	}
+
+	// the levels are generated with the same box filter that is used for decoded images
+	for (uint32_t level = n_levels; header.level_count == 0 && level < MipChain::get_level_count(this->width, this->height); level++)
+	{
+		uint8_t* dst = this->add_level((VkDeviceSize)MipChain::get_level_extent(this->width, level) * MipChain::get_level_extent(this->height, level) * 4);
+		MipChain::downsample_rgba8(this->get_level_data(level - 1), MipChain::get_level_extent(this->width, level - 1), MipChain::get_level_extent(this->height, level - 1), dst);
+	}
+	return true;
+}
+
+void Ktx2Texture::create(VkFormat format, uint32_t width, uint32_t height)
+{
+	format_info_t info;
+	if (!get_format_info(format, info))
+		throw std::invalid_argument("Unsupported KTX2 format!");
+
+	this->format = format;
+	this->width = width;
+	this->height = height;
+	this->levels.clear();
+	this->data.clear();
+}
+
+void Ktx2Texture::add_level(const uint8_t* level_data, VkDeviceSize size)
+{
+	memcpy(this->add_level(size), level_data, size);
+}
+
+uint8_t* Ktx2Texture::add_level(VkDeviceSize size)
+{
+	level_t level;
+	uint32_t i = static_cast<uint32_t>(this->levels.size());
+	level.width = (this->width >> i) > 0 ? (this->width >> i) : 1;
+	level.height = (this->height >> i) > 0 ? (this->height >> i) : 1;
+	level.size = size;
+	if (size != get_level_size(this->format, level.width, level.height))
+		throw std::invalid_argument("KTX2 level has an invalid size!");
+
+	// levels start at 16 bytes, which satisfies the offset rules of buffer to image copies for every supported format
+	level.offset = (this->data.size() + 15) / 16 * 16;
+	this->data.resize(level.offset + size);
+	this->levels.push_back(level);
+	return this->data.data() + level.offset;
+}
+
+void Ktx2Texture::build_dfd(VkFormat format, std::vector<uint32_t>& dfd)
+{
+	// Khronos basic data format descriptor, one sample per channel (or per block for compressed formats)
+	struct sample_t { uint32_t bit_offset; uint32_t bit_length; uint32_t channel; uint32_t upper; };
+	std::vector<sample_t> samples;
+	uint32_t color_model;
+	uint32_t block_dimension = 0;
+	bool srgb = (format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC7_SRGB_BLOCK || format == VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK || format == VK_FORMAT_ASTC_4x4_SRGB_BLOCK);
+
+	format_info_t info;
+	get_format_info(format, info);
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		color_model = 1;		// RGBSDA
+		samples = { { 0, 8, 0, 255 }, { 8, 8, 1, 255 }, { 16, 8, 2, 255 }, { 24, 8, 15, 255 } };
+		break;
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		color_model = 128;
+		samples = { { 0, 64, 1, UINT32_MAX } };
+		break;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+		color_model = 130;
+		samples = { { 0, 64, 15, UINT32_MAX }, { 64, 64, 0, UINT32_MAX } };
+		break;
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		color_model = 134;
+		samples = { { 0, 128, 0, UINT32_MAX } };
+		break;
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+		color_model = 161;
+		samples = { { 0, 64, 2, UINT32_MAX } };
+		break;
+	case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+		color_model = 161;
+		samples = { { 0, 64, 15, UINT32_MAX }, { 64, 64, 2, UINT32_MAX } };
+		break;
+	default:	// ASTC
+		color_model = 162;
+		samples = { { 0, 128, 0, UINT32_MAX } };
+		break;
+	}
+	if (info.block_width > 1)
+		block_dimension = (info.block_width - 1) | ((info.block_height - 1) << 8);
+
+	uint32_t block_size = 24 + 16 * static_cast<uint32_t>(samples.size());
+	dfd.clear();
+	dfd.push_back(4 + block_size);						// total size
+	dfd.push_back(0);									// vendor Khronos, descriptor type basic
+	dfd.push_back(2 | (block_size << 16));				// version 1.3, block size
+	dfd.push_back(color_model | (1 << 8) | ((srgb ? 2 : 1) << 16));	// BT709 primaries, transfer function, straight alpha
+	dfd.push_back(block_dimension);
+	dfd.push_back(info.block_size);						// bytes of plane 0
+	dfd.push_back(0);
+	for (const sample_t& sample : samples)
+	{
+		dfd.push_back(sample.bit_offset | ((sample.bit_length - 1) << 16) | (sample.channel << 24));
+		dfd.push_back(0);								// sample position
+		dfd.push_back(0);								// lower
+		dfd.push_back(sample.upper);
+	}
+}
+
+void Ktx2Texture::save(const std::string& path) const
+{
+	std::vector<uint32_t> dfd;
+	build_dfd(this->format, dfd);
+	format_info_t info;
+	get_format_info(this->format, info);
+
+	header_t header = {};
+	memcpy(header.identifier, IDENTIFIER, sizeof(IDENTIFIER));
+	header.vk_format = static_cast<uint32_t>(this->format);
+	header.type_size = 1;		// byte-sized components or block-compressed
+	header.pixel_width = this->width;
+	header.pixel_height = this->height;
+	header.pixel_depth = 0;
+	header.layer_count = 0;
+	header.face_count = 1;
+	header.level_count = this->get_level_count();
+	header.supercompression_scheme = 0;
+	header.dfd_byte_offset = static_cast<uint32_t>(sizeof(header_t) + this->levels.size() * sizeof(level_index_t));
+	header.dfd_byte_length = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+	header.kvd_byte_offset = 0;
+	header.kvd_byte_length = 0;
+	header.sgd_byte_offset = 0;
+	header.sgd_byte_length = 0;
+
+	/* The file stores the smallest level first. Every level is aligned to the least common
+	   multiple of the block size and 4, all supported block sizes are multiples of 4. */
+	std::vector<level_index_t> level_index(this->levels.size());
+	uint64_t offset = header.dfd_byte_offset + header.dfd_byte_length;
+	for (size_t i = this->levels.size(); i-- > 0;)
+	{
+		offset = (offset + info.block_size - 1) / info.block_size * info.block_size;
+		level_index[i].byte_offset = offset;
+		level_index[i].byte_length = this->levels[i].size;
+		level_index[i].uncompressed_byte_length = this->levels[i].size;
+		offset += this->levels[i].size;
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open " + path + " for writing!");
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header_t));
+	file.write(reinterpret_cast<const char*>(level_index.data()), level_index.size() * sizeof(level_index_t));
+	file.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * sizeof(uint32_t));
+
+	uint64_t written = header.dfd_byte_offset + header.dfd_byte_length;
+	const char padding[16] = {};
+	for (size_t i = this->levels.size(); i-- > 0;)
+	{
+		file.write(padding, level_index[i].byte_offset - written);
+		file.write(reinterpret_cast<const char*>(this->get_level_data(static_cast<uint32_t>(i))), this->levels[i].size);
+		written = level_index[i].byte_offset + this->levels[i].size;
+	}
+	if (!file.good())
+		throw std::runtime_error("Failed to write " + path + "!");
+}
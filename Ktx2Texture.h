@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/* Reads and writes KTX2 containers with precomputed mip levels. Only what the renderer
+   needs is supported: 2D textures, one layer, one face, no supercompression. The data
+   of every level is kept in one buffer and can be copied into staging memory as it is. */
+class Ktx2Texture
+{
+public:
+	struct level_t
+	{
+		VkDeviceSize offset;	// offset of the level in data
+		VkDeviceSize size;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	// size of a texel block of a format, 1x1 for uncompressed formats
+	struct format_info_t
+	{
+		uint32_t block_width;
+		uint32_t block_height;
+		uint32_t block_size;	// bytes
+	};
+
+private:
+	static const uint8_t IDENTIFIER[12];
+
+#pragma pack(push, 1)
+	struct header_t
+	{
+		uint8_t identifier[12];
+		uint32_t vk_format;
+		uint32_t type_size;
+		uint32_t pixel_width;
+		uint32_t pixel_height;
+		uint32_t pixel_depth;
+		uint32_t layer_count;
+		uint32_t face_count;
+		uint32_t level_count;
+		uint32_t supercompression_scheme;
+		uint32_t dfd_byte_offset;
+		uint32_t dfd_byte_length;
+		uint32_t kvd_byte_offset;
+		uint32_t kvd_byte_length;
+		uint64_t sgd_byte_offset;
+		uint64_t sgd_byte_length;
+	};
+
+	struct level_index_t
+	{
+		uint64_t byte_offset;
+		uint64_t byte_length;
+		uint64_t uncompressed_byte_length;
+	};
+#pragma pack(pop)
+
+	VkFormat format;
+	uint32_t width;
+	uint32_t height;
+	std::vector<level_t> levels;
+	std::vector<uint8_t> data;
+
+	static void build_dfd(VkFormat format, std::vector<uint32_t>& dfd);
+
+public:
+	Ktx2Texture(void);
+	virtual ~Ktx2Texture(void) = default;
+
+	// returns false if the format is not one of the supported ones
+	static bool get_format_info(VkFormat format, format_info_t& info);
+	static VkDeviceSize get_level_size(VkFormat format, uint32_t width, uint32_t height);
+
+	/* Returns false if the file can't be opened, throws if the file is not a supported KTX2 texture.
+	   The levels of RGBA8 files with a level count of 0 are generated after loading. */
+	bool load(const std::string& path);
+	void save(const std::string& path) const;
+
+	// levels are added from the largest (level 0) to the smallest
+	void create(VkFormat format, uint32_t width, uint32_t height);
+	void add_level(const uint8_t* level_data, VkDeviceSize size);
+	// adds an uninitialized level and returns where its data is written, pointers to older levels may become invalid
+	uint8_t* add_level(VkDeviceSize size);
+
+	VkFormat get_format(void) const { return this->format; }
+	uint32_t get_width(void) const { return this->width; }
+	uint32_t get_height(void) const { return this->height; }
+	uint32_t get_level_count(void) const { return static_cast<uint32_t>(this->levels.size()); }
+	const level_t& get_level(uint32_t level) const { return this->levels[level]; }
+	// all levels, level offsets are relative to the beginning
+	const uint8_t* get_data(void) const { return this->data.data(); }
+	VkDeviceSize get_data_size(void) const { return this->data.size(); }
+	const uint8_t* get_level_data(uint32_t level) const { return this->data.data() + this->levels[level].offset; }
+};
@@ -0,0 +1,110 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(void)
+{
+	this->data = nullptr;
+	this->size = 0;
+#if defined(_WIN32)
+	this->file = INVALID_HANDLE_VALUE;
+	this->mapping = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile(void)
+{
+	this->close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const std::string& path)
+{
+	this->close();
+
+	this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (this->file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(this->file, &file_size) || file_size.QuadPart == 0)
+	{
+		this->close();
+		return false;
+	}
+
+	this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (this->mapping == nullptr)
+	{
+		this->close();
+		return false;
+	}
+
+	this->data = static_cast<const uint8_t*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+	if (this->data == nullptr)
+	{
+		this->close();
+		return false;
+	}
+	this->size = static_cast<size_t>(file_size.QuadPart);
+	return true;
+}
+
+void MappedFile::close(void)
+{
+	if (this->data != nullptr)
+		UnmapViewOfFile(this->data);
+	if (this->mapping != nullptr)
+		CloseHandle(this->mapping);
+	if (this->file != INVALID_HANDLE_VALUE)
+		CloseHandle(this->file);
+	this->data = nullptr;
+	this->size = 0;
+	this->mapping = nullptr;
+	this->file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path)
+{
+	this->close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	// the mapping keeps its own reference to the file, the descriptor is not needed afterwards
+	struct stat file_stat;
+	void* mapped = MAP_FAILED;
+	if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+		mapped = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED)
+		return false;
+
+	// the whole file is read front to back, the OS can read ahead
+	madvise(mapped, static_cast<size_t>(file_stat.st_size), MADV_SEQUENTIAL);
+	this->data = static_cast<const uint8_t*>(mapped);
+	this->size = static_cast<size_t>(file_stat.st_size);
+	return true;
+}
+
+void MappedFile::close(void)
+{
+	if (this->data != nullptr)
+		munmap(const_cast<uint8_t*>(this->data), this->size);
+	this->data = nullptr;
+	this->size = 0;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/* Read-only memory mapping of a whole file. Nothing is read when the file is opened, the
+   OS loads the pages when they are touched for the first time. The data stays valid until
+   the file is closed. */
+class MappedFile
+{
+private:
+	const uint8_t* data;
+	size_t size;
+#if defined(_WIN32)
+	void* file;			// HANDLE of the file and of the mapping object
+	void* mapping;
+#endif
+
+public:
+	MappedFile(void);
+	// the mapping is owned by one object, it is unmapped even if the owner is destroyed by an exception
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	virtual ~MappedFile(void);
+
+	// returns false if the file can't be opened or mapped
+	bool open(const std::string& path);
+	void close(void);
+
+	bool is_open(void) const { return this->data != nullptr; }
+	const uint8_t* get_data(void) const { return this->data; }
+	size_t get_size(void) const { return this->size; }
+};
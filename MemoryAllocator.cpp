@@ -0,0 +1,344 @@
+#include "MemoryAllocator.h"
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+MemoryAllocator::MemoryAllocator(void)
+{
+	this->device = VK_NULL_HANDLE;
+	this->memory_properties = {};
+	this->max_allocation_count = 0;
+	this->n_device_allocations = 0;
+	this->block_size = DEFAULT_BLOCK_SIZE;
+}
+
+void MemoryAllocator::create(VkDevice device, VkPhysicalDevice physical_device, VkDeviceSize block_size)
+{
+	this->device = device;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &this->memory_properties);
+
+	VkPhysicalDeviceProperties properties = {};
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
+	this->max_allocation_count = properties.limits.maxMemoryAllocationCount;
+
+	// the buddy strategy splits blocks in halves, the block size must be a power of two
+	this->block_size = MIN_BUDDY_SIZE;
+	while (this->block_size * 2 <= block_size)
+		this->block_size *= 2;
+}
+
+void MemoryAllocator::destroy(void)
+{
+	uint32_t n_leaked = 0;
+	for (block_t& block : this->blocks)
+	{
+		n_leaked += block.n_allocations;
+		vkFreeMemory(this->device, block.memory, nullptr);	// implicitly unmaps the block
+	}
+	n_leaked += this->n_device_allocations - this->blocks.size();	// dedicated allocations
+	if (n_leaked > 0)
+		std::cerr << "MemoryAllocator: " << n_leaked << " allocations were not freed!" << std::endl;
+
+	this->blocks.clear();
+	this->n_device_allocations = 0;
+}
+
+uint32_t MemoryAllocator::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < this->memory_properties.memoryTypeCount; i++)
+	{
+		// get bit at i
+		if ((type_filter & (1 << i)) && (this->memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	}
+
+	throw std::runtime_error("Found no correct memory type!");
+}
+
+VkDeviceMemory MemoryAllocator::allocate_device_memory(VkDeviceSize size, uint32_t memory_type, const void* next, uint8_t*& mapped)
+{
+	if (this->n_device_allocations >= this->max_allocation_count)
+		throw std::runtime_error("Exceeded maxMemoryAllocationCount!");
+
+	VkMemoryAllocateInfo mem_alloc_info = {};
+	mem_alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	mem_alloc_info.pNext = next;
+	mem_alloc_info.allocationSize = size;
+	mem_alloc_info.memoryTypeIndex = memory_type;
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(this->device, &mem_alloc_info, nullptr, &memory) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate device memory!");
+	this->n_device_allocations++;
+
+	// host visible memory stays mapped as long as it lives
+	mapped = nullptr;
+	if (this->memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		void* data;
+		if (vkMapMemory(this->device, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+			throw std::runtime_error("Failed to map device memory!");
+		mapped = static_cast<uint8_t*>(data);
+	}
+	return memory;
+}
+
+VkDeviceSize MemoryAllocator::block_size_of_type(uint32_t memory_type) const
+{
+	// small heaps (e.g. the 256MB device local + host visible heap) must not be filled by a few blocks
+	const VkDeviceSize heap_size = this->memory_properties.memoryHeaps[this->memory_properties.memoryTypes[memory_type].heapIndex].size;
+	VkDeviceSize size = this->block_size;
+	while (size > MIN_BUDDY_SIZE && size * 8 > heap_size)
+		size /= 2;
+	return size;
+}
+
+uint32_t MemoryAllocator::create_block(uint32_t memory_type, resource_t resource, strategy_t strategy)
+{
+	block_t block;
+	block.size = this->block_size_of_type(memory_type);
+	block.memory = this->allocate_device_memory(block.size, memory_type, nullptr, block.mapped);
+	block.memory_type = memory_type;
+	block.resource = resource;
+	block.strategy = strategy;
+	block.n_allocations = 0;
+	block.used = 0;
+	block.head = 0;
+	if (strategy == STRATEGY_BUDDY)
+	{
+		// at the beginning the whole block is one free buddy of the highest order
+		uint32_t n_orders = 1;
+		while ((MIN_BUDDY_SIZE << (n_orders - 1)) < block.size)
+			n_orders++;
+		block.free_lists.resize(n_orders);
+		block.free_lists[n_orders - 1].push_back(0);
+	}
+
+	this->blocks.push_back(std::move(block));
+	return static_cast<uint32_t>(this->blocks.size() - 1);
+}
+
+bool MemoryAllocator::allocate_from_block(block_t& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	if (block.strategy == STRATEGY_LINEAR)
+	{
+		VkDeviceSize aligned = (block.head + alignment - 1) / alignment * alignment;
+		if (aligned + size > block.size)
+			return false;
+		block.used += aligned + size - block.head;
+		block.head = aligned + size;
+		offset = aligned;
+		block.n_allocations++;
+		return true;
+	}
+
+	/* Buddy strategy: every buddy is aligned to its own size, so an allocation
+	   is aligned as well if the buddy is at least as big as the alignment. */
+	const VkDeviceSize needed = std::max(std::max(size, alignment), MIN_BUDDY_SIZE);
+	uint32_t order = 0;
+	while ((MIN_BUDDY_SIZE << order) < needed)
+		order++;
+
+	// smallest free buddy that is big enough
+	uint32_t k = order;
+	while (k < block.free_lists.size() && block.free_lists[k].empty())
+		k++;
+	if (k >= block.free_lists.size())
+		return false;
+
+	offset = block.free_lists[k].back();
+	block.free_lists[k].pop_back();
+
+	// split until the buddy has the requested order, the upper halves become free
+	while (k > order)
+	{
+		k--;
+		block.free_lists[k].push_back(offset + (MIN_BUDDY_SIZE << k));
+	}
+
+	block.allocated_orders[offset] = order;
+	block.used += MIN_BUDDY_SIZE << order;
+	block.n_allocations++;
+	return true;
+}
+
+void MemoryAllocator::free_in_block(block_t& block, VkDeviceSize offset)
+{
+	block.n_allocations--;
+	if (block.strategy == STRATEGY_LINEAR)
+	{
+		// memory of a linear block can only be reused as a whole
+		if (block.n_allocations == 0)
+		{
+			block.head = 0;
+			block.used = 0;
+		}
+		return;
+	}
+
+	auto it = block.allocated_orders.find(offset);
+	if (it == block.allocated_orders.end())
+		throw std::logic_error("Freed memory that was not allocated by this block!");
+	uint32_t order = it->second;
+	block.allocated_orders.erase(it);
+	block.used -= MIN_BUDDY_SIZE << order;
+
+	// merge with the buddy as long as the buddy is free as well
+	while (order + 1 < block.free_lists.size())
+	{
+		const VkDeviceSize buddy = offset ^ (MIN_BUDDY_SIZE << order);
+		std::vector<VkDeviceSize>& list = block.free_lists[order];
+		auto buddy_it = std::find(list.begin(), list.end(), buddy);
+		if (buddy_it == list.end())
+			break;
+
+		*buddy_it = list.back();
+		list.pop_back();
+		offset = std::min(offset, buddy);
+		order++;
+	}
+	block.free_lists[order].push_back(offset);
+}
+
+MemoryAllocator::allocation_t MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, resource_t resource, strategy_t strategy, bool dedicated, const VkMemoryDedicatedAllocateInfo& dedicated_info)
+{
+	const uint32_t memory_type = this->find_memory_type(requirements.memoryTypeBits, properties);
+
+	// large resources would waste most of a block, they get their own memory
+	if (requirements.size > this->block_size_of_type(memory_type) / 2)
+		dedicated = true;
+
+	allocation_t allocation = {};
+	if (dedicated)
+	{
+		allocation.memory = this->allocate_device_memory(requirements.size, memory_type, &dedicated_info, allocation.mapped);
+		allocation.offset = 0;
+		allocation.size = requirements.size;
+		allocation.block = DEDICATED;
+		return allocation;
+	}
+
+	uint32_t block_index = UINT32_MAX;
+	VkDeviceSize offset = 0;
+	for (uint32_t i = 0; i < this->blocks.size(); i++)
+	{
+		block_t& block = this->blocks[i];
+		if (block.memory_type == memory_type && block.resource == resource && block.strategy == strategy &&
+			this->allocate_from_block(block, requirements.size, requirements.alignment, offset))
+		{
+			block_index = i;
+			break;
+		}
+	}
+
+	if (block_index == UINT32_MAX)
+	{
+		block_index = this->create_block(memory_type, resource, strategy);
+		if (!this->allocate_from_block(this->blocks[block_index], requirements.size, requirements.alignment, offset))
+			throw std::runtime_error("Allocation doesn't fit into a new memory block!");
+	}
+
+	const block_t& block = this->blocks[block_index];
+	allocation.memory = block.memory;
+	allocation.offset = offset;
+	allocation.size = requirements.size;
+	allocation.mapped = (block.mapped != nullptr) ? block.mapped + offset : nullptr;
+	allocation.block = block_index;
+	return allocation;
+}
+
+MemoryAllocator::allocation_t MemoryAllocator::allocate_buffer(VkBuffer buffer, VkMemoryPropertyFlags properties, strategy_t strategy)
+{
+	// the driver can ask for dedicated memory
+	VkMemoryDedicatedRequirements dedicated_req = {};
+	dedicated_req.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+	dedicated_req.pNext = nullptr;
+
+	VkMemoryRequirements2 mem_req = {};
+	mem_req.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	mem_req.pNext = &dedicated_req;
+
+	VkBufferMemoryRequirementsInfo2 mem_req_info = {};
+	mem_req_info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	mem_req_info.pNext = nullptr;
+	mem_req_info.buffer = buffer;
+	vkGetBufferMemoryRequirements2(this->device, &mem_req_info, &mem_req);
+
+	VkMemoryDedicatedAllocateInfo dedicated_info = {};
+	dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicated_info.pNext = nullptr;
+	dedicated_info.image = VK_NULL_HANDLE;
+	dedicated_info.buffer = buffer;
+
+	const bool dedicated = dedicated_req.prefersDedicatedAllocation || dedicated_req.requiresDedicatedAllocation;
+	allocation_t allocation = this->allocate(mem_req.memoryRequirements, properties, RESOURCE_LINEAR, strategy, dedicated, dedicated_info);
+
+	if (vkBindBufferMemory(this->device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+		throw std::runtime_error("Failed to bind buffer memory!");
+	return allocation;
+}
+
+MemoryAllocator::allocation_t MemoryAllocator::allocate_image(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties, strategy_t strategy)
+{
+	// render targets are usually reported as "prefers dedicated allocation"
+	VkMemoryDedicatedRequirements dedicated_req = {};
+	dedicated_req.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+	dedicated_req.pNext = nullptr;
+
+	VkMemoryRequirements2 mem_req = {};
+	mem_req.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	mem_req.pNext = &dedicated_req;
+
+	VkImageMemoryRequirementsInfo2 mem_req_info = {};
+	mem_req_info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	mem_req_info.pNext = nullptr;
+	mem_req_info.image = image;
+	vkGetImageMemoryRequirements2(this->device, &mem_req_info, &mem_req);
+
+	VkMemoryDedicatedAllocateInfo dedicated_info = {};
+	dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicated_info.pNext = nullptr;
+	dedicated_info.image = image;
+	dedicated_info.buffer = VK_NULL_HANDLE;
+
+	const bool dedicated = dedicated_req.prefersDedicatedAllocation || dedicated_req.requiresDedicatedAllocation;
+	const resource_t resource = (tiling == VK_IMAGE_TILING_LINEAR) ? RESOURCE_LINEAR : RESOURCE_OPTIMAL;
+	allocation_t allocation = this->allocate(mem_req.memoryRequirements, properties, resource, strategy, dedicated, dedicated_info);
+
+	if (vkBindImageMemory(this->device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+		throw std::runtime_error("Failed to bind image memory!");
+	return allocation;
+}
+
+void MemoryAllocator::free(allocation_t& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+		return;
+
+	if (allocation.block == DEDICATED)
+	{
+		vkFreeMemory(this->device, allocation.memory, nullptr);
+		this->n_device_allocations--;
+	}
+	else
+	{
+		// empty blocks are kept, the next allocations of the same kind reuse them
+		this->free_in_block(this->blocks[allocation.block], allocation.offset);
+	}
+	allocation = {};
+}
+
+void MemoryAllocator::print_statistics(void) const
+{
+	std::cout << std::endl;
+	std::cout << "Device memory allocations: " << this->n_device_allocations << " of " << this->max_allocation_count << std::endl;
+	for (size_t i = 0; i < this->blocks.size(); i++)
+	{
+		const block_t& block = this->blocks[i];
+		std::cout << "Block #" << i << ": memory type " << block.memory_type
+				  << ", " << ((block.strategy == STRATEGY_BUDDY) ? "buddy" : "linear")
+				  << ", " << ((block.resource == RESOURCE_LINEAR) ? "buffers" : "optimal images")
+				  << ", " << block.used / 1024 << " / " << block.size / 1024 << " KB used by "
+				  << block.n_allocations << " allocations" << std::endl;
+	}
+}
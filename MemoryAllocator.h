@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+/* Sub-allocates device memory out of large blocks instead of calling vkAllocateMemory
+   for every resource. Every block belongs to one memory type, one allocation strategy and
+   either linear resources (buffers, linear images) or optimal images. Because linear and
+   optimal resources never share a block, bufferImageGranularity never has to be considered.
+   Host visible blocks are mapped once for their whole lifetime. */
+class MemoryAllocator
+{
+public:
+	enum strategy_t : uint32_t
+	{
+		STRATEGY_BUDDY = 0,		// general purpose, allocations can be freed in any order
+		STRATEGY_LINEAR			// bump allocation, the block is reused when all of its allocations have been freed. For buffers that live as long as the device
+	};
+
+	struct allocation_t
+	{
+		VkDeviceMemory memory;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		uint8_t* mapped;		// first byte of the allocation if the memory is host visible, nullptr otherwise
+		uint32_t block;			// DEDICATED if the allocation owns its memory
+	};
+
+	static constexpr uint32_t DEDICATED = UINT32_MAX;
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+private:
+	enum resource_t : uint32_t
+	{
+		RESOURCE_LINEAR = 0,
+		RESOURCE_OPTIMAL
+	};
+
+	struct block_t
+	{
+		VkDeviceMemory memory;
+		VkDeviceSize size;						// power of two for the buddy strategy
+		uint8_t* mapped;
+		uint32_t memory_type;
+		resource_t resource;
+		strategy_t strategy;
+		uint32_t n_allocations;
+		VkDeviceSize used;						// bytes handed out, including padding
+		VkDeviceSize head;						// linear strategy: next free byte
+		std::vector<std::vector<VkDeviceSize>> free_lists;			// buddy strategy: free offsets per order
+		std::unordered_map<VkDeviceSize, uint32_t> allocated_orders;	// buddy strategy: order of every allocated offset
+	};
+
+	static constexpr VkDeviceSize MIN_BUDDY_SIZE = 256;		// size of order 0
+
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	uint32_t max_allocation_count;
+	uint32_t n_device_allocations;		// number of vkAllocateMemory calls that are alive
+	VkDeviceSize block_size;
+	std::vector<block_t> blocks;
+
+	VkDeviceMemory allocate_device_memory(VkDeviceSize size, uint32_t memory_type, const void* next, uint8_t*& mapped);
+	VkDeviceSize block_size_of_type(uint32_t memory_type) const;
+	uint32_t create_block(uint32_t memory_type, resource_t resource, strategy_t strategy);
+	bool allocate_from_block(block_t& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+	void free_in_block(block_t& block, VkDeviceSize offset);
+	allocation_t allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, resource_t resource, strategy_t strategy, bool dedicated, const VkMemoryDedicatedAllocateInfo& dedicated_info);
+
+public:
+	MemoryAllocator(void);
+	virtual ~MemoryAllocator(void) = default;
+
+	void create(VkDevice device, VkPhysicalDevice physical_device, VkDeviceSize block_size = DEFAULT_BLOCK_SIZE);
+	void destroy(void);
+
+	uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+
+	// allocates memory and binds it to the resource
+	allocation_t allocate_buffer(VkBuffer buffer, VkMemoryPropertyFlags properties, strategy_t strategy = STRATEGY_BUDDY);
+	allocation_t allocate_image(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties, strategy_t strategy = STRATEGY_BUDDY);
+	void free(allocation_t& allocation);
+
+	void print_statistics(void) const;
+};
@@ -0,0 +1,472 @@
+#include "Mesh.h"
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+
+// vertices are compared bitwise, vertex_t has no padding
+struct vertex_hash_t
+{
+	size_t operator()(const Mesh::vertex_t& vertex) const
+	{
+		// FNV-1a
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&vertex);
+		uint64_t h = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < sizeof(Mesh::vertex_t); i++)
+		{
+			h ^= bytes[i];
+			h *= 0x100000001b3ull;
+		}
+		return static_cast<size_t>(h);
+	}
+};
+
+struct vertex_equal_t
+{
+	bool operator()(const Mesh::vertex_t& a, const Mesh::vertex_t& b) const { return memcmp(&a, &b, sizeof(Mesh::vertex_t)) == 0; }
+};
+
+// OBJ indices start at 1, negative indices count from the end
+static size_t resolve_obj_index(long index, size_t count, const std::string& path, size_t line_number)
+{
+	long resolved = (index > 0) ? index - 1 : static_cast<long>(count) + index;
+	if (index == 0 || resolved < 0 || resolved >= static_cast<long>(count))
+		throw std::runtime_error("Invalid index in OBJ file " + path + ", line " + std::to_string(line_number));
+	return static_cast<size_t>(resolved);
+}
+
+bool Mesh::load_obj(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+		return false;
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uv_coords;
+	std::vector<vertex_t> polygon;
+	this->vertices.clear();
+	this->indices.clear();
+
+	std::string line;
+	size_t line_number = 0;
+	while (std::getline(file, line))
+	{
+		line_number++;
+		const char* c = line.c_str();
+		while (isspace(*c))
+			c++;
+
+		if (c[0] == 'v' && isspace(c[1]))
+		{
+			glm::vec3 pos;
+			if (sscanf(c + 2, "%f %f %f", &pos.x, &pos.y, &pos.z) != 3)
+				throw std::runtime_error("Invalid position in OBJ file " + path + ", line " + std::to_string(line_number));
+			positions.push_back(pos);
+		}
+		else if (c[0] == 'v' && c[1] == 't' && isspace(c[2]))
+		{
+			glm::vec2 uv_coord(0.0f);
+			if (sscanf(c + 3, "%f %f", &uv_coord.x, &uv_coord.y) < 1)
+				throw std::runtime_error("Invalid texture coordinate in OBJ file " + path + ", line " + std::to_string(line_number));
+			uv_coords.push_back(glm::vec2(uv_coord.x, 1.0f - uv_coord.y));	// OBJ v points up, Vulkan images start at the top
+		}
+		else if (c[0] == 'v' && c[1] == 'n' && isspace(c[2]))
+		{
+			glm::vec3 normal;
+			if (sscanf(c + 3, "%f %f %f", &normal.x, &normal.y, &normal.z) != 3)
+				throw std::runtime_error("Invalid normal in OBJ file " + path + ", line " + std::to_string(line_number));
+			normals.push_back(normal);
+		}
+		else if (c[0] == 'f' && isspace(c[1]))
+		{
+			// corners are v, v/vt, v//vn or v/vt/vn
+			polygon.clear();
+			c++;
+			for (;;)
+			{
+				while (isspace(*c))
+					c++;
+				if (*c == '\0' || *c == '#')
+					break;
+
+				char* end;
+				vertex_t vertex = {};
+				long index = strtol(c, &end, 10);
+				if (end == c)
+					throw std::runtime_error("Invalid face in OBJ file " + path + ", line " + std::to_string(line_number));
+				vertex.pos = positions[resolve_obj_index(index, positions.size(), path, line_number)];
+				c = end;
+
+				if (*c == '/')
+				{
+					c++;
+					if (*c != '/')
+					{
+						index = strtol(c, &end, 10);
+						if (end == c)
+							throw std::runtime_error("Invalid face in OBJ file " + path + ", line " + std::to_string(line_number));
+						vertex.uv_coord = uv_coords[resolve_obj_index(index, uv_coords.size(), path, line_number)];
+						c = end;
+					}
+					if (*c == '/')
+					{
+						c++;
+						index = strtol(c, &end, 10);
+						if (end == c)
+							throw std::runtime_error("Invalid face in OBJ file " + path + ", line " + std::to_string(line_number));
+						vertex.normal = normals[resolve_obj_index(index, normals.size(), path, line_number)];
+						c = end;
+					}
+				}
+				polygon.push_back(vertex);
+			}
+			if (polygon.size() < 3)
+				throw std::runtime_error("Face with less than 3 corners in OBJ file " + path + ", line " + std::to_string(line_number));
+
+			// polygons are triangulated as a fan, every corner is its own vertex until the mesh is welded
+			for (size_t i = 1; i + 1 < polygon.size(); i++)
+			{
+				const vertex_t* corners[3] = { &polygon[0], &polygon[i], &polygon[i + 1] };
+				for (const vertex_t* corner : corners)
+				{
+					this->indices.push_back(static_cast<uint32_t>(this->vertices.size()));
+					this->vertices.push_back(*corner);
+				}
+			}
+		}
+	}
+
+	if (this->indices.empty())
+		throw std::runtime_error("OBJ file " + path + " has no faces");
+	return true;
+}
+
+void Mesh::create(const std::vector<vertex_t>& vertices, const std::vector<uint32_t>& indices)
+{
+	this->vertices = vertices;
+	this->indices = indices;
+}
+
+void Mesh::clear_normals(void)
+{
+	for (vertex_t& vertex : this->vertices)
+		vertex.normal = glm::vec3(0.0f);
+}
+
+void Mesh::weld(void)
+{
+	std::unordered_map<vertex_t, uint32_t, vertex_hash_t, vertex_equal_t> unique;
+	unique.reserve(this->vertices.size());
+	std::vector<uint32_t> remap(this->vertices.size());
+	std::vector<vertex_t> welded;
+	for (size_t i = 0; i < this->vertices.size(); i++)
+	{
+		auto inserted = unique.emplace(this->vertices[i], static_cast<uint32_t>(welded.size()));
+		if (inserted.second)
+			welded.push_back(this->vertices[i]);
+		remap[i] = inserted.first->second;
+	}
+
+	for (uint32_t& index : this->indices)
+		index = remap[index];
+	this->vertices.swap(welded);
+}
+
+void Mesh::generate_normals(void)
+{
+	std::vector<glm::vec3> normals(this->vertices.size(), glm::vec3(0.0f));
+	for (size_t i = 0; i + 2 < this->indices.size(); i += 3)
+	{
+		const glm::vec3& p0 = this->vertices[this->indices[i]].pos;
+		glm::vec3 normal = glm::cross(this->vertices[this->indices[i + 1]].pos - p0, this->vertices[this->indices[i + 2]].pos - p0);	// length is twice the area
+		for (uint32_t k = 0; k < 3; k++)
+			normals[this->indices[i + k]] += normal;
+	}
+
+	for (size_t i = 0; i < this->vertices.size(); i++)
+	{
+		vertex_t& vertex = this->vertices[i];
+		if (vertex.normal.x != 0.0f || vertex.normal.y != 0.0f || vertex.normal.z != 0.0f)
+			continue;
+		float length = glm::length(normals[i]);
+		vertex.normal = (length > 0.0f) ? normals[i] / length : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+}
+
+float Mesh::get_vertex_score(int32_t cache_position, uint32_t n_remaining)
+{
+	// the vertex isn't used by any triangle that is still to be emitted
+	if (n_remaining == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cache_position >= 0)
+	{
+		// the vertices of the last triangle get a fixed score, otherwise the order degenerates into strips
+		if (cache_position < 3)
+			score = 0.75f;
+		else
+			score = powf(1.0f - (cache_position - 3) * (1.0f / (CACHE_SIZE - 3)), 1.5f);
+	}
+
+	// vertices with few remaining triangles are finished first, they leave the cache for good then
+	score += 2.0f * powf(static_cast<float>(n_remaining), -0.5f);
+	return score;
+}
+
+void Mesh::optimize_vertex_cache(void)
+{
+	/* Tom Forsyth, "Linear-Speed Vertex Cache Optimisation". The triangle with the highest score
+	   is emitted next, a triangle scores high if its vertices are in the modeled LRU cache and have
+	   few remaining triangles. Only the triangles of cached vertices are candidates, scores are
+	   updated for them after every triangle. */
+	const size_t n_vertices = this->vertices.size();
+	const size_t n_triangles = this->indices.size() / 3;
+	if (n_triangles == 0)
+		return;
+
+	// triangles that use a vertex, emitted triangles are removed
+	std::vector<uint32_t> n_remaining(n_vertices, 0);
+	for (uint32_t index : this->indices)
+		n_remaining[index]++;
+	std::vector<uint32_t> adjacency_offset(n_vertices + 1, 0);
+	for (size_t i = 0; i < n_vertices; i++)
+		adjacency_offset[i + 1] = adjacency_offset[i] + n_remaining[i];
+	std::vector<uint32_t> adjacency(this->indices.size());
+	std::vector<uint32_t> adjacency_fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+	for (size_t i = 0; i < this->indices.size(); i++)
+		adjacency[adjacency_fill[this->indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+	std::vector<int32_t> cache_position(n_vertices, -1);
+	std::vector<float> vertex_score(n_vertices);
+	for (size_t i = 0; i < n_vertices; i++)
+		vertex_score[i] = get_vertex_score(-1, n_remaining[i]);
+
+	std::vector<float> triangle_score(n_triangles);
+	std::vector<bool> emitted(n_triangles, false);
+	int64_t best_triangle = 0;
+	for (size_t i = 0; i < n_triangles; i++)
+	{
+		triangle_score[i] = vertex_score[this->indices[i * 3]] + vertex_score[this->indices[i * 3 + 1]] + vertex_score[this->indices[i * 3 + 2]];
+		if (triangle_score[i] > triangle_score[best_triangle])
+			best_triangle = static_cast<int64_t>(i);
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(this->indices.size());
+	uint32_t cache[CACHE_SIZE + 3];
+	uint32_t new_cache[CACHE_SIZE + 3];
+	uint32_t cache_count = 0;
+	size_t next_unemitted = 0;
+	while (output.size() < this->indices.size())
+	{
+		// no cached vertex has triangles left, the next triangle in input order starts over
+		if (best_triangle < 0)
+		{
+			while (emitted[next_unemitted])
+				next_unemitted++;
+			best_triangle = static_cast<int64_t>(next_unemitted);
+		}
+
+		const uint32_t* triangle = &this->indices[best_triangle * 3];
+		emitted[best_triangle] = true;
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t vertex = triangle[k];
+			output.push_back(vertex);
+
+			uint32_t* begin = &adjacency[adjacency_offset[vertex]];
+			uint32_t* end = begin + n_remaining[vertex];
+			std::swap(*std::find(begin, end, static_cast<uint32_t>(best_triangle)), *(end - 1));
+			n_remaining[vertex]--;
+		}
+
+		// the vertices of the triangle move to the front of the cache, the last ones fall out
+		uint32_t new_count = 0;
+		for (uint32_t k = 0; k < 3; k++)
+			new_cache[new_count++] = triangle[k];
+		for (uint32_t i = 0; i < cache_count; i++)
+		{
+			if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+				new_cache[new_count++] = cache[i];
+		}
+
+		best_triangle = -1;
+		float best_score = -1.0f;
+		for (uint32_t i = 0; i < new_count; i++)
+		{
+			uint32_t vertex = new_cache[i];
+			cache_position[vertex] = (i < CACHE_SIZE) ? static_cast<int32_t>(i) : -1;
+			vertex_score[vertex] = get_vertex_score(cache_position[vertex], n_remaining[vertex]);
+		}
+		for (uint32_t i = 0; i < new_count; i++)
+		{
+			uint32_t vertex = new_cache[i];
+			for (uint32_t j = adjacency_offset[vertex]; j < adjacency_offset[vertex] + n_remaining[vertex]; j++)
+			{
+				uint32_t t = adjacency[j];
+				triangle_score[t] = vertex_score[this->indices[t * 3]] + vertex_score[this->indices[t * 3 + 1]] + vertex_score[this->indices[t * 3 + 2]];
+				if (i < CACHE_SIZE && triangle_score[t] > best_score)
+				{
+					best_score = triangle_score[t];
+					best_triangle = t;
+				}
+			}
+		}
+
+		cache_count = std::min(new_count, CACHE_SIZE);
+		memcpy(cache, new_cache, cache_count * sizeof(uint32_t));
+	}
+
+	this->indices.swap(output);
+}
+
+uint32_t Mesh::simulate_fifo_cache(const std::vector<uint32_t>& indices, size_t n_vertices, uint32_t cache_size, std::vector<uint8_t>* triangle_misses)
+{
+	// a vertex is in the cache if fewer than cache_size misses happened since it was transformed
+	std::vector<uint32_t> timestamp(n_vertices, 0);
+	uint32_t time = cache_size + 1;
+	uint32_t n_misses = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		bool miss = time - timestamp[indices[i]] > cache_size;
+		if (miss)
+		{
+			timestamp[indices[i]] = time++;
+			n_misses++;
+		}
+		if (triangle_misses != nullptr)
+			(*triangle_misses)[i / 3] += miss ? 1 : 0;
+	}
+	return n_misses;
+}
+
+void Mesh::optimize_overdraw(float threshold)
+{
+	/* The index buffer is split into clusters where the cache optimizer had to start over (all
+	   three vertices of a triangle miss the cache) and, inside of these, wherever the ACMR of the
+	   cluster so far is good enough to pay for a cold cache at its end. Clusters are drawn
+	   outside-in: the further a cluster lies out in the direction it faces, the more it occludes,
+	   so it is drawn first. The new order is only kept if the ACMR doesn't get worse than
+	   threshold allows. */
+	const size_t n_triangles = this->indices.size() / 3;
+	if (n_triangles < 2)
+		return;
+
+	std::vector<uint8_t> triangle_misses(n_triangles, 0);
+	uint32_t n_misses = simulate_fifo_cache(this->indices, this->vertices.size(), FIFO_CACHE_SIZE, &triangle_misses);
+
+	const float target_acmr = static_cast<float>(n_misses) / n_triangles * threshold;
+	std::vector<uint32_t> cluster_begin;
+	uint32_t cluster_misses = 0;
+	for (size_t i = 0; i < n_triangles; i++)
+	{
+		size_t cluster_size = cluster_begin.empty() ? 0 : i - cluster_begin.back();
+		bool hard_boundary = triangle_misses[i] == 3;
+		bool soft_boundary = cluster_size >= MIN_CLUSTER_SIZE && cluster_misses <= target_acmr * cluster_size;
+		if (i == 0 || hard_boundary || soft_boundary)
+		{
+			cluster_begin.push_back(static_cast<uint32_t>(i));
+			cluster_misses = 0;
+		}
+		cluster_misses += triangle_misses[i];
+	}
+	if (cluster_begin.size() < 2)
+		return;
+	cluster_begin.push_back(static_cast<uint32_t>(n_triangles));
+
+	// area weighted centroids and normals
+	size_t n_clusters = cluster_begin.size() - 1;
+	std::vector<glm::vec3> cluster_centroid(n_clusters, glm::vec3(0.0f));
+	std::vector<glm::vec3> cluster_normal(n_clusters, glm::vec3(0.0f));
+	glm::vec3 mesh_centroid(0.0f);
+	float mesh_area = 0.0f;
+	for (size_t c = 0; c < n_clusters; c++)
+	{
+		float cluster_area = 0.0f;
+		for (uint32_t t = cluster_begin[c]; t < cluster_begin[c + 1]; t++)
+		{
+			const glm::vec3& p0 = this->vertices[this->indices[t * 3]].pos;
+			const glm::vec3& p1 = this->vertices[this->indices[t * 3 + 1]].pos;
+			const glm::vec3& p2 = this->vertices[this->indices[t * 3 + 2]].pos;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal);
+			cluster_normal[c] += normal;
+			cluster_centroid[c] += (p0 + p1 + p2) * (area / 3.0f);
+			cluster_area += area;
+		}
+		mesh_centroid += cluster_centroid[c];
+		mesh_area += cluster_area;
+		if (cluster_area > 0.0f)
+			cluster_centroid[c] /= cluster_area;
+	}
+	if (mesh_area > 0.0f)
+		mesh_centroid /= mesh_area;
+
+	std::vector<float> cluster_sort_key(n_clusters);
+	std::vector<uint32_t> cluster_order(n_clusters);
+	for (size_t c = 0; c < n_clusters; c++)
+	{
+		float length = glm::length(cluster_normal[c]);
+		cluster_sort_key[c] = (length > 0.0f) ? glm::dot(cluster_centroid[c] - mesh_centroid, cluster_normal[c] / length) : 0.0f;
+		cluster_order[c] = static_cast<uint32_t>(c);
+	}
+	std::stable_sort(cluster_order.begin(), cluster_order.end(), [&cluster_sort_key](uint32_t a, uint32_t b) { return cluster_sort_key[a] > cluster_sort_key[b]; });
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(this->indices.size());
+	for (uint32_t c : cluster_order)
+		sorted.insert(sorted.end(), this->indices.begin() + cluster_begin[c] * 3, this->indices.begin() + cluster_begin[c + 1] * 3);
+
+	uint32_t n_sorted_misses = simulate_fifo_cache(sorted, this->vertices.size(), FIFO_CACHE_SIZE, nullptr);
+	if (n_sorted_misses <= n_misses * threshold)
+		this->indices.swap(sorted);
+}
+
+void Mesh::optimize_vertex_fetch(void)
+{
+	// vertices are stored in the order the index buffer references them first, unused vertices are dropped
+	std::vector<uint32_t> remap(this->vertices.size(), UINT32_MAX);
+	std::vector<vertex_t> ordered;
+	ordered.reserve(this->vertices.size());
+	for (uint32_t& index : this->indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = static_cast<uint32_t>(ordered.size());
+			ordered.push_back(this->vertices[index]);
+		}
+		index = remap[index];
+	}
+	this->vertices.swap(ordered);
+}
+
+Mesh::statistics_t Mesh::analyze_vertex_cache(uint32_t cache_size) const
+{
+	uint32_t n_misses = simulate_fifo_cache(this->indices, this->vertices.size(), cache_size, nullptr);
+
+	statistics_t statistics = {};
+	statistics.acmr = this->indices.empty() ? 0.0f : static_cast<float>(n_misses) / (this->indices.size() / 3);
+	statistics.atvr = this->vertices.empty() ? 0.0f : static_cast<float>(n_misses) / this->vertices.size();
+	return statistics;
+}
+
+void Mesh::get_bounds(glm::vec3& min, glm::vec3& max) const
+{
+	min = glm::vec3(0.0f);
+	max = glm::vec3(0.0f);
+	if (this->vertices.empty())
+		return;
+
+	min = max = this->vertices[0].pos;
+	for (const vertex_t& vertex : this->vertices)
+	{
+		min = glm::min(min, vertex.pos);
+		max = glm::max(max, vertex.pos);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/* Indexed triangle mesh that is loaded from an OBJ file and optimized for rendering. The
+   optimizations run in this order:
+   1. weld: identical vertices are merged, OBJ files store every face corner on its own,
+      generate_normals afterwards gives vertices without normal a smooth one
+   2. optimize_vertex_cache: triangles are reordered for the post-transform vertex cache (Forsyth)
+   3. optimize_overdraw: clusters of triangles are sorted outside-in, as long as the cache efficiency stays
+   4. optimize_vertex_fetch: vertices are reordered by their first use, the index buffer is read linearly */
+class Mesh
+{
+public:
+	struct vertex_t
+	{
+		glm::vec3 pos;
+		glm::vec3 normal;
+		glm::vec2 uv_coord;
+	};
+
+	// efficiency of the post-transform vertex cache, lower is better
+	struct statistics_t
+	{
+		float acmr;		// average cache miss ratio, transformed vertices per triangle (0.5 - 3)
+		float atvr;		// average transformed vertex ratio, transformed vertices per vertex (1 is optimal)
+	};
+
+	static constexpr uint32_t CACHE_SIZE = 32;				// LRU cache the optimizer models
+	static constexpr uint32_t FIFO_CACHE_SIZE = 16;			// FIFO cache the statistics simulate, close to real hardware
+	static constexpr float OVERDRAW_THRESHOLD = 1.05f;		// ACMR may get worse by this factor for less overdraw
+	static constexpr uint32_t MIN_CLUSTER_SIZE = 256;		// triangles, smaller clusters cost too many cache misses at their borders
+
+private:
+	std::vector<vertex_t> vertices;
+	std::vector<uint32_t> indices;
+
+	static float get_vertex_score(int32_t cache_position, uint32_t n_remaining);
+	// returns the number of cache misses, optionally adds the misses of every triangle
+	static uint32_t simulate_fifo_cache(const std::vector<uint32_t>& indices, size_t n_vertices, uint32_t cache_size, std::vector<uint8_t>* triangle_misses);
+
+public:
+	Mesh(void) = default;
+	virtual ~Mesh(void) = default;
+
+	// returns false if the file can't be opened, throws if the file is not a valid OBJ file. Missing normals are 0
+	bool load_obj(const std::string& path);
+	void create(const std::vector<vertex_t>& vertices, const std::vector<uint32_t>& indices);
+
+	// vertices that only differ in their normal can be welded afterwards, for vertex layouts without normal
+	void clear_normals(void);
+	void weld(void);
+	// area weighted average of the triangle normals, only for vertices whose normal is 0
+	void generate_normals(void);
+	void optimize_vertex_cache(void);
+	void optimize_overdraw(float threshold = OVERDRAW_THRESHOLD);
+	void optimize_vertex_fetch(void);
+
+	statistics_t analyze_vertex_cache(uint32_t cache_size = FIFO_CACHE_SIZE) const;
+	void get_bounds(glm::vec3& min, glm::vec3& max) const;
+
+	const std::vector<vertex_t>& get_vertices(void) const { return this->vertices; }
+	const std::vector<uint32_t>& get_indices(void) const { return this->indices; }
+	size_t get_triangle_count(void) const { return this->indices.size() / 3; }
+};
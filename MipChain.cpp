@@ -0,0 +1,78 @@
+#include "MipChain.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+uint32_t MipChain::get_level_count(uint32_t width, uint32_t height)
+{
+	uint32_t extent = (width > height) ? width : height;
+	uint32_t n_levels = 1;
+	while (extent > 1)
+	{
+		extent >>= 1;
+		n_levels++;
+	}
+	return n_levels;
+}
+
+VkDeviceSize MipChain::get_level_offset(uint32_t width, uint32_t height, uint32_t level)
+{
+	VkDeviceSize offset = 0;
+	for (uint32_t i = 0; i < level; i++)
+		offset += (VkDeviceSize)get_level_extent(width, i) * get_level_extent(height, i) * PIXEL_SIZE;
+	return offset;
+}
+
+void MipChain::downsample_rgba8(const uint8_t* src, uint32_t src_width, uint32_t src_height, uint8_t* dst)
+{
+	uint32_t dst_width = get_level_extent(src_width, 1);
+	uint32_t dst_height = get_level_extent(src_height, 1);
+	size_t src_pitch = (size_t)src_width * PIXEL_SIZE;
+
+	for (uint32_t y = 0; y < dst_height; y++)
+	{
+		const uint8_t* row0 = src + (size_t)(2 * y) * src_pitch;
+		const uint8_t* row1 = src + (size_t)((2 * y + 1 < src_height) ? 2 * y + 1 : src_height - 1) * src_pitch;
+		uint8_t* out = dst + (size_t)y * dst_width * PIXEL_SIZE;
+		uint32_t x = 0;
+
+#if defined(__SSE2__)
+		/* Four source pixels of both rows give two destination pixels. The channels are widened
+		   to 16 bit, so the sum of four pixels is exact and rounded like the scalar path. */
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		for (; 2 * x + 4 <= src_width; x += 2)
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + (size_t)(2 * x) * PIXEL_SIZE));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + (size_t)(2 * x) * PIXEL_SIZE));
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));	// pixels 0 and 1
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));	// pixels 2 and 3
+			lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+			hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+			__m128i sum = _mm_unpacklo_epi64(lo, hi);
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + (size_t)x * PIXEL_SIZE), _mm_packus_epi16(sum, zero));
+		}
+#endif
+		for (; x < dst_width; x++)
+		{
+			uint32_t x0 = 2 * x;
+			uint32_t x1 = (x0 + 1 < src_width) ? x0 + 1 : src_width - 1;
+			for (uint32_t c = 0; c < PIXEL_SIZE; c++)
+			{
+				uint32_t sum = row0[x0 * PIXEL_SIZE + c] + row0[x1 * PIXEL_SIZE + c] + row1[x0 * PIXEL_SIZE + c] + row1[x1 * PIXEL_SIZE + c];
+				out[x * PIXEL_SIZE + c] = static_cast<uint8_t>((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+void MipChain::generate_rgba8(uint8_t* chain, uint32_t width, uint32_t height, uint32_t n_levels)
+{
+	for (uint32_t level = 1; level < n_levels; level++)
+	{
+		const uint8_t* src = chain + get_level_offset(width, height, level - 1);
+		uint8_t* dst = chain + get_level_offset(width, height, level);
+		downsample_rgba8(src, get_level_extent(width, level - 1), get_level_extent(height, level - 1), dst);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+/* Mip chain of an RGBA8 image that is generated on the CPU. Used if the format can't be blitted
+   with linear filtering. All levels are stored tightly packed one after another, level 0 first. */
+class MipChain
+{
+private:
+	static constexpr uint32_t PIXEL_SIZE = 4;
+
+public:
+	// number of levels down to 1x1
+	static uint32_t get_level_count(uint32_t width, uint32_t height);
+	static uint32_t get_level_extent(uint32_t extent, uint32_t level) { return (extent >> level) > 0 ? (extent >> level) : 1; }
+	static VkDeviceSize get_level_offset(uint32_t width, uint32_t height, uint32_t level);
+	static VkDeviceSize get_chain_size(uint32_t width, uint32_t height, uint32_t n_levels) { return get_level_offset(width, height, n_levels); }
+
+	// 2x2 box filter, an odd last row or column is averaged with itself
+	static void downsample_rgba8(const uint8_t* src, uint32_t src_width, uint32_t src_height, uint8_t* dst);
+	// level 0 must already be stored in the chain, the other levels are written
+	static void generate_rgba8(uint8_t* chain, uint32_t width, uint32_t height, uint32_t n_levels);
+};
@@ -0,0 +1,148 @@
+#include "PipelineCache.h"
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+PipelineCache::PipelineCache(void)
+{
+	this->device = VK_NULL_HANDLE;
+	this->cache = VK_NULL_HANDLE;
+	this->properties = {};
+	this->loaded_size = 0;
+}
+
+uint64_t PipelineCache::hash(const uint8_t* data, size_t size)
+{
+	// FNV-1a
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		h ^= data[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+bool PipelineCache::is_valid(const file_header_t& header, const std::string& data) const
+{
+	if (header.magic != MAGIC || header.version != VERSION)
+		return false;
+	// a cache of another device or driver is useless, drivers may even crash on it
+	if (header.vendor_id != this->properties.vendorID || header.device_id != this->properties.deviceID || header.driver_version != this->properties.driverVersion)
+		return false;
+	if (memcmp(header.uuid, this->properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		return false;
+	if (header.data_size != data.size() || header.data_hash != hash(reinterpret_cast<const uint8_t*>(data.data()), data.size()))
+		return false;
+
+	// the data itself starts with the header the driver has written
+	VkPipelineCacheHeaderVersionOne driver_header;
+	if (data.size() < sizeof(driver_header))
+		return false;
+	memcpy(&driver_header, data.data(), sizeof(driver_header));
+	return driver_header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		driver_header.vendorID == this->properties.vendorID && driver_header.deviceID == this->properties.deviceID &&
+		memcmp(driver_header.pipelineCacheUUID, this->properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool PipelineCache::load(std::string& data)
+{
+	std::ifstream file(this->path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return false;
+
+	size_t file_size = (size_t)file.tellg();
+	file_header_t header;
+	if (file_size < sizeof(header))
+		return false;
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	data.resize(file_size - sizeof(header));
+	file.read(&data[0], data.size());
+	if (!file.good())
+		return false;
+	return this->is_valid(header, data);
+}
+
+void PipelineCache::create(VkDevice device, VkPhysicalDevice physical_device, const std::string& path)
+{
+	this->device = device;
+	this->path = path;
+	this->loaded_size = 0;
+	vkGetPhysicalDeviceProperties(physical_device, &this->properties);
+
+	// an invalid file is ignored, it is replaced when the cache is saved
+	std::string data;
+	if (!path.empty() && this->load(data))
+		this->loaded_size = data.size();
+	else if (!path.empty())
+		std::cout << "Pipeline cache " << path << " is missing or invalid, pipelines are compiled from scratch" << std::endl;
+
+	VkPipelineCacheCreateInfo cache_info = {};
+	cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cache_info.pNext = nullptr;
+	cache_info.flags = 0;
+	cache_info.initialDataSize = this->loaded_size;
+	cache_info.pInitialData = (this->loaded_size > 0) ? data.data() : nullptr;
+	if (vkCreatePipelineCache(this->device, &cache_info, nullptr, &this->cache) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create pipeline cache!");
+}
+
+void PipelineCache::destroy(void)
+{
+	vkDestroyPipelineCache(this->device, this->cache, nullptr);
+	this->cache = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::save(void)
+{
+	if (this->path.empty())
+		return true;
+
+	size_t size = 0;
+	if (vkGetPipelineCacheData(this->device, this->cache, &size, nullptr) != VK_SUCCESS)
+		return false;
+	std::vector<uint8_t> data(size);
+	if (vkGetPipelineCacheData(this->device, this->cache, &size, data.data()) != VK_SUCCESS)
+		return false;
+
+	file_header_t header = {};
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.vendor_id = this->properties.vendorID;
+	header.device_id = this->properties.deviceID;
+	header.driver_version = this->properties.driverVersion;
+	memcpy(header.uuid, this->properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.data_size = size;
+	header.data_hash = hash(data.data(), size);
+
+	std::string tmp_path = this->path + ".tmp";
+	{
+		std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data.data()), size);
+		if (!file.good())
+		{
+			file.close();
+			std::remove(tmp_path.c_str());
+			return false;
+		}
+	}
+
+	// rename replaces the file at once on POSIX, on Windows it fails if the file exists
+	if (std::rename(tmp_path.c_str(), this->path.c_str()) != 0)
+	{
+		std::remove(this->path.c_str());
+		if (std::rename(tmp_path.c_str(), this->path.c_str()) != 0)
+		{
+			std::remove(tmp_path.c_str());
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <cstdint>
+
+/* Pipeline cache that is stored on disk between runs, so the driver doesn't compile the shaders
+   again on every start. The file begins with a header of its own that identifies the device and
+   driver the data was created with, the data is only passed to the driver if everything matches.
+   The file is written to a temporary file first and renamed afterwards, an interrupted write
+   never leaves a broken cache behind. */
+class PipelineCache
+{
+private:
+	struct file_header_t
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendor_id;
+		uint32_t device_id;
+		uint32_t driver_version;
+		uint8_t uuid[VK_UUID_SIZE];		// pipelineCacheUUID of the device
+		uint64_t data_size;
+		uint64_t data_hash;				// detects truncated or corrupted data
+	};
+
+	static constexpr uint32_t MAGIC = 0x43505646;	// "FVPC"
+	static constexpr uint32_t VERSION = 1;
+
+	VkDevice device;
+	VkPipelineCache cache;
+	VkPhysicalDeviceProperties properties;
+	std::string path;
+	size_t loaded_size;				// bytes of cache data that were loaded from the file
+
+	static uint64_t hash(const uint8_t* data, size_t size);
+	bool load(std::string& data);
+	bool is_valid(const file_header_t& header, const std::string& data) const;
+
+public:
+	PipelineCache(void);
+	virtual ~PipelineCache(void) = default;
+
+	// an empty path creates a cache that is not stored
+	void create(VkDevice device, VkPhysicalDevice physical_device, const std::string& path);
+	void destroy(void);
+	// writes the cache to the file, returns false if the file can't be written
+	bool save(void);
+
+	VkPipelineCache get(void) const { return this->cache; }
+	size_t get_loaded_size(void) const { return this->loaded_size; }
+};
@@ -0,0 +1,137 @@
+#include "SceneFile.h"
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+
+const uint8_t SceneFile::IDENTIFIER[8] = { 'F', 'V', 'S', 'C', 'E', 'N', 'E', 0x1A };
+
+static_assert(sizeof(SceneFile::draw_t) == 24, "draw_t is stored in the file as it is");
+
+SceneFile::SceneFile(void)
+{
+	this->header = nullptr;
+}
+
+bool SceneFile::load(const std::string& path)
+{
+	this->close();
+	if (!this->file.open(path))
+		return false;
+
+	/* Only the header and the draws are validated, the sections are used as they are. Draws are
+	   checked against the index section and their indices against the vertex section, a broken
+	   draw would read outside of the index or vertex buffer. */
+	const uint8_t* data = this->file.get_data();
+	size_t file_size = this->file.get_size();
+	if (file_size < sizeof(header_t))
+		throw std::runtime_error("Scene file is too small: " + path);
+	const header_t* header = reinterpret_cast<const header_t*>(data);
+	if (memcmp(header->identifier, IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+		throw std::runtime_error("Not a scene file: " + path);
+	if (header->version < MIN_VERSION || header->version > VERSION)
+		throw std::runtime_error("Unsupported scene file version " + std::to_string(header->version) + ": " + path);
+	if (header->vertex_stride == 0 || header->vertex_size % header->vertex_stride != 0)
+		throw std::runtime_error("Invalid vertex section in scene file: " + path);
+
+	uint64_t sections[3][2] = {
+		{ header->vertex_offset, header->vertex_size },
+		{ header->index_offset, header->index_size },
+		{ header->draw_offset, (uint64_t)header->draw_count * sizeof(draw_t) }
+	};
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		// the padding belongs to the section, host memory imports read it
+		uint64_t padded_size = (sections[i][1] + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+		if (sections[i][0] % SECTION_ALIGNMENT != 0 || sections[i][0] > file_size || padded_size > file_size - sections[i][0])
+			throw std::runtime_error("Scene file is truncated or corrupt: " + path);
+	}
+
+	const draw_t* draws = reinterpret_cast<const draw_t*>(data + header->draw_offset);
+	for (uint32_t i = 0; i < header->draw_count; i++)
+	{
+		uint64_t index_size = (draws[i].index_type == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t);
+		if ((draws[i].index_type != VK_INDEX_TYPE_UINT16 && draws[i].index_type != VK_INDEX_TYPE_UINT32) || draws[i].index_offset % index_size != 0 ||
+			draws[i].index_offset > header->index_size || (uint64_t)draws[i].index_count * index_size > header->index_size - draws[i].index_offset)
+			throw std::runtime_error("Invalid draw " + std::to_string(i) + " in scene file: " + path);
+
+		// the largest index is searched, this touches every page of the index section once
+		const uint8_t* indices = data + header->index_offset + draws[i].index_offset;
+		uint32_t max_index = 0;
+		for (uint32_t j = 0; j < draws[i].index_count; j++)
+		{
+			uint32_t index;
+			if (draws[i].index_type == VK_INDEX_TYPE_UINT16)
+				index = reinterpret_cast<const uint16_t*>(indices)[j];
+			else
+				index = reinterpret_cast<const uint32_t*>(indices)[j];
+			max_index = (index > max_index) ? index : max_index;
+		}
+		uint64_t vertex_count = header->vertex_size / header->vertex_stride;
+		if (draws[i].index_count > 0 && (draws[i].vertex_offset < 0 || (uint64_t)draws[i].vertex_offset + max_index >= vertex_count))
+			throw std::runtime_error("Draw " + std::to_string(i) + " reads outside of the vertices in scene file: " + path);
+	}
+
+	this->header = header;
+	return true;
+}
+
+void SceneFile::close(void)
+{
+	this->file.close();
+	this->header = nullptr;
+}
+
+void SceneFile::save(const std::string& path, uint32_t vertex_stride, const void* vertices, size_t vertex_size, const void* indices, size_t index_size,
+	const draw_t* draws, uint32_t n_draws, const glm::mat4& transform)
+{
+	auto align = [](uint64_t offset) { return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT; };
+
+	header_t header = {};
+	memcpy(header.identifier, IDENTIFIER, sizeof(IDENTIFIER));
+	header.version = VERSION;
+	header.vertex_stride = vertex_stride;
+	header.vertex_offset = align(sizeof(header_t));
+	header.vertex_size = vertex_size;
+	header.index_offset = align(header.vertex_offset + vertex_size);
+	header.index_size = index_size;
+	header.draw_offset = align(header.index_offset + index_size);
+	header.draw_count = n_draws;
+	header.reserved = 0;
+	memcpy(header.transform, &transform[0][0], sizeof(header.transform));
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open " + path + " for writing!");
+
+	// every section is padded up to the alignment, host memory imports need whole pages
+	const uint64_t offsets[3] = { header.vertex_offset, header.index_offset, header.draw_offset };
+	const void* sections[3] = { vertices, indices, draws };
+	const uint64_t sizes[3] = { vertex_size, index_size, (uint64_t)n_draws * sizeof(draw_t) };
+	const char padding[SECTION_ALIGNMENT] = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header_t));
+	uint64_t written = sizeof(header_t);
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		file.write(padding, offsets[i] - written);
+		file.write(static_cast<const char*>(sections[i]), sizes[i]);
+		written = offsets[i] + sizes[i];
+	}
+	file.write(padding, align(written) - written);
+	if (!file.good())
+		throw std::runtime_error("Failed to write " + path + "!");
+}
+
+SceneFile::draw_t SceneFile::get_draw(uint32_t draw) const
+{
+	draw_t result = reinterpret_cast<const draw_t*>(this->file.get_data() + this->header->draw_offset)[draw];
+	if (this->header->version < 2)
+		result.material = 0;
+	return result;
+}
+
+glm::mat4 SceneFile::get_transform(void) const
+{
+	glm::mat4 transform;
+	memcpy(&transform[0][0], this->header->transform, sizeof(this->header->transform));
+	return transform;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <cstdint>
+#include "MappedFile.h"
+
+/* Binary scene file that is used as it is, without parsing. A header gives the offset and
+   size of three sections:
+   - vertices: packed vertices as they are stored in the vertex buffer
+   - indices: index data of all draws, 16 and 32 bit indices are mixed
+   - draws: one draw_t per draw
+   Sections start at multiples of SECTION_ALIGNMENT and are padded up to it. In a memory mapping
+   they are page aligned, they can be copied into staging memory or imported as host memory. */
+class SceneFile
+{
+public:
+	static constexpr uint32_t VERSION = 2;				// 2 added the material of the draws
+	static constexpr uint32_t MIN_VERSION = 1;			// older files are read with material 0
+	static constexpr uint64_t SECTION_ALIGNMENT = 4096;
+
+	// indexed draw out of the index section, the index width is chosen per draw
+	struct draw_t
+	{
+		VkIndexType index_type;
+		uint32_t index_count;
+		VkDeviceSize index_offset;	// bytes into the index data, aligned to the index size
+		int32_t vertex_offset;		// added to every index
+		uint32_t material;			// texture of the draw with bindless textures, unused in version 1
+	};
+
+private:
+	static const uint8_t IDENTIFIER[8];
+
+#pragma pack(push, 1)
+	struct header_t
+	{
+		uint8_t identifier[8];
+		uint32_t version;
+		uint32_t vertex_stride;
+		uint64_t vertex_offset;
+		uint64_t vertex_size;
+		uint64_t index_offset;
+		uint64_t index_size;
+		uint64_t draw_offset;
+		uint32_t draw_count;
+		uint32_t reserved;
+		float transform[16];		// model matrix of the vertex data, column major
+	};
+#pragma pack(pop)
+
+	MappedFile file;
+	const header_t* header;
+
+public:
+	SceneFile(void);
+	virtual ~SceneFile(void) = default;
+
+	// returns false if the file can't be opened, throws if it is not a valid scene file
+	bool load(const std::string& path);
+	void close(void);
+	static void save(const std::string& path, uint32_t vertex_stride, const void* vertices, size_t vertex_size, const void* indices, size_t index_size,
+		const draw_t* draws, uint32_t n_draws, const glm::mat4& transform);
+
+	bool is_loaded(void) const { return this->header != nullptr; }
+	uint32_t get_vertex_stride(void) const { return this->header->vertex_stride; }
+	size_t get_vertex_count(void) const { return this->header->vertex_size / this->header->vertex_stride; }
+	// sections point into the mapping, their size is padded up to SECTION_ALIGNMENT in the file
+	const uint8_t* get_vertex_data(void) const { return this->file.get_data() + this->header->vertex_offset; }
+	size_t get_vertex_data_size(void) const { return this->header->vertex_size; }
+	const uint8_t* get_index_data(void) const { return this->file.get_data() + this->header->index_offset; }
+	size_t get_index_data_size(void) const { return this->header->index_size; }
+	// the field of the material is undefined in version 1 files, the material of their draws is 0
+	draw_t get_draw(uint32_t draw) const;
+	uint32_t get_draw_count(void) const { return this->header->draw_count; }
+	glm::mat4 get_transform(void) const;
+};
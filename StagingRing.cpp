@@ -0,0 +1,126 @@
+#include "StagingRing.h"
+#include <stdexcept>
+
+StagingRing::StagingRing(void)
+{
+	this->device = VK_NULL_HANDLE;
+	this->allocator = nullptr;
+	this->buffer = VK_NULL_HANDLE;
+	this->memory = {};
+	this->capacity = 0;
+	this->head = 0;
+	this->tail = 0;
+	this->in_use = 0;
+	this->open_size = 0;
+}
+
+void StagingRing::create(VkDevice device, MemoryAllocator* allocator, VkDeviceSize capacity)
+{
+	this->device = device;
+	this->allocator = allocator;
+	this->capacity = capacity;
+
+	VkBufferCreateInfo buffer_info = {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.pNext = nullptr;
+	buffer_info.flags = 0;
+	buffer_info.size = capacity;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	buffer_info.queueFamilyIndexCount = 0;
+	buffer_info.pQueueFamilyIndices = nullptr;
+	if (vkCreateBuffer(this->device, &buffer_info, nullptr, &this->buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create staging ring buffer!");
+
+	// coherent memory, so nothing has to be flushed after the CPU has written into it. It is never freed before the device, it's bump allocated
+	this->memory = this->allocator->allocate_buffer(this->buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryAllocator::STRATEGY_LINEAR);
+	if (this->memory.mapped == nullptr)
+		throw std::runtime_error("Staging ring memory is not mapped!");
+
+	this->head = 0;
+	this->tail = 0;
+	this->in_use = 0;
+	this->open_size = 0;
+	this->segments.clear();
+}
+
+void StagingRing::destroy(void)
+{
+	vkDestroyBuffer(this->device, this->buffer, nullptr);
+	this->allocator->free(this->memory);
+	this->buffer = VK_NULL_HANDLE;
+	this->segments.clear();
+}
+
+bool StagingRing::try_allocate(VkDeviceSize size, VkDeviceSize alignment, span_t& span)
+{
+	if (size > this->capacity)
+		return false;
+
+	// nothing in flight, start at the beginning again to keep large allocations possible
+	if (this->in_use == 0)
+	{
+		this->head = 0;
+		this->tail = 0;
+	}
+
+	VkDeviceSize offset = (this->head + alignment - 1) / alignment * alignment;
+	VkDeviceSize consumed;
+	bool full = this->head == this->tail && this->in_use > 0;
+
+	if (this->head >= this->tail && !full)
+	{
+		// free memory is [head, capacity) and [0, tail)
+		if (offset + size <= this->capacity)
+			consumed = offset + size - this->head;
+		else if (size <= this->tail)
+		{
+			// the end of the buffer is skipped, the skipped bytes are freed together with the allocation
+			offset = 0;
+			consumed = this->capacity - this->head + size;
+		}
+		else
+			return false;
+	}
+	else
+	{
+		// free memory is [head, tail)
+		if (offset + size <= this->tail)
+			consumed = offset + size - this->head;
+		else
+			return false;
+	}
+
+	this->head = offset + size;
+	this->in_use += consumed;
+	this->open_size += consumed;
+
+	span.data = this->memory.mapped + offset;
+	span.size = size;
+	span.buffer = this->buffer;
+	span.offset = offset;
+	return true;
+}
+
+void StagingRing::close(uint64_t submission)
+{
+	if (this->open_size == 0)
+		return;
+
+	segment_t segment;
+	segment.submission = submission;
+	segment.end = this->head;
+	segment.size = this->open_size;
+	this->segments.push_back(segment);
+	this->open_size = 0;
+}
+
+void StagingRing::reclaim(uint64_t completed_submission)
+{
+	while (!this->segments.empty() && this->segments.front().submission <= completed_submission)
+	{
+		this->tail = this->segments.front().end;
+		this->in_use -= this->segments.front().size;
+		this->segments.pop_front();
+	}
+}
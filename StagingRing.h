@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include "MemoryAllocator.h"
+
+/* One persistently mapped staging buffer that is used as a ring. Uploads write straight into
+   the mapped memory, the bytes written between two calls of close() belong to one submission.
+   Memory of a submission is reclaimed as soon as the fence of the submission has been signaled. */
+class StagingRing
+{
+public:
+	// range of the staging buffer the caller writes into
+	struct span_t
+	{
+		uint8_t* data;
+		VkDeviceSize size;
+		VkBuffer buffer;		// source of the copy commands
+		VkDeviceSize offset;	// offset of data inside the buffer
+
+		template<typename T>
+		T* as(void) const { return reinterpret_cast<T*>(this->data); }
+	};
+
+private:
+	struct segment_t
+	{
+		uint64_t submission;
+		VkDeviceSize end;		// the tail moves here when the submission has finished
+		VkDeviceSize size;		// bytes of the segment, including the bytes skipped at a wrap
+	};
+
+	VkDevice device;
+	MemoryAllocator* allocator;
+	VkBuffer buffer;
+	MemoryAllocator::allocation_t memory;
+	VkDeviceSize capacity;
+	VkDeviceSize head;				// next byte that is written
+	VkDeviceSize tail;				// oldest byte that may still be read by the GPU
+	VkDeviceSize in_use;			// bytes between tail and head
+	VkDeviceSize open_size;			// bytes written since the last close()
+	std::deque<segment_t> segments;
+
+public:
+	StagingRing(void);
+	virtual ~StagingRing(void) = default;
+
+	void create(VkDevice device, MemoryAllocator* allocator, VkDeviceSize capacity);
+	void destroy(void);
+	VkDeviceSize get_capacity(void) const { return this->capacity; }
+
+	// returns false if the ring has not enough free memory
+	bool try_allocate(VkDeviceSize size, VkDeviceSize alignment, span_t& span);
+	// everything allocated since the last close belongs to the submission
+	void close(uint64_t submission);
+	// frees the memory of every submission up to (including) the completed one
+	void reclaim(uint64_t completed_submission);
+};
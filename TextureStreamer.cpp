@@ -0,0 +1,153 @@
+#include "TextureStreamer.h"
+#include <algorithm>
+
+TextureStreamer::TextureStreamer(void)
+{
+	this->budget = 0;
+	this->resident_size = 0;
+	this->pending_free = 0;
+}
+
+uint32_t TextureStreamer::add_texture(const std::vector<VkDeviceSize>& level_sizes, uint32_t pinned_base_level)
+{
+	texture_t texture;
+	texture.level_sizes = level_sizes;
+	texture.pinned_base_level = std::min(pinned_base_level, static_cast<uint32_t>(level_sizes.size()) - 1);
+	texture.resident_base_level = texture.pinned_base_level;
+	texture.requested_base_level = texture.pinned_base_level;
+	texture.last_used = 0;
+	texture.changing = false;
+
+	this->resident_size += this->get_size(texture, texture.resident_base_level);
+	this->textures.push_back(texture);
+	return static_cast<uint32_t>(this->textures.size() - 1);
+}
+
+void TextureStreamer::clear(void)
+{
+	this->textures.clear();
+	this->resident_size = 0;
+	this->pending_free = 0;
+}
+
+VkDeviceSize TextureStreamer::get_size(const texture_t& texture, uint32_t base_level) const
+{
+	VkDeviceSize size = 0;
+	for (size_t level = base_level; level < texture.level_sizes.size(); level++)
+		size += texture.level_sizes[level];
+	return size;
+}
+
+uint32_t TextureStreamer::get_wanted_base_level(const texture_t& texture, uint64_t frame) const
+{
+	if (frame > texture.last_used + UNUSED_FRAMES)
+		return texture.pinned_base_level;
+	return texture.requested_base_level;
+}
+
+void TextureStreamer::request(uint32_t texture, uint32_t base_level, uint64_t frame)
+{
+	texture_t& t = this->textures[texture];
+	t.requested_base_level = std::min(base_level, t.pinned_base_level);
+	t.last_used = frame;
+}
+
+void TextureStreamer::plan(uint64_t frame, VkDeviceSize max_upload, std::vector<change_t>& changes)
+{
+	changes.clear();
+	VkDeviceSize upload = 0;
+	// the first change is planned even if it is larger, textures larger than max_upload could never grow otherwise
+	auto fits = [&upload, max_upload](VkDeviceSize size) { return upload == 0 || upload + size <= max_upload; };
+
+	// textures that have more levels than needed give their memory back
+	for (uint32_t i = 0; i < this->textures.size(); i++)
+	{
+		texture_t& texture = this->textures[i];
+		uint32_t wanted = this->get_wanted_base_level(texture, frame);
+		if (texture.changing || wanted <= texture.resident_base_level)
+			continue;
+
+		VkDeviceSize size = this->get_size(texture, wanted);
+		if (!fits(size))
+			continue;
+		upload += size;
+		this->pending_free += this->get_size(texture, texture.resident_base_level) - size;
+		texture.changing = true;
+		changes.push_back({ i, wanted });
+	}
+
+	// textures that need more levels, the most recently used ones first
+	std::vector<uint32_t> growing;
+	for (uint32_t i = 0; i < this->textures.size(); i++)
+	{
+		const texture_t& texture = this->textures[i];
+		if (!texture.changing && this->get_wanted_base_level(texture, frame) < texture.resident_base_level)
+			growing.push_back(i);
+	}
+	std::sort(growing.begin(), growing.end(), [this](uint32_t a, uint32_t b) { return this->textures[a].last_used > this->textures[b].last_used; });
+
+	for (uint32_t i : growing)
+	{
+		texture_t& texture = this->textures[i];
+		uint32_t wanted = this->get_wanted_base_level(texture, frame);
+		VkDeviceSize current_size = this->get_size(texture, texture.resident_base_level);
+
+		// as many levels as fit into the budget right now
+		uint32_t base_level = wanted;
+		while (base_level < texture.resident_base_level && this->resident_size + this->get_size(texture, base_level) - current_size > this->budget)
+			base_level++;
+
+		if (base_level < texture.resident_base_level && fits(this->get_size(texture, base_level)))
+		{
+			upload += this->get_size(texture, base_level);
+			this->resident_size += this->get_size(texture, base_level) - current_size;
+			texture.changing = true;
+			changes.push_back({ i, base_level });
+		}
+		if (base_level == wanted)
+			continue;
+
+		/* The remaining levels need memory of other textures. The most detailed levels of textures
+		   that were used less recently are evicted one at a time, the memory is available to a later
+		   plan once the evictions have been committed. */
+		VkDeviceSize missing = this->resident_size + this->get_size(texture, wanted) - this->get_size(texture, base_level) - this->budget;
+		while (this->pending_free < missing)
+		{
+			int32_t victim = -1;
+			for (uint32_t j = 0; j < this->textures.size(); j++)
+			{
+				const texture_t& candidate = this->textures[j];
+				if (candidate.changing || candidate.resident_base_level >= candidate.pinned_base_level || candidate.last_used >= texture.last_used)
+					continue;
+				if (victim < 0 || candidate.last_used < this->textures[victim].last_used)
+					victim = static_cast<int32_t>(j);
+			}
+			if (victim < 0)
+				break;
+
+			texture_t& evicted = this->textures[victim];
+			uint32_t evicted_base_level = evicted.resident_base_level + 1;
+			if (!fits(this->get_size(evicted, evicted_base_level)))
+				break;
+			upload += this->get_size(evicted, evicted_base_level);
+			this->pending_free += evicted.level_sizes[evicted.resident_base_level];
+			evicted.changing = true;
+			changes.push_back({ static_cast<uint32_t>(victim), evicted_base_level });
+		}
+	}
+}
+
+void TextureStreamer::commit(const change_t& change)
+{
+	texture_t& texture = this->textures[change.texture];
+
+	// growing is accounted when it is planned, shrinking when the old levels are gone
+	if (change.base_level > texture.resident_base_level)
+	{
+		VkDeviceSize freed = this->get_size(texture, texture.resident_base_level) - this->get_size(texture, change.base_level);
+		this->resident_size -= freed;
+		this->pending_free -= std::min(this->pending_free, freed);
+	}
+	texture.resident_base_level = change.base_level;
+	texture.changing = false;
+}
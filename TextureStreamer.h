@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdint>
+
+/* Decides which mip levels of streamed textures are resident in VRAM. A texture always has
+   a contiguous range of levels resident, from its base level down to the smallest level.
+   The renderer reports every frame which base level it would like to sample (usage feedback),
+   the streamer plans changes of the base levels within a memory budget. Levels of the least
+   recently used textures are evicted first. The streamer only does the bookkeeping, creating
+   the images and swapping them is left to the renderer. */
+class TextureStreamer
+{
+public:
+	// new base level of a texture
+	struct change_t
+	{
+		uint32_t texture;
+		uint32_t base_level;
+	};
+
+	static constexpr uint64_t UNUSED_FRAMES = 120;		// textures that are not requested that long fall back to their pinned levels
+
+private:
+	struct texture_t
+	{
+		std::vector<VkDeviceSize> level_sizes;
+		uint32_t pinned_base_level;		// coarsest state, these levels are always resident
+		uint32_t resident_base_level;
+		uint32_t requested_base_level;
+		uint64_t last_used;				// frame of the last request
+		bool changing;					// a change is in flight, nothing is planned until it is committed
+	};
+
+	std::vector<texture_t> textures;
+	VkDeviceSize budget;
+	VkDeviceSize resident_size;			// levels that are resident or are being made resident
+	VkDeviceSize pending_free;			// levels of planned shrinks that are still resident
+
+	VkDeviceSize get_size(const texture_t& texture, uint32_t base_level) const;
+	uint32_t get_wanted_base_level(const texture_t& texture, uint64_t frame) const;
+
+public:
+	TextureStreamer(void);
+	virtual ~TextureStreamer(void) = default;
+
+	// the pinned levels are resident from the beginning, returns the index of the texture
+	uint32_t add_texture(const std::vector<VkDeviceSize>& level_sizes, uint32_t pinned_base_level);
+	void clear(void);
+
+	void set_budget(VkDeviceSize budget) { this->budget = budget; }
+	VkDeviceSize get_budget(void) const { return this->budget; }
+	VkDeviceSize get_resident_size(void) const { return this->resident_size; }
+	uint32_t get_resident_base_level(uint32_t texture) const { return this->textures[texture].resident_base_level; }
+
+	// usage feedback: the texture is sampled this frame and would need levels from base_level on
+	void request(uint32_t texture, uint32_t base_level, uint64_t frame);
+
+	/* Plans the changes of this update, about max_upload bytes are uploaded. The planned
+	   textures are marked as changing until commit() is called for them. Textures that need fewer
+	   levels are shrunk first, levels of the least recently used textures are evicted if a texture
+	   that is needed doesn't fit into the budget anymore. */
+	void plan(uint64_t frame, VkDeviceSize max_upload, std::vector<change_t>& changes);
+	// the change has been uploaded and swapped in
+	void commit(const change_t& change);
+};
@@ -0,0 +1,48 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(void)
+{
+	this->stopping = false;
+}
+
+void ThreadPool::create(uint32_t n_threads)
+{
+	if (n_threads == 0)
+		n_threads = std::thread::hardware_concurrency();
+	if (n_threads == 0)
+		n_threads = 1;
+
+	this->stopping = false;
+	for (uint32_t i = 0; i < n_threads; i++)
+		this->workers.emplace_back(&ThreadPool::worker_main, this);
+}
+
+void ThreadPool::destroy(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->condition.notify_all();
+
+	for (std::thread& worker : this->workers)
+		worker.join();
+	this->workers.clear();
+}
+
+void ThreadPool::worker_main(void)
+{
+	for (;;)
+	{
+		std::function<void(void)> task;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->condition.wait(lock, [this](void) { return this->stopping || !this->tasks.empty(); });
+			if (this->tasks.empty())
+				return;		// stopping and nothing left to do
+			task = std::move(this->tasks.front());
+			this->tasks.pop_front();
+		}
+		task();		// exceptions are stored in the future of the task
+	}
+}
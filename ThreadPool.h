@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <cstdint>
+
+/* Fixed number of worker threads that execute tasks in the order they were submitted.
+   The result (or the exception) of a task is returned through a future. */
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void(void)>> tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping;
+
+	void worker_main(void);
+
+public:
+	ThreadPool(void);
+	virtual ~ThreadPool(void) = default;
+
+	// 0 threads uses one thread per hardware thread
+	void create(uint32_t n_threads = 0);
+	// finishes the tasks that are already submitted
+	void destroy(void);
+
+	uint32_t get_thread_count(void) const { return static_cast<uint32_t>(this->workers.size()); }
+
+	template<typename F>
+	auto submit(F&& task) -> std::future<decltype(task())>
+	{
+		typedef decltype(task()) result_t;
+		std::shared_ptr<std::packaged_task<result_t(void)>> packaged = std::make_shared<std::packaged_task<result_t(void)>>(std::forward<F>(task));
+		std::future<result_t> future = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->tasks.push_back([packaged](void) { (*packaged)(); });
+		}
+		this->condition.notify_one();
+		return future;
+	}
+};
@@ -0,0 +1,473 @@
+#include "UploadBatch.h"
+#include <limits>
+#include <stdexcept>
+
+UploadBatch::UploadBatch(void)
+{
+	this->device = VK_NULL_HANDLE;
+	this->queue = VK_NULL_HANDLE;
+	this->queue_family = 0;
+	this->dst_queue = VK_NULL_HANDLE;
+	this->dst_queue_family = 0;
+	this->allocator = nullptr;
+	this->cmd_pool = VK_NULL_HANDLE;
+	this->cmd_buffer = VK_NULL_HANDLE;
+	this->acquire_cmd_pool = VK_NULL_HANDLE;
+	this->acquire_cmd_buffer = VK_NULL_HANDLE;
+	this->semaphore = VK_NULL_HANDLE;
+	this->fence = VK_NULL_HANDLE;
+	this->recording = false;
+	this->pending = false;
+	this->n_operations = 0;
+	this->n_acquire_operations = 0;
+	this->submission_count = 0;
+}
+
+void UploadBatch::create(VkDevice device, VkQueue queue, uint32_t queue_family, VkQueue dst_queue, uint32_t dst_queue_family, MemoryAllocator* allocator, VkDeviceSize staging_size)
+{
+	this->device = device;
+	this->queue = queue;
+	this->queue_family = queue_family;
+	this->dst_queue = dst_queue;
+	this->dst_queue_family = dst_queue_family;
+	this->allocator = allocator;
+
+	// the pool is reset as a whole before every batch
+	VkCommandPoolCreateInfo cmd_pool_info = {};
+	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmd_pool_info.pNext = nullptr;
+	cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	cmd_pool_info.queueFamilyIndex = queue_family;
+	if (vkCreateCommandPool(this->device, &cmd_pool_info, nullptr, &this->cmd_pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create command pool of upload batch!");
+
+	VkCommandBufferAllocateInfo cmd_buffer_info = {};
+	cmd_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmd_buffer_info.pNext = nullptr;
+	cmd_buffer_info.commandPool = this->cmd_pool;
+	cmd_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmd_buffer_info.commandBufferCount = 1;
+	if (vkAllocateCommandBuffers(this->device, &cmd_buffer_info, &this->cmd_buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate command buffer of upload batch!");
+
+	this->acquire_cmd_buffer = this->cmd_buffer;
+	if (this->is_family_transfer())
+	{
+		// the destination queue acquires the resources in its own command buffer
+		cmd_pool_info.queueFamilyIndex = this->dst_queue_family;
+		if (vkCreateCommandPool(this->device, &cmd_pool_info, nullptr, &this->acquire_cmd_pool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create acquire command pool of upload batch!");
+
+		cmd_buffer_info.commandPool = this->acquire_cmd_pool;
+		if (vkAllocateCommandBuffers(this->device, &cmd_buffer_info, &this->acquire_cmd_buffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate acquire command buffer of upload batch!");
+
+		VkSemaphoreCreateInfo semaphore_info = {};
+		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphore_info.pNext = nullptr;
+		semaphore_info.flags = 0;
+		if (vkCreateSemaphore(this->device, &semaphore_info, nullptr, &this->semaphore) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create semaphore of upload batch!");
+	}
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.pNext = nullptr;
+	fence_info.flags = 0;
+	if (vkCreateFence(this->device, &fence_info, nullptr, &this->fence) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create fence of upload batch!");
+
+	this->ring.create(this->device, this->allocator, staging_size);
+}
+
+void UploadBatch::destroy(void)
+{
+	if (this->pending)
+		this->wait();
+	this->release_staging_buffers();
+	this->ring.destroy();
+
+	vkDestroyFence(this->device, this->fence, nullptr);
+	if (this->is_family_transfer())
+	{
+		vkDestroySemaphore(this->device, this->semaphore, nullptr);
+		vkFreeCommandBuffers(this->device, this->acquire_cmd_pool, 1, &this->acquire_cmd_buffer);
+		vkDestroyCommandPool(this->device, this->acquire_cmd_pool, nullptr);
+	}
+	vkFreeCommandBuffers(this->device, this->cmd_pool, 1, &this->cmd_buffer);
+	vkDestroyCommandPool(this->device, this->cmd_pool, nullptr);
+}
+
+void UploadBatch::release_staging_buffers(void)
+{
+	for (staging_t& staging : this->staging_buffers)
+	{
+		vkDestroyBuffer(this->device, staging.buffer, nullptr);
+		this->allocator->free(staging.allocation);
+	}
+	this->staging_buffers.clear();
+}
+
+void UploadBatch::finished(void)
+{
+	this->pending = false;
+	this->ring.reclaim(this->submission_count);
+	this->release_staging_buffers();
+}
+
+void UploadBatch::begin(void)
+{
+	if (this->recording)
+		throw std::logic_error("Upload batch is already recording!");
+	if (this->pending)
+		this->wait();
+
+	VkResult result = vkResetCommandPool(this->device, this->cmd_pool, 0);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to reset command pool of upload batch!");
+	if (this->is_family_transfer())
+	{
+		result = vkResetCommandPool(this->device, this->acquire_cmd_pool, 0);
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("Failed to reset acquire command pool of upload batch!");
+	}
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = nullptr;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;	// one-time usage of the command buffer
+	begin_info.pInheritanceInfo = nullptr;
+
+	result = vkBeginCommandBuffer(this->cmd_buffer, &begin_info);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to begin command buffer of upload batch!");
+	if (this->is_family_transfer())
+	{
+		result = vkBeginCommandBuffer(this->acquire_cmd_buffer, &begin_info);
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("Failed to begin acquire command buffer of upload batch!");
+	}
+
+	this->recording = true;
+	this->n_operations = 0;
+	this->n_acquire_operations = 0;
+}
+
+void UploadBatch::copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize src_offset, VkDeviceSize dst_offset)
+{
+	VkBufferCopy buffer_copy = {};
+	buffer_copy.srcOffset = src_offset;
+	buffer_copy.dstOffset = dst_offset;
+	buffer_copy.size = size;
+
+	vkCmdCopyBuffer(this->cmd_buffer, src, dst, 1, &buffer_copy);
+	this->n_operations++;
+}
+
+void UploadBatch::copy_buffer_to_image(VkBuffer src, VkImage dst, uint32_t width, uint32_t height, VkDeviceSize src_offset, uint32_t mip_level)
+{
+	// the image must be in the TRANSFER_DST_OPTIMAL layout
+	VkBufferImageCopy buff_img_cpy = {};
+	buff_img_cpy.bufferOffset = src_offset;
+	buff_img_cpy.bufferRowLength = 0;		// tightly packed
+	buff_img_cpy.bufferImageHeight = 0;
+	buff_img_cpy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	buff_img_cpy.imageSubresource.mipLevel = mip_level;
+	buff_img_cpy.imageSubresource.baseArrayLayer = 0;
+	buff_img_cpy.imageSubresource.layerCount = 1;
+	buff_img_cpy.imageOffset = { 0, 0, 0 };
+	buff_img_cpy.imageExtent = { width, height, 1 };
+
+	vkCmdCopyBufferToImage(this->cmd_buffer, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buff_img_cpy);
+	this->n_operations++;
+}
+
+void UploadBatch::image_barrier(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage)
+{
+	vkCmdPipelineBarrier(this->cmd_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	this->n_operations++;
+}
+
+void UploadBatch::dst_image_barrier(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage)
+{
+	if (!this->is_family_transfer())
+	{
+		this->image_barrier(barrier, src_stage, dst_stage);
+		return;
+	}
+	vkCmdPipelineBarrier(this->acquire_cmd_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	this->n_acquire_operations++;
+}
+
+void UploadBatch::transfer_ownership(VkBuffer buffer, VkAccessFlags dst_access, VkPipelineStageFlags dst_stage)
+{
+	VkBufferMemoryBarrier buffer_barrier = {};
+	buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	buffer_barrier.pNext = nullptr;
+	buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	buffer_barrier.dstAccessMask = dst_access;
+	buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.buffer = buffer;
+	buffer_barrier.offset = 0;
+	buffer_barrier.size = VK_WHOLE_SIZE;
+
+	if (!this->is_family_transfer())
+	{
+		vkCmdPipelineBarrier(this->cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, nullptr, 1, &buffer_barrier, 0, nullptr);
+		this->n_operations++;
+		return;
+	}
+
+	// release on the transfer queue, the destination access is ignored there
+	buffer_barrier.srcQueueFamilyIndex = this->queue_family;
+	buffer_barrier.dstQueueFamilyIndex = this->dst_queue_family;
+	buffer_barrier.dstAccessMask = 0;
+	vkCmdPipelineBarrier(this->cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &buffer_barrier, 0, nullptr);
+	this->n_operations++;
+
+	// acquire on the destination queue, the source access is ignored there
+	buffer_barrier.srcAccessMask = 0;
+	buffer_barrier.dstAccessMask = dst_access;
+	vkCmdPipelineBarrier(this->acquire_cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage, 0, 0, nullptr, 1, &buffer_barrier, 0, nullptr);
+	this->n_acquire_operations++;
+}
+
+void UploadBatch::transfer_ownership(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags dst_stage)
+{
+	VkImageMemoryBarrier image_barrier = barrier;
+	image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+	if (!this->is_family_transfer())
+	{
+		this->image_barrier(image_barrier, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage);
+		return;
+	}
+
+	// both barriers must describe the same layout transition, it is executed only once
+	image_barrier.srcQueueFamilyIndex = this->queue_family;
+	image_barrier.dstQueueFamilyIndex = this->dst_queue_family;
+	image_barrier.dstAccessMask = 0;
+	vkCmdPipelineBarrier(this->cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+	this->n_operations++;
+
+	image_barrier.srcAccessMask = 0;
+	image_barrier.dstAccessMask = barrier.dstAccessMask;
+	vkCmdPipelineBarrier(this->acquire_cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+	this->n_acquire_operations++;
+}
+
+void UploadBatch::generate_mipmaps(VkImage image, uint32_t width, uint32_t height, uint32_t n_levels, VkAccessFlags dst_access, VkPipelineStageFlags dst_stage)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = n_levels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	// the destination queue owns all levels before the first blit
+	this->transfer_ownership(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+	VkCommandBuffer cmd_buffer = this->acquire_cmd_buffer;
+	barrier.subresourceRange.levelCount = 1;
+	for (uint32_t level = 1; level < n_levels; level++)
+	{
+		// the previous level becomes the source of the blit
+		barrier.subresourceRange.baseMipLevel = level - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		int32_t src_width = (int32_t)((width >> (level - 1)) > 0 ? (width >> (level - 1)) : 1);
+		int32_t src_height = (int32_t)((height >> (level - 1)) > 0 ? (height >> (level - 1)) : 1);
+		VkImageBlit blit = {};
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = level - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { src_width, src_height, 1 };
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = level;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { src_width > 1 ? src_width / 2 : 1, src_height > 1 ? src_height / 2 : 1, 1 };
+		vkCmdBlitImage(cmd_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		// the previous level is finished
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = dst_access;
+		vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	// the last level was only written
+	barrier.subresourceRange.baseMipLevel = n_levels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dst_access;
+	vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	if (this->is_family_transfer())
+		this->n_acquire_operations++;
+	else
+		this->n_operations++;
+}
+
+StagingRing::span_t UploadBatch::stage(VkDeviceSize size, VkDeviceSize alignment)
+{
+	StagingRing::span_t span;
+	if (this->try_stage(size, span, alignment))
+		return span;
+
+	// the ring is full, flush the batch so its memory can be reused
+	this->submit();
+	this->wait();
+	this->begin();
+	if (!this->ring.try_allocate(size, alignment, span))
+		throw std::runtime_error("Staging ring of upload batch is full after a flush!");
+	return span;
+}
+
+bool UploadBatch::try_stage(VkDeviceSize size, StagingRing::span_t& span, VkDeviceSize alignment)
+{
+	if (!this->recording)
+		throw std::logic_error("Upload batch is not recording!");
+
+	if (size <= this->ring.get_capacity())
+		return this->ring.try_allocate(size, alignment, span);
+
+	// too large for the ring
+	VkBufferCreateInfo buffer_info = {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.pNext = nullptr;
+	buffer_info.flags = 0;
+	buffer_info.size = size;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	buffer_info.queueFamilyIndexCount = 0;
+	buffer_info.pQueueFamilyIndices = nullptr;
+
+	staging_t staging;
+	if (vkCreateBuffer(this->device, &buffer_info, nullptr, &staging.buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create staging buffer of upload batch!");
+	staging.allocation = this->allocator->allocate_buffer(staging.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	this->staging_buffers.push_back(staging);
+
+	span.data = staging.allocation.mapped;
+	span.size = size;
+	span.buffer = staging.buffer;
+	span.offset = 0;
+	return true;
+}
+
+void UploadBatch::release_after_completion(VkBuffer buffer, const MemoryAllocator::allocation_t& allocation)
+{
+	staging_t staging;
+	staging.buffer = buffer;
+	staging.allocation = allocation;
+	this->staging_buffers.push_back(staging);
+}
+
+void UploadBatch::submit_cmd_buffer(VkQueue queue, VkCommandBuffer cmd_buffer, VkSemaphore wait, VkSemaphore signal, VkFence fence)
+{
+	// the acquire barriers wait at the top of the pipe, so the whole submission waits
+	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = nullptr;
+	submit_info.waitSemaphoreCount = (wait != VK_NULL_HANDLE) ? 1 : 0;
+	submit_info.pWaitSemaphores = &wait;
+	submit_info.pWaitDstStageMask = &wait_stage;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &cmd_buffer;
+	submit_info.signalSemaphoreCount = (signal != VK_NULL_HANDLE) ? 1 : 0;
+	submit_info.pSignalSemaphores = &signal;
+
+	VkResult result = vkQueueSubmit(queue, 1, &submit_info, fence);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to submit upload batch!");
+}
+
+void UploadBatch::submit(void)
+{
+	if (!this->recording)
+		throw std::logic_error("Upload batch is not recording!");
+
+	VkResult result = vkEndCommandBuffer(this->cmd_buffer);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to end command buffer of upload batch!");
+	if (this->is_family_transfer())
+	{
+		result = vkEndCommandBuffer(this->acquire_cmd_buffer);
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("Failed to end acquire command buffer of upload batch!");
+	}
+	this->recording = false;
+	this->ring.close(++this->submission_count);
+
+	// nothing to do for the GPU
+	if (this->n_operations == 0 && this->n_acquire_operations == 0)
+	{
+		this->finished();
+		return;
+	}
+
+	result = vkResetFences(this->device, 1, &this->fence);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to reset fence of upload batch!");
+
+	// the fence is signaled by the last submission, the destination queue waits for the transfer queue
+	bool transfer_work = this->n_operations > 0;
+	bool acquire_work = this->n_acquire_operations > 0;
+	if (transfer_work)
+		this->submit_cmd_buffer(this->queue, this->cmd_buffer, VK_NULL_HANDLE, acquire_work ? this->semaphore : VK_NULL_HANDLE, acquire_work ? VK_NULL_HANDLE : this->fence);
+	if (acquire_work)
+		this->submit_cmd_buffer(this->dst_queue, this->acquire_cmd_buffer, transfer_work ? this->semaphore : VK_NULL_HANDLE, VK_NULL_HANDLE, this->fence);
+	this->pending = true;
+}
+
+bool UploadBatch::poll(void)
+{
+	if (!this->pending)
+		return true;
+
+	VkResult result = vkGetFenceStatus(this->device, this->fence);
+	if (result == VK_NOT_READY)
+		return false;
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to get fence status of upload batch!");
+
+	this->finished();
+	return true;
+}
+
+void UploadBatch::wait(void)
+{
+	if (!this->pending)
+		return;
+
+	VkResult result = vkWaitForFences(this->device, 1, &this->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to wait for upload batch!");
+
+	this->finished();
+}
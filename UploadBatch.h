@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+
+/* Records many transfer operations (copies, layout transitions) into one command buffer
+   and submits them at once with a fence. Staging memory comes from a persistently mapped
+   ring, the part of the ring used by a batch is reclaimed as soon as the GPU has finished it.
+
+   The batch can run on a dedicated transfer queue. Resources are then released by the transfer
+   queue family and acquired by the family of the destination queue (the graphics queue) in a
+   second command buffer that waits on a semaphore of the transfer submission. If both families
+   are the same only one command buffer is used and the ownership transfers become plain barriers. */
+class UploadBatch
+{
+private:
+	struct staging_t
+	{
+		VkBuffer buffer;
+		MemoryAllocator::allocation_t allocation;
+	};
+
+	VkDevice device;
+	VkQueue queue;
+	uint32_t queue_family;
+	VkQueue dst_queue;				// queue that uses the uploaded resources
+	uint32_t dst_queue_family;
+	MemoryAllocator* allocator;
+	VkCommandPool cmd_pool;
+	VkCommandBuffer cmd_buffer;
+	VkCommandPool acquire_cmd_pool;			// only created if the queue families differ
+	VkCommandBuffer acquire_cmd_buffer;		// recorded for the destination queue, equal to cmd_buffer if the families are the same
+	VkSemaphore semaphore;					// signaled by the transfer submission, waited on by the acquire submission
+	VkFence fence;
+	bool recording;
+	bool pending;					// submitted, but not known to be finished
+	uint32_t n_operations;
+	uint32_t n_acquire_operations;
+	std::vector<staging_t> staging_buffers;	// uploads that do not fit into the ring
+	StagingRing ring;
+	uint64_t submission_count;
+
+	void release_staging_buffers(void);
+	void finished(void);
+	bool is_family_transfer(void) const { return this->queue_family != this->dst_queue_family; }
+	void submit_cmd_buffer(VkQueue queue, VkCommandBuffer cmd_buffer, VkSemaphore wait, VkSemaphore signal, VkFence fence);
+
+public:
+	UploadBatch(void);
+	virtual ~UploadBatch(void) = default;
+
+	static constexpr VkDeviceSize DEFAULT_STAGING_SIZE = 32 * 1024 * 1024;
+
+	// queue can be a transfer queue, dst_queue is the queue that uses the resources afterwards
+	void create(VkDevice device, VkQueue queue, uint32_t queue_family, VkQueue dst_queue, uint32_t dst_queue_family, MemoryAllocator* allocator, VkDeviceSize staging_size = DEFAULT_STAGING_SIZE);
+	void destroy(void);
+
+	// waits for the previous batch if it is still pending
+	void begin(void);
+	VkCommandBuffer get_cmd_buffer(void) const { return this->cmd_buffer; }
+	uint32_t get_queue_family(void) const { return this->queue_family; }
+	bool is_recording(void) const { return this->recording; }
+
+	void copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize src_offset = 0, VkDeviceSize dst_offset = 0);
+	void copy_buffer_to_image(VkBuffer src, VkImage dst, uint32_t width, uint32_t height, VkDeviceSize src_offset = 0, uint32_t mip_level = 0);
+	// recorded on the transfer queue, the stages must be supported by its family
+	void image_barrier(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage);
+	// recorded on the destination queue after the transfer part of the batch, for transitions the transfer queue can't do
+	void dst_image_barrier(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage);
+
+	/* Makes the result of the copies into the resource available to the destination queue.
+	   The image barrier describes the last transition, it starts from TRANSFER_DST_OPTIMAL and
+	   the access mask that is used on the destination queue. Queue family indices are filled in. */
+	void transfer_ownership(VkBuffer buffer, VkAccessFlags dst_access, VkPipelineStageFlags dst_stage);
+	void transfer_ownership(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags dst_stage);
+
+	/* Fills levels 1..n_levels-1 of a color image by blitting every level from the previous one,
+	   the format must support linear blit filtering. All levels must be in TRANSFER_DST_OPTIMAL and
+	   level 0 must hold the data. The blits are recorded on the destination queue (blits need a
+	   graphics queue), the image is handed over and ends up in SHADER_READ_ONLY_OPTIMAL. */
+	void generate_mipmaps(VkImage image, uint32_t width, uint32_t height, uint32_t n_levels, VkAccessFlags dst_access, VkPipelineStageFlags dst_stage);
+
+	/* Returns staging memory the caller writes the data of one upload into, the span stays
+	   valid until the batch has been submitted. If the ring is full the recorded operations
+	   are submitted and waited for, uploads larger than the ring get their own buffer. */
+	StagingRing::span_t stage(VkDeviceSize size, VkDeviceSize alignment = 16);
+	/* Same as stage() but never flushes the batch, returns false if the ring is full. Spans that
+	   are still written by other threads stay valid, their copies can be recorded later. */
+	bool try_stage(VkDeviceSize size, StagingRing::span_t& span, VkDeviceSize alignment = 16);
+
+	// the buffer is destroyed and its memory freed when the batch has finished
+	void release_after_completion(VkBuffer buffer, const MemoryAllocator::allocation_t& allocation);
+
+	// submits everything that was recorded since begin(), empty batches are not submitted
+	void submit(void);
+	// returns true if the batch has finished, never blocks
+	bool poll(void);
+	void wait(void);
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <cstdint>
+
+/* Packed vertex attributes. Every type knows the format the vertex input reads it with, so
+   the attribute descriptions of a vertex struct follow from the types of its members. The
+   shaders see floats in all cases, normalized and half formats are converted by the hardware. */
+
+// 4 x 16 bit signed normalized, [-1, 1]
+struct snorm16x4_t
+{
+	static constexpr VkFormat FORMAT = VK_FORMAT_R16G16B16A16_SNORM;
+
+	uint64_t bits;
+
+	snorm16x4_t(void) = default;
+	explicit snorm16x4_t(const glm::vec4& v) : bits(glm::packSnorm4x16(v)) {}
+	glm::vec4 unpack(void) const { return glm::unpackSnorm4x16(this->bits); }
+};
+
+// 4 x 8 bit unsigned normalized, [0, 1]
+struct unorm8x4_t
+{
+	static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+	uint32_t bits;
+
+	unorm8x4_t(void) = default;
+	explicit unorm8x4_t(const glm::vec4& v) : bits(glm::packUnorm4x8(v)) {}
+	glm::vec4 unpack(void) const { return glm::unpackUnorm4x8(this->bits); }
+};
+
+// 2 x 16 bit float, 11 bits of precision
+struct half2_t
+{
+	static constexpr VkFormat FORMAT = VK_FORMAT_R16G16_SFLOAT;
+
+	uint32_t bits;
+
+	half2_t(void) = default;
+	explicit half2_t(const glm::vec2& v) : bits(glm::packHalf2x16(v)) {}
+	glm::vec2 unpack(void) const { return glm::unpackHalf2x16(this->bits); }
+};
+
+// format of an attribute type, packed types provide their own, plain floats are listed here
+template<typename T>
+struct attrib_format_t
+{
+	static constexpr VkFormat FORMAT = T::FORMAT;
+};
+
+template<> struct attrib_format_t<float> { static constexpr VkFormat FORMAT = VK_FORMAT_R32_SFLOAT; };
+template<> struct attrib_format_t<glm::vec2> { static constexpr VkFormat FORMAT = VK_FORMAT_R32G32_SFLOAT; };
+template<> struct attrib_format_t<glm::vec3> { static constexpr VkFormat FORMAT = VK_FORMAT_R32G32B32_SFLOAT; };
+template<> struct attrib_format_t<glm::vec4> { static constexpr VkFormat FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT; };
@@ -1,7 +1,14 @@
 #include "VulkanApp.h"
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <cstddef>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <deque>
 #include <glm/gtc/matrix_transform.hpp>
+#include "shaders_spirv.h"		// generated at build time from shader/
 
 #define STB_IMAGE_IMPLEMENTATION
 #ifdef __clang__  
@@ -18,6 +25,8 @@
 			asm("int $3");			// causes a break in the program
 
 inline const char* strdevice_type(VkPhysicalDeviceType);
+inline const char* strpresent_mode(VkPresentModeKHR);
+inline double get_time(void);
 
 inline const char* strdevice_type(VkPhysicalDeviceType type)
 {
@@ -36,8 +45,35 @@ inline const char* strdevice_type(VkPhysicalDeviceType type)
 	}
 }
 
+inline const char* strpresent_mode(VkPresentModeKHR mode)
+{
+	switch (mode)
+	{
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "IMMEDIATE, no vertical sync, tearing is possible";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "MAILBOX, vertical sync, the newest image replaces the queued one";
+	case VK_PRESENT_MODE_FIFO_KHR:
+		return "FIFO, vertical sync";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		return "FIFO RELAXED, vertical sync unless the frame is late";
+	default:
+		return "Unknown present mode";
+	}
+}
+
+inline double get_time(void)
+{
+	// glfwGetTime is not available without an initialized GLFW (headless mode)
+	using clock = std::chrono::steady_clock;
+	return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
 void FirstVulkan::vertex_t::get_binding_description(VkVertexInputBindingDescription& description)
 {
+	static_assert(sizeof(vertex_t) == 16, "the vertex is meant to be packed into 16 bytes");
+	static_assert(sizeof(instance_t) == 52, "the cull shader reads instances as 13 words");
+
 	description = {};
 	description.binding = 0;
 	description.stride = sizeof(vertex_t);
@@ -50,23 +86,81 @@ void FirstVulkan::vertex_t::get_attrib_descriptions(std::vector<VkVertexInputAtt
 
 	descriptions[0].location = 0;
 	descriptions[0].binding = 0;
-	descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;	// x, y, z - float
-	descriptions[0].offset = 0;
+	descriptions[0].format = attrib_format_t<decltype(vertex_t::pos)>::FORMAT;	// x, y, z - quantized
+	descriptions[0].offset = offsetof(vertex_t, pos);
 
 	descriptions[1].location = 1;
 	descriptions[1].binding = 0;
-	descriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;	// r, g, b, a - float
-	descriptions[1].offset = sizeof(glm::vec3);
+	descriptions[1].format = attrib_format_t<decltype(vertex_t::color)>::FORMAT;	// r, g, b, a
+	descriptions[1].offset = offsetof(vertex_t, color);
 
 	descriptions[2].location = 2;
 	descriptions[2].binding = 0;
-	descriptions[2].format = VK_FORMAT_R32G32_SFLOAT;	// u, v - float
-	descriptions[2].offset = sizeof(glm::vec3) + sizeof(glm::vec4);
+	descriptions[2].format = attrib_format_t<decltype(vertex_t::uv_coord)>::FORMAT;	// u, v
+	descriptions[2].offset = offsetof(vertex_t, uv_coord);
+}
+
+void FirstVulkan::instance_t::get_binding_description(VkVertexInputBindingDescription& description)
+{
+	description = {};
+	description.binding = 1;
+	description.stride = sizeof(instance_t);
+	description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;		// advances once per instance
+}
+
+void FirstVulkan::instance_t::get_attrib_descriptions(std::vector<VkVertexInputAttributeDescription>& descriptions)
+{
+	// a matrix takes one location per row
+	uint32_t location = static_cast<uint32_t>(descriptions.size());
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		VkVertexInputAttributeDescription description = {};
+		description.location = location++;
+		description.binding = 1;
+		description.format = attrib_format_t<glm::vec4>::FORMAT;
+		description.offset = offsetof(instance_t, transform) + i * sizeof(glm::vec4);
+		descriptions.push_back(description);
+	}
+
+	VkVertexInputAttributeDescription description = {};
+	description.location = location;
+	description.binding = 1;
+	description.format = attrib_format_t<decltype(instance_t::color)>::FORMAT;
+	description.offset = offsetof(instance_t, color);
+	descriptions.push_back(description);
 }
 
-FirstVulkan::FirstVulkan(void)
+FirstVulkan::FirstVulkan(void) : FirstVulkan(settings_t())
 {
-	this->vertices = {
+}
+
+FirstVulkan::FirstVulkan(const settings_t& settings)
+{
+	this->settings = settings;
+	this->n_frames_in_flight = (settings.frames_in_flight > 0) ? settings.frames_in_flight : 1;
+	this->current_frame = 0;
+	this->frame_number = 0;
+
+	// series of the benchmark, in the same order as frame_phase_t
+	const char* phase_names[N_PHASES] = { "poll", "wait", "update_mvp", "stream", "acquire", "record", "submit", "present", "frame" };
+	for (uint32_t i = 0; i < N_PHASES; i++)
+		this->benchmark.add_series(phase_names[i]);
+
+	// GPU times and pipeline statistics are reported through the benchmark as well
+	this->gpu_scope_frame = this->gpu_profiler.add_scope("frame");
+	this->gpu_scope_renderpass = this->gpu_profiler.add_scope("renderpass");
+	this->gpu_scope_cull = this->gpu_profiler.add_scope("cull");		// only recorded with GPU culling
+	this->gpu_series_begin = N_PHASES;
+	this->gpu_frame_ms = std::numeric_limits<double>::quiet_NaN();
+	for (uint32_t i = 0; i < this->gpu_profiler.get_scope_count(); i++)
+		this->benchmark.add_series("gpu:" + this->gpu_profiler.get_scope_name(i));
+	if (this->settings.pipeline_statistics)
+	{
+		for (uint32_t i = 0; i < GpuProfiler::N_STATISTICS; i++)
+			this->benchmark.add_series(std::string("gpu:") + GpuProfiler::get_statistic_name(static_cast<GpuProfiler::statistic_t>(i)), "count");
+	}
+
+	std::vector<unpacked_vertex_t> quads = {
 		{ {-0.5f, 0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f, 1.0f }, {0.0f, 0.0f} },
 		{ { 0.5f, 0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f, 1.0f }, {1.0f, 1.0f} },
 		{ {-0.5f, 0.5f,  0.5f }, { 0.0f, 0.0f, 1.0f, 1.0f }, {0.0f, 1.0f} },
@@ -82,19 +176,51 @@ FirstVulkan::FirstVulkan(void)
 	this->indices = {
 		0, 2, 1, 0, 1, 3, 4, 6, 5, 4, 5, 7
 	};
+	this->mesh_transform = glm::mat4(1.0f);
+	this->quantize_vertices(quads);
+	if (!this->settings.scene_path.empty())
+		this->load_scene(this->settings.scene_path);
+	else if (!this->settings.mesh_path.empty())
+	{
+		this->load_mesh(this->settings.mesh_path);
+		this->add_draw(this->indices.data(), this->indices.size(), 0, static_cast<uint32_t>(this->vertices.size()));
+	}
+	else
+	{
+		// one draw per quad, with bindless textures the second quad shows the second texture
+		this->add_draw(this->indices.data(), 6, 0, static_cast<uint32_t>(this->vertices.size()), 0);
+		this->add_draw(this->indices.data() + 6, 6, 0, static_cast<uint32_t>(this->vertices.size()), 1);
+	}
+	if (!this->settings.export_scene_path.empty())
+		this->export_scene(this->settings.export_scene_path);
 
 	this->width		= 400;
 	this->height	= 300;
 	this->swapchain = VK_NULL_HANDLE;
-	this->glfw_init();
+	this->surface = VK_NULL_HANDLE;
+	this->window = nullptr;
+	this->last_image_index = 0;
+	this->color_format = COLOR_FORMAT;
+	this->color_space = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+	this->present_mode = VK_PRESENT_MODE_FIFO_KHR;
+	this->texture_descriptor_version = 0;
+	this->memory_budget_supported = false;
+	this->host_import_alignment = 0;
+	this->gpu_culling = this->settings.gpu_culling;
+	this->cull_key_down = false;
+	this->visible_instance_count = 0;
+	this->get_memory_host_pointer_properties = nullptr;
+	if (!this->settings.headless)
+		this->glfw_init();
 	this->vulkan_init();
-	this->t_app_start = glfwGetTime();
+	this->t_app_start = get_time();
 }
 
 FirstVulkan::~FirstVulkan(void)
 {
 	this->vulkan_destroy();
-	this->glfw_destroy();
+	if (!this->settings.headless)
+		this->glfw_destroy();
 }
 
 void FirstVulkan::vulkan_create_app_info(void)
@@ -125,19 +251,35 @@ void FirstVulkan::vulkan_create_instance(void)
 	vkEnumerateInstanceExtensionProperties(nullptr, &n_instance_extensions, instance_extension_properties);
 	this->print_instance_extensions(instance_extension_properties, n_instance_extensions);
 
-	// activate layers
-	std::vector<const char*> instance_layers = {
+	// activate layers, only the installed ones (e.g. CI machines don't have the validation layers)
+	const char* wanted_layers[] = {
 		"VK_LAYER_LUNARG_standard_validation",	// vulkans validation layer
 		"VK_LAYER_KHRONOS_validation"
 	};
+	std::vector<const char*> instance_layers;
+	for (const char* layer : wanted_layers)
+	{
+		for (uint32_t i = 0; i < n_instance_layers; i++)
+		{
+			if (strcmp(layer, instance_layer_properties[i].layerName) == 0)
+				instance_layers.push_back(layer);
+		}
+	}
 
-	// fetch requiered extensions for glfw
-	uint32_t n_glfw_extensions = 0;
-	const char** temp_extensions = glfwGetRequiredInstanceExtensions(&n_glfw_extensions);
+	// fetch requiered extensions for glfw, there is no window in headless mode
 	std::vector<const char*> instance_extensions;
-	for (size_t i = 0; i < n_glfw_extensions; i++)			// glfw extensions
-		instance_extensions.push_back(temp_extensions[i]);
-	instance_extensions.push_back("VK_EXT_debug_utils");
+	if (!this->settings.headless)
+	{
+		uint32_t n_glfw_extensions = 0;
+		const char** temp_extensions = glfwGetRequiredInstanceExtensions(&n_glfw_extensions);
+		for (size_t i = 0; i < n_glfw_extensions; i++)			// glfw extensions
+			instance_extensions.push_back(temp_extensions[i]);
+	}
+	for (uint32_t i = 0; i < n_instance_extensions; i++)
+	{
+		if (strcmp(instance_extension_properties[i].extensionName, "VK_EXT_debug_utils") == 0)
+			instance_extensions.push_back("VK_EXT_debug_utils");
+	}
 
 	// set information for the later created instance
 	VkInstanceCreateInfo instance_info = {};
@@ -162,6 +304,52 @@ void FirstVulkan::vulkan_create_glfw_window_surface(void)
 	ASSERT_VULKAN(result);
 }
 
+void FirstVulkan::vulkan_find_queue_families(VkPhysicalDevice physical_device)
+{
+	uint32_t n_queue_families;
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &n_queue_families, nullptr);
+	VkQueueFamilyProperties family_prop[n_queue_families];
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &n_queue_families, family_prop);
+
+	const uint32_t NONE = UINT32_MAX;
+	this->queue_families.graphics = NONE;
+	this->queue_families.transfer = NONE;
+	this->queue_families.compute = NONE;
+	for (uint32_t i = 0; i < n_queue_families; i++)
+	{
+		VkQueueFlags flags = family_prop[i].queueFlags;
+		if (family_prop[i].queueCount == 0)
+			continue;
+
+		// the graphics family must be able to present as well
+		if ((flags & VK_QUEUE_GRAPHICS_BIT) && this->queue_families.graphics == NONE)
+		{
+			VkBool32 present_support = VK_TRUE;
+			if (!this->settings.headless)
+				vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, this->surface, &present_support);
+			if (present_support)
+				this->queue_families.graphics = i;
+		}
+		// dedicated families (DMA engines, async compute) don't have the graphics bit
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && this->queue_families.transfer == NONE)
+			this->queue_families.transfer = i;
+		if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && this->queue_families.compute == NONE)
+			this->queue_families.compute = i;
+	}
+
+	if (this->queue_families.graphics == NONE)
+		throw std::runtime_error("No queue family supports graphics and presentation!");
+	// graphics and compute queues support transfers implicitly
+	if (this->queue_families.transfer == NONE)
+		this->queue_families.transfer = (this->queue_families.compute != NONE) ? this->queue_families.compute : this->queue_families.graphics;
+	if (this->queue_families.compute == NONE)
+		this->queue_families.compute = this->queue_families.graphics;
+	if (!this->settings.async_transfer)
+		this->queue_families.transfer = this->queue_families.graphics;
+
+	std::cout << "Queue families: graphics " << this->queue_families.graphics << ", transfer " << this->queue_families.transfer << ", compute " << this->queue_families.compute << std::endl;
+}
+
 void FirstVulkan::vulkan_create_device(void)
 {
 	// get the physical devices, in this case the graphics cards
@@ -173,31 +361,155 @@ void FirstVulkan::vulkan_create_device(void)
 	ASSERT_VULKAN(result);
 	this->print_deviceinfo(this->physical_devices, n_physical_devices);
 
-	// Create information about the queues the application uses
+	// Create information about the queues the application uses, one queue of every distinct family
+	this->vulkan_find_queue_families(physical_devices[0]);
+	uint32_t families[] = { this->queue_families.graphics, this->queue_families.transfer, this->queue_families.compute };
 	float queue_priorities[] = { 1.0f, 1.0f, 1.0f, 1.0f };	// all queues have the highest priority
-	VkDeviceQueueCreateInfo device_queue_info = {};
-	device_queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	device_queue_info.pNext = nullptr;
-	device_queue_info.flags = 0;
-	device_queue_info.queueFamilyIndex = 0;
-	device_queue_info.queueCount = 1;
-	device_queue_info.pQueuePriorities = queue_priorities;
-
-	VkPhysicalDeviceFeatures used_device_features = {};	// no features used yet
+	std::vector<VkDeviceQueueCreateInfo> device_queue_infos;
+	for (uint32_t family : families)
+	{
+		bool created = false;
+		for (const VkDeviceQueueCreateInfo& info : device_queue_infos)
+			created |= (info.queueFamilyIndex == family);
+		if (created)
+			continue;
+
+		VkDeviceQueueCreateInfo device_queue_info = {};
+		device_queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		device_queue_info.pNext = nullptr;
+		device_queue_info.flags = 0;
+		device_queue_info.queueFamilyIndex = family;
+		device_queue_info.queueCount = 1;
+		device_queue_info.pQueuePriorities = queue_priorities;
+		device_queue_infos.push_back(device_queue_info);
+	}
+
+	VkPhysicalDeviceFeatures supported_device_features = {};
+	vkGetPhysicalDeviceFeatures(physical_devices[0], &supported_device_features);
+	if (this->settings.pipeline_statistics && !supported_device_features.pipelineStatisticsQuery)
+	{
+		std::cerr << "Pipeline statistics queries are not supported by the device, statistics are not collected." << std::endl;
+		this->settings.pipeline_statistics = false;
+	}
+	// the statistics query of the render pass only counts secondary command buffers if they inherit it
+	this->parallel_recording = this->settings.parallel_recording && (!this->settings.pipeline_statistics || supported_device_features.inheritedQueries);
+	if (this->settings.parallel_recording && !this->parallel_recording)
+		std::cerr << "Pipeline statistics can't be inherited by secondary command buffers, the draws are recorded inline." << std::endl;
+
+	VkPhysicalDeviceFeatures used_device_features = {};
 	used_device_features.samplerAnisotropy = VK_TRUE;
+	used_device_features.pipelineStatisticsQuery = this->settings.pipeline_statistics ? VK_TRUE : VK_FALSE;
+	used_device_features.inheritedQueries = (this->parallel_recording && this->settings.pipeline_statistics) ? VK_TRUE : VK_FALSE;
+	// block compressed texture formats can only be used if their feature is enabled
+	used_device_features.textureCompressionBC = supported_device_features.textureCompressionBC;
+	used_device_features.textureCompressionETC2 = supported_device_features.textureCompressionETC2;
+	used_device_features.textureCompressionASTC_LDR = supported_device_features.textureCompressionASTC_LDR;
+	// GPU culling draws every range of draw slots with one call, without it every draw has its own call
+	this->multi_draw_indirect = supported_device_features.multiDrawIndirect == VK_TRUE;
+	used_device_features.multiDrawIndirect = supported_device_features.multiDrawIndirect;
+
+	// extensions at device level, offscreen rendering doesn't need a swapchain
+	std::vector<const char*> device_extensions;
+	if (!this->settings.headless)
+		device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+	// the budget of the memory heaps limits the memory of streamed textures
+	uint32_t n_extensions;
+	result = vkEnumerateDeviceExtensionProperties(physical_devices[0], nullptr, &n_extensions, nullptr);
+	ASSERT_VULKAN(result);
+	std::vector<VkExtensionProperties> extensions(n_extensions);
+	result = vkEnumerateDeviceExtensionProperties(physical_devices[0], nullptr, &n_extensions, extensions.data());
+	ASSERT_VULKAN(result);
+	bool external_memory_host_supported = false;
+	for (const VkExtensionProperties& extension : extensions)
+	{
+		this->memory_budget_supported |= (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0);
+		external_memory_host_supported |= (strcmp(extension.extensionName, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0);
+	}
+	if (this->memory_budget_supported)
+		device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	// the mapping of a scene file can be imported, the GPU copies out of it without staging memory
+	bool import_host_memory = external_memory_host_supported && this->scene.is_loaded();
+	if (import_host_memory)
+		device_extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+
+	/* Bindless textures need descriptor indexing, core in Vulkan 1.2 and VK_EXT_descriptor_indexing
+	   before. The texture index is the same for the whole draw, dynamic indexing is enough. The draw
+	   finds its texture with gl_DrawID, which needs draw parameters (core in Vulkan 1.1). */
+	VkPhysicalDeviceShaderDrawParametersFeatures supported_draw_parameters_features = {};
+	supported_draw_parameters_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_DRAW_PARAMETERS_FEATURES;
+	supported_draw_parameters_features.pNext = nullptr;
+
+	VkPhysicalDeviceDescriptorIndexingFeatures supported_indexing_features = {};
+	supported_indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+	supported_indexing_features.pNext = nullptr;
+
+	VkPhysicalDeviceDescriptorIndexingProperties indexing_properties = {};
+	indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+	indexing_properties.pNext = nullptr;
+
+	VkPhysicalDeviceProperties2 device_properties = {};
+	device_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	device_properties.pNext = &indexing_properties;
+
+	VkPhysicalDeviceFeatures2 device_features = {};
+	device_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	device_features.pNext = &supported_indexing_features;
+
+	bool descriptor_indexing_extension = false;
+	bool draw_parameters_extension = false;
+	for (const VkExtensionProperties& extension : extensions)
+	{
+		descriptor_indexing_extension |= (strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0);
+		draw_parameters_extension |= (strcmp(extension.extensionName, VK_KHR_SHADER_DRAW_PARAMETERS_EXTENSION_NAME) == 0);
+	}
+	vkGetPhysicalDeviceProperties2(physical_devices[0], &device_properties);
+	this->max_draw_indirect_count = std::max<uint32_t>(device_properties.properties.limits.maxDrawIndirectCount, 1);
+	bool descriptor_indexing_core = device_properties.properties.apiVersion >= VK_API_VERSION_1_2;
+	bool draw_parameters_core = device_properties.properties.apiVersion >= VK_API_VERSION_1_1;
+	if (draw_parameters_core)
+		supported_indexing_features.pNext = &supported_draw_parameters_features;
+	this->bindless_textures = false;
+	if (this->settings.bindless_textures && (descriptor_indexing_core || descriptor_indexing_extension))
+	{
+		vkGetPhysicalDeviceFeatures2(physical_devices[0], &device_features);
+		this->bindless_textures = supported_device_features.shaderSampledImageArrayDynamicIndexing
+			&& (draw_parameters_core ? supported_draw_parameters_features.shaderDrawParameters : draw_parameters_extension)
+			&& supported_indexing_features.descriptorBindingSampledImageUpdateAfterBind
+			&& supported_indexing_features.descriptorBindingPartiallyBound
+			&& indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers >= MAX_BINDLESS_TEXTURES
+			&& indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages >= MAX_BINDLESS_TEXTURES;
+	}
+	if (this->settings.bindless_textures && !this->bindless_textures)
+		std::cerr << "Descriptor indexing or draw parameters are not supported by the device, textures are bound with descriptor sets." << std::endl;
 
-	// extensions at device level
-	std::vector<const char*> device_extensions = {
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME
-	};
+	VkPhysicalDeviceShaderDrawParametersFeatures used_draw_parameters_features = {};
+	used_draw_parameters_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_DRAW_PARAMETERS_FEATURES;
+	used_draw_parameters_features.pNext = nullptr;
+
+	VkPhysicalDeviceDescriptorIndexingFeatures used_indexing_features = {};
+	used_indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+	used_indexing_features.pNext = draw_parameters_core ? &used_draw_parameters_features : nullptr;
+	if (this->bindless_textures)
+	{
+		used_device_features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+		used_indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		used_indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+		used_draw_parameters_features.shaderDrawParameters = VK_TRUE;
+		if (!descriptor_indexing_core)
+			device_extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		if (!draw_parameters_core)
+			device_extensions.push_back(VK_KHR_SHADER_DRAW_PARAMETERS_EXTENSION_NAME);
+	}
 
 	// create information about the logical device we are creating
 	VkDeviceCreateInfo device_info = {};
 	device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	device_info.pNext = nullptr;
+	device_info.pNext = this->bindless_textures ? &used_indexing_features : nullptr;
 	device_info.flags = 0;
-	device_info.queueCreateInfoCount = 1;
-	device_info.pQueueCreateInfos = &device_queue_info;
+	device_info.queueCreateInfoCount = device_queue_infos.size();
+	device_info.pQueueCreateInfos = device_queue_infos.data();
 	device_info.enabledLayerCount = 0;
 	device_info.ppEnabledLayerNames = nullptr;
 	device_info.enabledExtensionCount = device_extensions.size();
@@ -207,17 +519,37 @@ void FirstVulkan::vulkan_create_device(void)
 	// create logical device
 	result = vkCreateDevice(physical_devices[0], &device_info, nullptr, &this->device);
 	ASSERT_VULKAN(result);
+
+	if (import_host_memory)
+	{
+		VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_properties = {};
+		host_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+		host_properties.pNext = nullptr;
+
+		VkPhysicalDeviceProperties2 properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &host_properties;
+		vkGetPhysicalDeviceProperties2(physical_devices[0], &properties);
+
+		// extension functions are not exported by the loader
+		this->get_memory_host_pointer_properties = (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(this->device, "vkGetMemoryHostPointerPropertiesEXT");
+		if (this->get_memory_host_pointer_properties != nullptr)
+			this->host_import_alignment = host_properties.minImportedHostPointerAlignment;
+	}
 }
 
 void FirstVulkan::vulkan_create_queues(void)
 {
-	vkGetDeviceQueue(this->device, 0, 0, &this->queue);
+	// queues of the same family are the same queue
+	vkGetDeviceQueue(this->device, this->queue_families.graphics, 0, &this->queue);
+	vkGetDeviceQueue(this->device, this->queue_families.transfer, 0, &this->transfer_queue);
+	vkGetDeviceQueue(this->device, this->queue_families.compute, 0, &this->compute_queue);
 }
 
 void FirstVulkan::vulkan_check_surface_support(void)
 {
 	VkBool32 surface_support = false;
-	VkResult result = vkGetPhysicalDeviceSurfaceSupportKHR(physical_devices[0], 0, this->surface, &surface_support);
+	VkResult result = vkGetPhysicalDeviceSurfaceSupportKHR(physical_devices[0], this->queue_families.graphics, this->surface, &surface_support);
 	ASSERT_VULKAN(result);
 
 	if (!surface_support)
@@ -227,41 +559,183 @@ void FirstVulkan::vulkan_check_surface_support(void)
 	}
 }
 
+void FirstVulkan::vulkan_query_swapchain_support(void)
+{
+	VkResult result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(this->physical_devices[0], this->surface, &this->swapchain_support.capabilities);
+	ASSERT_VULKAN(result);
+
+	uint32_t n_formats;
+	result = vkGetPhysicalDeviceSurfaceFormatsKHR(this->physical_devices[0], this->surface, &n_formats, nullptr);
+	ASSERT_VULKAN(result);
+	this->swapchain_support.formats.resize(n_formats);
+	result = vkGetPhysicalDeviceSurfaceFormatsKHR(this->physical_devices[0], this->surface, &n_formats, this->swapchain_support.formats.data());
+	ASSERT_VULKAN(result);
+
+	uint32_t n_present_modes;
+	result = vkGetPhysicalDeviceSurfacePresentModesKHR(this->physical_devices[0], this->surface, &n_present_modes, nullptr);
+	ASSERT_VULKAN(result);
+	this->swapchain_support.present_modes.resize(n_present_modes);
+	result = vkGetPhysicalDeviceSurfacePresentModesKHR(this->physical_devices[0], this->surface, &n_present_modes, this->swapchain_support.present_modes.data());
+	ASSERT_VULKAN(result);
+}
+
+void FirstVulkan::vulkan_choose_swapchain_config(void)
+{
+	// color format: prefer the 8 bit UNORM formats the application was written for
+	const std::vector<VkSurfaceFormatKHR>& formats = this->swapchain_support.formats;
+	const VkFormat preferred_formats[] = { COLOR_FORMAT, VK_FORMAT_R8G8B8A8_UNORM };
+	bool format_found = false;
+	if (formats.size() == 1 && formats[0].format == VK_FORMAT_UNDEFINED)
+	{
+		// the surface has no preferred format at all
+		this->color_format = COLOR_FORMAT;
+		this->color_space = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+		format_found = true;
+	}
+	for (size_t i = 0; i < sizeof(preferred_formats) / sizeof(VkFormat) && !format_found; i++)
+	{
+		for (const VkSurfaceFormatKHR& format : formats)
+		{
+			if (format.format == preferred_formats[i] && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+			{
+				this->color_format = format.format;
+				this->color_space = format.colorSpace;
+				format_found = true;
+				break;
+			}
+		}
+	}
+	if (!format_found)
+	{
+		if (formats.empty())
+			throw std::runtime_error("Surface doesn't support any format!");
+		this->color_format = formats[0].format;
+		this->color_space = formats[0].colorSpace;
+	}
+
+	/* Present mode: MAILBOX and IMMEDIATE both don't block on the vertical sync, one can replace the other.
+	   FIFO is the only present mode that is guaranteed to be supported. */
+	std::vector<VkPresentModeKHR> candidates = { this->settings.present_mode };
+	if (this->settings.present_mode == VK_PRESENT_MODE_MAILBOX_KHR)
+		candidates.push_back(VK_PRESENT_MODE_IMMEDIATE_KHR);
+	else if (this->settings.present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+		candidates.push_back(VK_PRESENT_MODE_MAILBOX_KHR);
+	candidates.push_back(VK_PRESENT_MODE_FIFO_KHR);
+
+	const std::vector<VkPresentModeKHR>& present_modes = this->swapchain_support.present_modes;
+	this->present_mode = VK_PRESENT_MODE_FIFO_KHR;
+	for (VkPresentModeKHR candidate : candidates)
+	{
+		if (std::find(present_modes.begin(), present_modes.end(), candidate) != present_modes.end())
+		{
+			this->present_mode = candidate;
+			break;
+		}
+	}
+	if (this->present_mode != this->settings.present_mode)
+		std::cerr << "Requested present mode is not supported, falling back to " << strpresent_mode(this->present_mode) << std::endl;
+
+	std::cout << std::endl;
+	std::cout << "Swapchain format:          " << this->color_format << std::endl;
+	std::cout << "Swapchain present mode:    " << strpresent_mode(this->present_mode) << std::endl;
+}
+
 void FirstVulkan::vulkan_create_swapchain(void)
 {
+	// the capabilities change with the window, e.g. the extent limits and the transform
+	VkResult result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(this->physical_devices[0], this->surface, &this->swapchain_support.capabilities);
+	ASSERT_VULKAN(result);
+	const VkSurfaceCapabilitiesKHR& capabilities = this->swapchain_support.capabilities;
+
+	/* One image more than frames in flight: every frame in flight can own an image while the
+	   presentation engine displays another one. More images only add latency. */
+	uint32_t n_images = std::max(capabilities.minImageCount, this->n_frames_in_flight + 1);
+	if (capabilities.maxImageCount > 0 && n_images > capabilities.maxImageCount)	// 0 means no limit
+		n_images = capabilities.maxImageCount;
+
+	VkCompositeAlphaFlagBitsKHR composite_alpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	if (!(capabilities.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR))
+		composite_alpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
+
 	// create swapchain info
 	VkSwapchainCreateInfoKHR swap_chain_info = {};
 	swap_chain_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 	swap_chain_info.pNext = nullptr;
 	swap_chain_info.flags = 0;
 	swap_chain_info.surface = this->surface;
-	swap_chain_info.minImageCount = 3;				// TODO: check if valid
-	swap_chain_info.imageFormat = COLOR_FORMAT;		// TODO: check if valid
-	swap_chain_info.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR; // TODO: check if valid
+	swap_chain_info.minImageCount = n_images;
+	swap_chain_info.imageFormat = this->color_format;
+	swap_chain_info.imageColorSpace = this->color_space;
 	swap_chain_info.imageExtent = { width, height };
 	swap_chain_info.imageArrayLayers = 1;
 	swap_chain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 	swap_chain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	swap_chain_info.queueFamilyIndexCount = 0;
 	swap_chain_info.pQueueFamilyIndices = nullptr;
-	swap_chain_info.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR; // image can also be rotated
-	swap_chain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	swap_chain_info.presentMode = VK_PRESENT_MODE_FIFO_KHR; // TODO: check if valid
+	swap_chain_info.preTransform = capabilities.currentTransform;	// don't let the presentation engine rotate the image
+	swap_chain_info.compositeAlpha = composite_alpha;
+	swap_chain_info.presentMode = this->present_mode;
 	swap_chain_info.clipped = VK_TRUE;
 	swap_chain_info.oldSwapchain = this->swapchain; // is needed if swap chain is modified, e.g. when the window resizes
 
 	// chreate actual swapchain
-	VkResult result = vkCreateSwapchainKHR(this->device, &swap_chain_info, nullptr, &this->swapchain);
+	result = vkCreateSwapchainKHR(this->device, &swap_chain_info, nullptr, &this->swapchain);
 	ASSERT_VULKAN(result);
 }
 
+void FirstVulkan::vulkan_create_offscreen_images(void)
+{
+	/* Headless mode: the offscreen images take the place of the swapchain images.
+	   There is one image for every frame in flight. */
+	this->n_images_swapchain = this->n_frames_in_flight;
+	this->offscreen_images = new VkImage[this->n_images_swapchain];
+	this->offscreen_memory = new allocation_t[this->n_images_swapchain];
+
+	for (uint32_t i = 0; i < this->n_images_swapchain; i++)
+	{
+		VkImageCreateInfo image_info = {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.pNext = nullptr;
+		image_info.flags = 0;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = this->color_format;
+		image_info.extent.width = this->width;
+		image_info.extent.height = this->height;
+		image_info.extent.depth = 1;
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;	// rendered to and optionally read back
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.queueFamilyIndexCount = 0;
+		image_info.pQueueFamilyIndices = nullptr;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VkResult result = vkCreateImage(this->device, &image_info, nullptr, this->offscreen_images + i);
+		ASSERT_VULKAN(result);
+
+		this->offscreen_memory[i] = this->allocator.allocate_image(this->offscreen_images[i], image_info.tiling, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+}
+
 void FirstVulkan::vulkan_create_image_views(void)
 {
-	// retrieve images for drawing from swapchain
-	vkGetSwapchainImagesKHR(this->device, this->swapchain, &this->n_images_swapchain, nullptr);
+	// retrieve images for drawing from swapchain, or use the offscreen images in headless mode
+	if (!this->settings.headless)
+		vkGetSwapchainImagesKHR(this->device, this->swapchain, &this->n_images_swapchain, nullptr);
 	VkImage images_swapchain[n_images_swapchain];
-	VkResult result = vkGetSwapchainImagesKHR(this->device, this->swapchain, &this->n_images_swapchain, images_swapchain);
-	ASSERT_VULKAN(result);
+	VkResult result = VK_SUCCESS;
+	if (this->settings.headless)
+	{
+		for (uint32_t i = 0; i < this->n_images_swapchain; i++)
+			images_swapchain[i] = this->offscreen_images[i];
+	}
+	else
+	{
+		result = vkGetSwapchainImagesKHR(this->device, this->swapchain, &this->n_images_swapchain, images_swapchain);
+		ASSERT_VULKAN(result);
+	}
 
 	// create image view for every image of the swapchain
 	this->image_views = new VkImageView[this->n_images_swapchain];
@@ -274,7 +748,7 @@ void FirstVulkan::vulkan_create_image_views(void)
 		image_view_info.flags = 0;
 		image_view_info.image = images_swapchain[i];
 		image_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		image_view_info.format = COLOR_FORMAT; // TODO: check if valid
+		image_view_info.format = this->color_format;
 		image_view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
 		image_view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
 		image_view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -297,7 +771,7 @@ void FirstVulkan::vulkan_create_render_pass(void)
 	// attachment description for framebuffer
 	VkAttachmentDescription attachment_description = {};
 	attachment_description.flags = 0;
-	attachment_description.format = COLOR_FORMAT;
+	attachment_description.format = this->color_format;
 	attachment_description.samples = VK_SAMPLE_COUNT_1_BIT;
 	attachment_description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	attachment_description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -305,6 +779,8 @@ void FirstVulkan::vulkan_create_render_pass(void)
 	attachment_description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachment_description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;		// layout before render pass
 	attachment_description.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;	// layout after render pass
+	if (this->settings.headless)
+		attachment_description.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;	// offscreen images are not presented but can be read back
 
 	// attachment description for depth buffer
 	VkAttachmentDescription depth_description = {};
@@ -345,10 +821,12 @@ void FirstVulkan::vulkan_create_render_pass(void)
 	VkSubpassDependency subpass_dependency = {};
 	subpass_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;	// interal subpass
 	subpass_dependency.dstSubpass = 0;						// our subpass, depends on the internal pass to finish!
-	subpass_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;	// transformation happens after the color output
-	subpass_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpass_dependency.srcAccessMask = 0;					// destination (output image) must be read-write
-	subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	/* All frames in flight share the depth image, the clear of this frame must wait for the depth writes
+	   of the frame before, the frames overlap otherwise. */
+	subpass_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;	// transformation happens after the color output
+	subpass_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	subpass_dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;	// destination (output image) must be read-write
+	subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	subpass_dependency.dependencyFlags = 0;
 
 	std::vector<VkAttachmentDescription> attachments = {
@@ -375,24 +853,32 @@ void FirstVulkan::vulkan_create_render_pass(void)
 
 void FirstVulkan::vulkan_create_shader_modules(void)
 {
-	/* Creating shaders can be improved and more automatized. */
-	std::vector<char> shadercode_main_vert, shadercode_main_frag;
-	// read shader code
-	this->read_shader("../../../shader/spir-v/main_vert.spv", shadercode_main_vert);
-	this->read_shader("../../../shader/spir-v/main_frag.spv", shadercode_main_frag);
-
-	// create shader modules for every shader
-	VkResult result = this->create_shader_moudle(shadercode_main_vert, &this->shadermodule_main_vert);
+	/* The SPIR-V code is compiled and embedded into the executable by the build, the modules
+	   are created straight from it without reading files. */
+	VkResult result = this->create_shader_moudle(SPIRV_MAIN_VERT, SPIRV_MAIN_VERT_SIZE, &this->shadermodule_main_vert);
+	ASSERT_VULKAN(result);
+	result = this->create_shader_moudle(SPIRV_MAIN_FRAG, SPIRV_MAIN_FRAG_SIZE, &this->shadermodule_main_frag);
 	ASSERT_VULKAN(result);
-	this->create_shader_moudle(shadercode_main_frag, &this->shadermodule_main_frag);
+	result = this->create_shader_moudle(SPIRV_CULL_COMP, SPIRV_CULL_COMP_SIZE, &this->shadermodule_cull_comp);
 	ASSERT_VULKAN(result);
+
+	// index a descriptor array and read gl_DrawID, the modules can only be created with descriptor indexing and draw parameters enabled
+	this->shadermodule_bindless_vert = VK_NULL_HANDLE;
+	this->shadermodule_bindless_frag = VK_NULL_HANDLE;
+	if (this->bindless_textures)
+	{
+		result = this->create_shader_moudle(SPIRV_BINDLESS_VERT, SPIRV_BINDLESS_VERT_SIZE, &this->shadermodule_bindless_vert);
+		ASSERT_VULKAN(result);
+		result = this->create_shader_moudle(SPIRV_BINDLESS_FRAG, SPIRV_BINDLESS_FRAG_SIZE, &this->shadermodule_bindless_frag);
+		ASSERT_VULKAN(result);
+	}
 }
 
 void FirstVulkan::vulkan_create_descriptor_set_layout(void)
 {
 	VkDescriptorSetLayoutBinding uniform_set_binding = {};
 	uniform_set_binding.binding = 0;
-	uniform_set_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uniform_set_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;	// the offset changes every frame
 	uniform_set_binding.descriptorCount = 1;
 	uniform_set_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	uniform_set_binding.pImmutableSamplers = nullptr;
@@ -418,6 +904,46 @@ void FirstVulkan::vulkan_create_descriptor_set_layout(void)
 	
 	VkResult result = vkCreateDescriptorSetLayout(this->device, &descr_set_info, nullptr, &this->descriptor_set_layout);
 	ASSERT_VULKAN(result);
+
+	/* The texture array is a set of its own, dynamic uniform buffers can't be in a set of an update-after-bind
+	   pool. Elements after the last texture are never written, which partially bound allows. The sampler
+	   binding of set 0 stays, it is written but not used by bindless.frag. The textures of the draw slots
+	   are a storage buffer in the same set, it is written once and never updated after binding. */
+	this->bindless_descriptor_set_layout = VK_NULL_HANDLE;
+	if (!this->bindless_textures)
+		return;
+
+	VkDescriptorSetLayoutBinding texture_array_binding = {};
+	texture_array_binding.binding = 0;
+	texture_array_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	texture_array_binding.descriptorCount = MAX_BINDLESS_TEXTURES;
+	texture_array_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	texture_array_binding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding draw_texture_binding = {};
+	draw_texture_binding.binding = 1;
+	draw_texture_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	draw_texture_binding.descriptorCount = 1;
+	draw_texture_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	draw_texture_binding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding bindless_bindings[] = { texture_array_binding, draw_texture_binding };
+	VkDescriptorBindingFlags binding_flags[] = { VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT, 0 };
+	VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {};
+	binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	binding_flags_info.pNext = nullptr;
+	binding_flags_info.bindingCount = 2;
+	binding_flags_info.pBindingFlags = binding_flags;
+
+	VkDescriptorSetLayoutCreateInfo bindless_set_info = {};
+	bindless_set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	bindless_set_info.pNext = &binding_flags_info;
+	bindless_set_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	bindless_set_info.bindingCount = 2;
+	bindless_set_info.pBindings = bindless_bindings;
+
+	result = vkCreateDescriptorSetLayout(this->device, &bindless_set_info, nullptr, &this->bindless_descriptor_set_layout);
+	ASSERT_VULKAN(result);
 }
 
 void FirstVulkan::vulkan_create_pipeline(void)
@@ -428,7 +954,7 @@ void FirstVulkan::vulkan_create_pipeline(void)
 	shader_stage_main_vert.pNext = nullptr;
 	shader_stage_main_vert.flags = 0;
 	shader_stage_main_vert.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	shader_stage_main_vert.module = this->shadermodule_main_vert;
+	shader_stage_main_vert.module = this->bindless_textures ? this->shadermodule_bindless_vert : this->shadermodule_main_vert;
 	shader_stage_main_vert.pName = "main";					// main function of shader
 	shader_stage_main_vert.pSpecializationInfo = nullptr;	// can be used to optimize constants and expressions where the constants are used
 
@@ -437,7 +963,7 @@ void FirstVulkan::vulkan_create_pipeline(void)
 	shader_stage_main_frag.pNext = nullptr;
 	shader_stage_main_frag.flags = 0;
 	shader_stage_main_frag.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	shader_stage_main_frag.module = this->shadermodule_main_frag;
+	shader_stage_main_frag.module = this->bindless_textures ? this->shadermodule_bindless_frag : this->shadermodule_main_frag;
 	shader_stage_main_frag.pName = "main";					// main function of shader
 	shader_stage_main_vert.pSpecializationInfo = nullptr;	// can be used to optimize constants and expressions where the constants are used
 
@@ -447,20 +973,22 @@ void FirstVulkan::vulkan_create_pipeline(void)
 	};
 
 	// get binding descriptions
-	VkVertexInputBindingDescription vertex_binding_descr = {};
-	vertex_t::get_binding_description(vertex_binding_descr);
+	VkVertexInputBindingDescription vertex_binding_descr[2] = {};
+	vertex_t::get_binding_description(vertex_binding_descr[0]);
+	instance_t::get_binding_description(vertex_binding_descr[1]);
 
 	// get attribute descriptions, equals glVertexAttribPointer
 	std::vector<VkVertexInputAttributeDescription> vertex_attrib_descr;
 	vertex_t::get_attrib_descriptions(vertex_attrib_descr);
+	instance_t::get_attrib_descriptions(vertex_attrib_descr);
 
 	// create vertex shader input info
 	VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
 	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	vertex_input_info.pNext = nullptr;
 	vertex_input_info.flags = 0;
-	vertex_input_info.vertexBindingDescriptionCount = 1;		// i think thats the equivalent to glBindBuffer
-	vertex_input_info.pVertexBindingDescriptions = &vertex_binding_descr;
+	vertex_input_info.vertexBindingDescriptionCount = 2;		// i think thats the equivalent to glBindBuffer
+	vertex_input_info.pVertexBindingDescriptions = vertex_binding_descr;
 	vertex_input_info.vertexAttributeDescriptionCount = vertex_attrib_descr.size();
 	vertex_input_info.pVertexAttributeDescriptions = vertex_attrib_descr.data();
 
@@ -574,15 +1102,21 @@ void FirstVulkan::vulkan_create_pipeline(void)
 	dynamic_state_info.dynamicStateCount = dynamic_pipeline_states.size();
 	dynamic_state_info.pDynamicStates = dynamic_pipeline_states.data();
 
-	// create pipeline layout
+	// create pipeline layout, with bindless textures the texture array is set 1 and every draw call pushes its first draw slot
+	VkDescriptorSetLayout set_layouts[] = { this->descriptor_set_layout, this->bindless_descriptor_set_layout };
+	VkPushConstantRange first_slot_range = {};
+	first_slot_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	first_slot_range.offset = 0;
+	first_slot_range.size = sizeof(uint32_t);
+
 	VkPipelineLayoutCreateInfo pipeline_layout_info = {};
 	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipeline_layout_info.pNext = nullptr;
 	pipeline_layout_info.flags = 0;
-	pipeline_layout_info.setLayoutCount = 1;
-	pipeline_layout_info.pSetLayouts = &this->descriptor_set_layout;
-	pipeline_layout_info.pushConstantRangeCount = 0;
-	pipeline_layout_info.pPushConstantRanges = nullptr;
+	pipeline_layout_info.setLayoutCount = this->bindless_textures ? 2 : 1;
+	pipeline_layout_info.pSetLayouts = set_layouts;
+	pipeline_layout_info.pushConstantRangeCount = this->bindless_textures ? 1 : 0;
+	pipeline_layout_info.pPushConstantRanges = &first_slot_range;
 
 	VkResult result = vkCreatePipelineLayout(this->device, &pipeline_layout_info, nullptr, &this->pipeline_layout);
 	ASSERT_VULKAN(result);
@@ -609,8 +1143,70 @@ void FirstVulkan::vulkan_create_pipeline(void)
 	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;	// used for inheritance
 	pipeline_info.basePipelineIndex = -1;				// invalid index
 
-	// finally, create pipeline
-	result = vkCreateGraphicsPipelines(this->device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->pipeline);
+	// finally, create pipeline, the driver reuses the shader binaries of earlier runs from the cache
+	double t_create = get_time();
+	result = vkCreateGraphicsPipelines(this->device, this->pipeline_cache.get(), 1, &pipeline_info, nullptr, &this->pipeline);
+	ASSERT_VULKAN(result);
+	std::cout << "Pipeline created in " << (get_time() - t_create) * 1000.0 << " ms (" << this->pipeline_cache.get_loaded_size() << " bytes of cache data loaded)" << std::endl;
+}
+
+void FirstVulkan::vulkan_create_cull_pipeline(void)
+{
+	// instances, culled instances, indirect draws
+	VkDescriptorSetLayoutBinding bindings[3] = {};
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo set_layout_info = {};
+	set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	set_layout_info.pNext = nullptr;
+	set_layout_info.flags = 0;
+	set_layout_info.bindingCount = 3;
+	set_layout_info.pBindings = bindings;
+
+	VkResult result = vkCreateDescriptorSetLayout(this->device, &set_layout_info, nullptr, &this->cull_descriptor_set_layout);
+	ASSERT_VULKAN(result);
+
+	// the frustum changes every frame, it is pushed with the dispatch
+	VkPushConstantRange push_constant_range = {};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(cull_constants_t);
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.pNext = nullptr;
+	pipeline_layout_info.flags = 0;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts = &this->cull_descriptor_set_layout;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+	result = vkCreatePipelineLayout(this->device, &pipeline_layout_info, nullptr, &this->cull_pipeline_layout);
+	ASSERT_VULKAN(result);
+
+	VkComputePipelineCreateInfo pipeline_info = {};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.pNext = nullptr;
+	pipeline_info.flags = 0;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.pNext = nullptr;
+	pipeline_info.stage.flags = 0;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = this->shadermodule_cull_comp;
+	pipeline_info.stage.pName = "main";
+	pipeline_info.stage.pSpecializationInfo = nullptr;
+	pipeline_info.layout = this->cull_pipeline_layout;
+	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+	pipeline_info.basePipelineIndex = -1;
+
+	result = vkCreateComputePipelines(this->device, this->pipeline_cache.get(), 1, &pipeline_info, nullptr, &this->cull_pipeline);
 	ASSERT_VULKAN(result);
 }
 
@@ -647,7 +1243,7 @@ void FirstVulkan::vulkan_create_command_pool(void)
 	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	cmd_pool_info.pNext = nullptr;
 	cmd_pool_info.flags = 0;			// can allow to update command buffers on per buffer basis, or can allow to record the command buffers every iteration (OpenGL)
-	cmd_pool_info.queueFamilyIndex = 0;	// TODO: check if valid, family MUST have graphics bit anebled
+	cmd_pool_info.queueFamilyIndex = this->queue_families.graphics;
 
 	// create command pool
 	VkResult result = vkCreateCommandPool(this->device, &cmd_pool_info, nullptr, &this->cmd_pool);
@@ -656,21 +1252,48 @@ void FirstVulkan::vulkan_create_command_pool(void)
 
 void FirstVulkan::vulkan_create_command_buffers(void)
 {
-	// allocation info for command buffer(s)
-	VkCommandBufferAllocateInfo cmd_buffer_alloc_info = {};
-	cmd_buffer_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cmd_buffer_alloc_info.pNext = nullptr;
-	cmd_buffer_alloc_info.commandPool = this->cmd_pool;
-	cmd_buffer_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	cmd_buffer_alloc_info.commandBufferCount = this->n_images_swapchain;	// needed for every image in the swapchain 
-
-	// create final command buffers
-	this->cmd_buffers = new VkCommandBuffer[this->n_images_swapchain];
-	VkResult result = vkAllocateCommandBuffers(this->device, &cmd_buffer_alloc_info, this->cmd_buffers);
-	ASSERT_VULKAN(result);
+	/* Every frame in flight gets its own command pool. The pool is reset as a whole
+	   as soon as the frame's fence is signaled and the command buffer is recorded new. */
+	VkCommandPoolCreateInfo cmd_pool_info = {};
+	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmd_pool_info.pNext = nullptr;
+	cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;	// command buffers are short-living, they are recorded every frame
+	cmd_pool_info.queueFamilyIndex = this->queue_families.graphics;
+
+	for (uint32_t i = 0; i < this->n_frames_in_flight; i++)
+	{
+		VkResult result = vkCreateCommandPool(this->device, &cmd_pool_info, nullptr, &this->frames[i].cmd_pool);
+		ASSERT_VULKAN(result);
+
+		// allocation info for command buffer
+		VkCommandBufferAllocateInfo cmd_buffer_alloc_info = {};
+		cmd_buffer_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cmd_buffer_alloc_info.pNext = nullptr;
+		cmd_buffer_alloc_info.commandPool = this->frames[i].cmd_pool;
+		cmd_buffer_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cmd_buffer_alloc_info.commandBufferCount = 1;
+
+		result = vkAllocateCommandBuffers(this->device, &cmd_buffer_alloc_info, &this->frames[i].cmd_buffer);
+		ASSERT_VULKAN(result);
+
+		// every worker of the thread pool can record one slice of the draw list
+		if (!this->parallel_recording)
+			continue;
+		this->frames[i].recorders.resize(this->thread_pool.get_thread_count());
+		for (recorder_t& recorder : this->frames[i].recorders)
+		{
+			result = vkCreateCommandPool(this->device, &cmd_pool_info, nullptr, &recorder.cmd_pool);
+			ASSERT_VULKAN(result);
+
+			cmd_buffer_alloc_info.commandPool = recorder.cmd_pool;
+			cmd_buffer_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			result = vkAllocateCommandBuffers(this->device, &cmd_buffer_alloc_info, &recorder.cmd_buffer);
+			ASSERT_VULKAN(result);
+		}
+	}
 }
 
-void FirstVulkan::vulkan_create_semaphores(void)
+void FirstVulkan::vulkan_create_sync_objects(void)
 {
 	// create info for semaphores
 	VkSemaphoreCreateInfo semaphore_info = {};
@@ -678,11 +1301,32 @@ void FirstVulkan::vulkan_create_semaphores(void)
 	semaphore_info.pNext = nullptr;
 	semaphore_info.flags = 0;
 
-	// semaphores for rendering
-	VkResult result = vkCreateSemaphore(this->device, &semaphore_info, nullptr, &this->semaphore_img_aviable);
-	ASSERT_VULKAN(result);
-	result = vkCreateSemaphore(this->device, &semaphore_info, nullptr, &this->semaphore_rendering_done);
-	ASSERT_VULKAN(result);
+	// create info for fences
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.pNext = nullptr;
+	fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;	// the first wait of every frame must not block
+
+	for (uint32_t i = 0; i < this->n_frames_in_flight; i++)
+	{
+		// semaphores for rendering
+		VkResult result = vkCreateSemaphore(this->device, &semaphore_info, nullptr, &this->frames[i].semaphore_img_aviable);
+		ASSERT_VULKAN(result);
+		result = vkCreateSemaphore(this->device, &semaphore_info, nullptr, &this->frames[i].semaphore_rendering_done);
+		ASSERT_VULKAN(result);
+
+		// fence to limit the number of frames the CPU is ahead of the GPU
+		result = vkCreateFence(this->device, &fence_info, nullptr, &this->frames[i].fence_in_flight);
+		ASSERT_VULKAN(result);
+	}
+}
+
+void FirstVulkan::vulkan_create_image_fences(void)
+{
+	// no swapchain image is in use at the beginning
+	this->fences_images_in_flight = new VkFence[this->n_images_swapchain];
+	for (uint32_t i = 0; i < this->n_images_swapchain; i++)
+		this->fences_images_in_flight[i] = VK_NULL_HANDLE;
 }
 
 void FirstVulkan::vulkan_recrate_swapchain(void)
@@ -694,143 +1338,285 @@ void FirstVulkan::vulkan_recrate_swapchain(void)
 	ASSERT_VULKAN(result);
 
 	// destroy the old objects...
-	vkFreeCommandBuffers(this->device, this->cmd_pool, this->n_images_swapchain, this->cmd_buffers);	// command buffer depends on the number of images in the swapchain
-	delete[] this->cmd_buffers;
+	delete[] this->fences_images_in_flight;		// depends on the number of images in the swapchain
 	for (size_t i = 0; i < this->n_images_swapchain; i++)
 		vkDestroyFramebuffer(this->device, this->fbos_swapchain[i], nullptr);	// framebuffer depends on the window size
 	delete[] this->fbos_swapchain;
 	for (size_t i = 0; i < this->n_images_swapchain; i++)
 		vkDestroyImageView(this->device, this->image_views[i], nullptr);		// image view depends on the window size
 	delete[] this->image_views;
+	vkDestroyImageView(this->device, this->depth_image_view, nullptr);		// depth image depends on the window size
+	vkDestroyImage(this->device, this->depth_image, nullptr);
+	this->allocator.free(this->depth_memory);
 
 	// ...and create them new
 	VkSwapchainKHR old_swapchain = this->swapchain;	// Save old swapchain because VkSwapchainCreateInfoKHR must inherit from the old_swapchain in order to create the new one.
 
 	this->vulkan_create_swapchain();				// Old swapchain is saved in this->swapchain and then gets overwritten. New swapchain interits from the old swapchain.
 	this->vulkan_create_image_views();
-	this->vulkan_create_depth_image(this->physical_devices[0], this->queue);
+	this->upload_batch.begin();
+	this->vulkan_create_depth_image(this->physical_devices[0]);
+	this->upload_batch.submit();
+	this->upload_batch.wait();
 	this->vulkan_create_framebuffers();				// recreate framebuffers
-	this->vulkan_create_command_buffers();			// recreate command buffers
-	this->vulkan_record_command_buffers();			// command buffers must also recorded new
+	this->vulkan_create_image_fences();				// command buffers are recorded every frame, only the image tracking must be recreated
 
 	vkDestroySwapchainKHR(this->device, old_swapchain, nullptr);	// Delete old swapchain, in this->swapchain is saved the new swapchain.
 }
 
-uint32_t FirstVulkan::vulkan_find_mem_type_index(uint32_t type_filter, VkMemoryPropertyFlags properties)
+FirstVulkan::decoded_texture_t FirstVulkan::decode_texture(const std::string& path, const std::vector<ktx2_candidate_t>& candidates, bool blit_mipmaps)
 {
-	VkPhysicalDeviceMemoryProperties device_mem_properties = {};
-	vkGetPhysicalDeviceMemoryProperties(this->physical_devices[0], &device_mem_properties); // TODO:: check if valid
+	// runs on a worker thread, no Vulkan functions are called here
+	decoded_texture_t decoded;
+	decoded.blit_mipmaps = false;
 
-	for (uint32_t i = 0; i < device_mem_properties.memoryTypeCount; i++)
+	// block compressed textures need 4-8 times less memory, converted files are stored next to the source image
+	std::string base_path = path.substr(0, path.find_last_of('.'));
+	for (const ktx2_candidate_t& candidate : candidates)
 	{
-		// get bit at i
-		if ((type_filter & (1 << i)) && (device_mem_properties.memoryTypes[i].propertyFlags & properties) == properties)
-			return i;
+		if (!decoded.data.load(base_path + candidate.suffix))
+			continue;
+		if (decoded.data.get_format() != candidate.format)
+			throw std::runtime_error("KTX2 texture " + base_path + candidate.suffix + " has an unexpected format!");
+		return decoded;
 	}
 
-	throw std::runtime_error("Found no correct memory type!");
+	int w, h, c;
+	stbi_uc* img_data = stbi_load(path.c_str(), &w, &h, &c, 4);	// force loaded 4 channels
+	if (img_data == nullptr)
+		throw std::runtime_error("Unable to load texture " + path + "!");
+
+	/* The whole mip chain is created. The GPU blits the levels if the format can be filtered
+	   linearly as blit source and destination, otherwise the levels are generated here. */
+	uint32_t mip_levels = MipChain::get_level_count(w, h);
+	decoded.blit_mipmaps = blit_mipmaps;
+	decoded.data.create(VK_FORMAT_R8G8B8A8_UNORM, w, h);
+	decoded.data.add_level(img_data, (VkDeviceSize)w * h * 4);
+	stbi_image_free(img_data);
+	if (!blit_mipmaps)
+	{
+		for (uint32_t level = 1; level < mip_levels; level++)
+		{
+			uint8_t* dst = decoded.data.add_level((VkDeviceSize)MipChain::get_level_extent(w, level) * MipChain::get_level_extent(h, level) * 4);
+			MipChain::downsample_rgba8(decoded.data.get_level_data(level - 1), MipChain::get_level_extent(w, level - 1), MipChain::get_level_extent(h, level - 1), dst);
+		}
+	}
+	return decoded;
 }
 
-void FirstVulkan::vulkan_load_texture(void)
+VkDeviceSize FirstVulkan::get_staging_size(const decoded_texture_t& decoded, uint32_t base_level)
 {
-	int w, h, c;
-	stbi_uc* img_data = stbi_load("../../../textures/texture1.jpg", &w, &h, &c, 4);
-
-	std::cout << "Image width: " << w << std::endl;
-	std::cout << "Image height: " << h << std::endl;
-	std::cout << "Image color channels: " << c << std::endl;
-	std::cout << "Number of pixels: " << w * h << std::endl;
+	return decoded.data.get_data_size() - decoded.data.get_level(base_level).offset;
+}
 
-	c = 4; // force loaded 4 channels
+void FirstVulkan::stage_texture(const decoded_texture_t& decoded, uint32_t base_level, uint8_t* staging)
+{
+	// the levels are stored one after another, they are staged with a single copy. Runs on worker threads too
+	VkDeviceSize base_offset = decoded.data.get_level(base_level).offset;
+	memcpy(staging, decoded.data.get_data() + base_offset, decoded.data.get_data_size() - base_offset);
+}
 
-	if (img_data == nullptr)
-		throw std::runtime_error("Unable to load texture!");
+void FirstVulkan::vulkan_upload_texture(const decoded_texture_t& decoded, uint32_t base_level, texture_t& texture)
+{
+	StagingRing::span_t staging = this->upload_batch.stage(FirstVulkan::get_staging_size(decoded, base_level));
+	FirstVulkan::stage_texture(decoded, base_level, staging.data);
+	this->vulkan_upload_texture(decoded, base_level, staging, texture);
+}
 
-	VkDeviceSize byte_size = byte_size = w * h * c;
-	
-	// create staging buffer + memory for texture
-	VkBuffer texture1_staging_buffer = {};
-	VkDeviceMemory texture1_staging_buffer_mem = {};
-	this->vulkan_create_buffer(byte_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, texture1_staging_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, texture1_staging_buffer_mem);
-
-	// load texture in staging buffer (is still in RAM)
-	void* tex_map;
-	vkMapMemory(this->device, texture1_staging_buffer_mem, 0, byte_size, 0, &tex_map);
-	memcpy(tex_map, img_data, byte_size);
-	vkUnmapMemory(this->device, texture1_staging_buffer_mem);
-
-	VkImageCreateInfo tex1_info = {};
-	tex1_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	tex1_info.pNext = nullptr;
-	tex1_info.flags = 0;
-	tex1_info.imageType = VK_IMAGE_TYPE_2D;
-	tex1_info.format = VK_FORMAT_R8G8B8A8_UNORM;
-	tex1_info.extent.width = w;
-	tex1_info.extent.height = h;
-	tex1_info.extent.depth = 1;
-	tex1_info.mipLevels = 1;
-	tex1_info.arrayLayers = 1;
-	tex1_info.samples = VK_SAMPLE_COUNT_1_BIT;
-	tex1_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-	tex1_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;	// pixels get transfered from staging buffer into the image and it should be sampled
-	tex1_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	tex1_info.queueFamilyIndexCount = 0;				// we dont share the queues between multiple queue families
-	tex1_info.pQueueFamilyIndices = nullptr;
-	tex1_info.initialLayout = this->texture1_layout;
+void FirstVulkan::vulkan_upload_texture(const decoded_texture_t& decoded, uint32_t base_level, const StagingRing::span_t& staging, texture_t& texture)
+{
+	// the image holds the levels from base_level on, only complete chains can be blitted
+	const Ktx2Texture& data = decoded.data;
+	if (decoded.blit_mipmaps && base_level != 0)
+		throw std::logic_error("Blitted mip chains can't start at a higher level!");
+	texture.format = data.get_format();
+	texture.width = MipChain::get_level_extent(data.get_width(), base_level);
+	texture.height = MipChain::get_level_extent(data.get_height(), base_level);
+	texture.mip_levels = decoded.blit_mipmaps ? MipChain::get_level_count(texture.width, texture.height) : data.get_level_count() - base_level;
+	texture.base_level = base_level;
+	texture.layout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+
+	// the staging memory already holds the levels from base_level on
+	VkDeviceSize base_offset = data.get_level(base_level).offset;
+
+	VkImageCreateInfo tex_info = {};
+	tex_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	tex_info.pNext = nullptr;
+	tex_info.flags = 0;
+	tex_info.imageType = VK_IMAGE_TYPE_2D;
+	tex_info.format = texture.format;
+	tex_info.extent.width = texture.width;
+	tex_info.extent.height = texture.height;
+	tex_info.extent.depth = 1;
+	tex_info.mipLevels = texture.mip_levels;
+	tex_info.arrayLayers = 1;
+	tex_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	tex_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	tex_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;	// pixels get transfered from staging buffer into the image and it should be sampled
+	if (decoded.blit_mipmaps)
+		tex_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;	// every level is the blit source of the next one
+	tex_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	tex_info.queueFamilyIndexCount = 0;				// we dont share the queues between multiple queue families
+	tex_info.pQueueFamilyIndices = nullptr;
+	tex_info.initialLayout = texture.layout;
 
 	// create image for texture
-	VkResult result = vkCreateImage(this->device, &tex1_info, nullptr, &this->texture1_image);
+	VkResult result = vkCreateImage(this->device, &tex_info, nullptr, &texture.image);
 	ASSERT_VULKAN(result);
 
-	// memory requierements of texture's image
-	VkMemoryRequirements mem_req = {};
-	vkGetImageMemoryRequirements(this->device, this->texture1_image, &mem_req);
+	// allocate memory on the GPU for the image, it's bound by the allocator
+	texture.memory = this->allocator.allocate_image(texture.image, tex_info.tiling, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	// allocation info for texture's memory
-	VkMemoryAllocateInfo mem_alloc_info = {};
-	mem_alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	mem_alloc_info.pNext = nullptr;
-	mem_alloc_info.allocationSize = mem_req.size;
-	mem_alloc_info.memoryTypeIndex = this->vulkan_find_mem_type_index(mem_req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	// change layout of image that data can be transfered to the image memory
+	this->vulkan_change_layout(texture.image, texture.format, texture.layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.mip_levels);
 
-	// allocate actual memory on the GPU for the image
-	result = vkAllocateMemory(this->device, &mem_alloc_info, nullptr, &this->texture1_memory);
-	ASSERT_VULKAN(result);
+	// write every decoded level to image
+	for (uint32_t level = base_level; level < data.get_level_count(); level++)
+	{
+		const Ktx2Texture::level_t& info = data.get_level(level);
+		this->vulkan_write_buffer_to_image(staging.buffer, texture.image, info.width, info.height, staging.offset + info.offset - base_offset, level - base_level);
+	}
 
-	// upload texture1 to GPU
-	vkBindImageMemory(this->device, this->texture1_image, this->texture1_memory, 0);
+	if (decoded.blit_mipmaps)
+	{
+		this->upload_batch.generate_mipmaps(texture.image, texture.width, texture.height, texture.mip_levels, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		texture.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	else
+	{
+		// change layout of image that the shader can read the image most effectively
+		this->vulkan_change_layout(texture.image, texture.format, texture.layout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.mip_levels);
+	}
 
-	// change layout of image that data can be transfered to the image memory
-	this->vulkan_change_layout(this->cmd_pool, this->queue, this->texture1_image, VK_FORMAT_R8G8B8A8_UNORM, this->texture1_layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-	// write buffer to image
-	this->vulkan_write_buffer_to_image(this->cmd_pool, this->queue, texture1_staging_buffer, w, h);
-
-	// change layout of image that the shader can read the image most effectively
-	this->vulkan_change_layout(this->cmd_pool, this->queue, this->texture1_image, VK_FORMAT_R8G8B8A8_UNORM, this->texture1_layout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-	vkDestroyBuffer(this->device, texture1_staging_buffer, nullptr);
-	vkFreeMemory(this->device, texture1_staging_buffer_mem, nullptr);
-
-	VkImageViewCreateInfo tex1_img_view_info = {};
-	tex1_img_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	tex1_img_view_info.pNext = nullptr;
-	tex1_img_view_info.flags = 0;
-	tex1_img_view_info.image = this->texture1_image;
-	tex1_img_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	tex1_img_view_info.format = VK_FORMAT_R8G8B8A8_UNORM;
-	tex1_img_view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-	tex1_img_view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-	tex1_img_view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-	tex1_img_view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-	tex1_img_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	tex1_img_view_info.subresourceRange.baseMipLevel = 0;
-	tex1_img_view_info.subresourceRange.levelCount = 1;
-	tex1_img_view_info.subresourceRange.baseArrayLayer = 0;
-	tex1_img_view_info.subresourceRange.layerCount = 1;
-
-	result = vkCreateImageView(this->device, &tex1_img_view_info, nullptr, &this->texture1_view);
+	VkImageViewCreateInfo tex_img_view_info = {};
+	tex_img_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	tex_img_view_info.pNext = nullptr;
+	tex_img_view_info.flags = 0;
+	tex_img_view_info.image = texture.image;
+	tex_img_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	tex_img_view_info.format = texture.format;
+	tex_img_view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	tex_img_view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	tex_img_view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	tex_img_view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	tex_img_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	tex_img_view_info.subresourceRange.baseMipLevel = 0;
+	tex_img_view_info.subresourceRange.levelCount = texture.mip_levels;
+	tex_img_view_info.subresourceRange.baseArrayLayer = 0;
+	tex_img_view_info.subresourceRange.layerCount = 1;
+
+	result = vkCreateImageView(this->device, &tex_img_view_info, nullptr, &texture.view);
 	ASSERT_VULKAN(result);
+}
+
+void FirstVulkan::vulkan_destroy_texture(texture_t& texture)
+{
+	vkDestroyImageView(this->device, texture.view, nullptr);
+	vkDestroyImage(this->device, texture.image, nullptr);
+	this->allocator.free(texture.memory);
+}
+
+void FirstVulkan::vulkan_load_textures(const std::vector<std::string>& paths)
+{
+	if (paths.empty())
+		throw std::invalid_argument("At least one texture is needed!");
+
+	// the format support is checked here, the workers must not call Vulkan
+	const ktx2_candidate_t all_candidates[] = {
+		{ ".bc7.ktx2", VK_FORMAT_BC7_UNORM_BLOCK },
+		{ ".etc2.ktx2", VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK },
+		{ ".astc.ktx2", VK_FORMAT_ASTC_4x4_UNORM_BLOCK }
+	};
+	std::vector<ktx2_candidate_t> candidates;
+	for (const ktx2_candidate_t& candidate : all_candidates)
+	{
+		if (this->vulkan_is_format_supported(this->physical_devices[0], candidate.format, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+			candidates.push_back(candidate);
+	}
+	/* Streamed textures upload parts of the chain again and again, the whole chain is kept on the CPU.
+	   Even the first upload only has the small levels, which are built from the whole chain. The workers
+	   generate it, the GPU blits are only used without streaming, which is why streaming is off by default. */
+	bool blit_mipmaps = !this->settings.texture_streaming && this->vulkan_is_format_supported(this->physical_devices[0], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+
+	/* The textures are decoded on the thread pool and the workers copy the decoded levels into
+	   staging memory too. The main thread only allocates the staging memory and records the
+	   copies, in the order of the paths. The ring isn't flushed while workers write into it, if
+	   it is full every copy in flight is recorded first. Only a few textures are decoded ahead,
+	   so the decoded data doesn't pile up in memory. */
+	const size_t n_ahead = 2 * (size_t)this->thread_pool.get_thread_count();
+	std::deque<std::future<decoded_texture_t>> decoding;
+	std::deque<staged_texture_t> staging;
+	size_t n_submitted = 0;
+	uint32_t max_mip_levels = 1;
+	if (this->bindless_textures && paths.size() > MAX_BINDLESS_TEXTURES)
+		throw std::runtime_error("Too many textures for the bindless texture array!");
+	this->textures.resize(paths.size());
+	if (this->settings.texture_streaming)
+		this->texture_sources.resize(paths.size());
+
+	auto record_oldest = [&](void)
+	{
+		staged_texture_t& staged = staging.front();
+		staged.copied.get();		// rethrows errors of the worker
+		texture_t& texture = this->textures[staged.index];
+		this->vulkan_upload_texture(*staged.decoded, staged.base_level, staged.staging, texture);
+		max_mip_levels = std::max(max_mip_levels, staged.base_level + texture.mip_levels);
+
+		std::cout << "Texture " << paths[staged.index] << ": " << texture.width << "x" << texture.height << ", " << texture.mip_levels << " levels" << (staged.decoded->data.get_format() != VK_FORMAT_R8G8B8A8_UNORM ? ", precompressed" : "") << std::endl;
+		if (this->settings.texture_streaming)
+			this->texture_sources[staged.index] = std::move(*staged.decoded);
+		staging.pop_front();
+	};
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		for (; n_submitted < paths.size() && n_submitted <= i + n_ahead; n_submitted++)
+		{
+			const std::string& path = paths[n_submitted];
+			decoding.push_back(this->thread_pool.submit([path, candidates, blit_mipmaps](void) { return FirstVulkan::decode_texture(path, candidates, blit_mipmaps); }));
+		}
+
+		std::shared_ptr<decoded_texture_t> decoded = std::make_shared<decoded_texture_t>(decoding.front().get());		// rethrows errors of the worker
+		decoding.pop_front();
+		uint32_t base_level = 0;
+		if (this->settings.texture_streaming)
+		{
+			// the small levels are always resident, the streamer decides about the others
+			std::vector<VkDeviceSize> level_sizes;
+			for (uint32_t level = 0; level < decoded->data.get_level_count(); level++)
+			{
+				const Ktx2Texture::level_t& info = decoded->data.get_level(level);
+				level_sizes.push_back(info.size);
+				if (base_level == level && std::max(info.width, info.height) > TEXTURE_PINNED_EXTENT && level + 1 < decoded->data.get_level_count())
+					base_level = level + 1;
+			}
+			this->texture_streamer.add_texture(level_sizes, base_level);
+		}
+
+		VkDeviceSize size = FirstVulkan::get_staging_size(*decoded, base_level);
+		StagingRing::span_t span;
+		if (!this->upload_batch.try_stage(size, span))
+		{
+			while (!staging.empty())
+				record_oldest();
+			span = this->upload_batch.stage(size);
+		}
+
+		staged_texture_t staged;
+		staged.index = i;
+		staged.decoded = decoded;
+		staged.base_level = base_level;
+		staged.staging = span;
+		staged.copied = this->thread_pool.submit([decoded, base_level, span](void) { FirstVulkan::stage_texture(*decoded, base_level, span.data); });
+		staging.push_back(std::move(staged));
+
+		// recorded as soon as the copy is done, without waiting for it
+		while (staging.size() > n_ahead || (!staging.empty() && staging.front().copied.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
+			record_oldest();
+	}
+	while (!staging.empty())
+		record_oldest();
 
 	VkSamplerCreateInfo sampler_info = {};
 	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -848,17 +1634,97 @@ void FirstVulkan::vulkan_load_texture(void)
 	sampler_info.compareEnable = VK_FALSE;	// used for shadow maps (shadow samplers) equal to OpenGL's texture parameter GL_COMPARE_R_TO_TEXTURE
 	sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
 	sampler_info.minLod = 0.0f;	// level of detail
-	sampler_info.maxLod = 0.0f;
+	sampler_info.maxLod = (float)max_mip_levels;		// all levels of every texture
 	sampler_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 	sampler_info.unnormalizedCoordinates = VK_FALSE;
 
-	result = vkCreateSampler(this->device, &sampler_info, nullptr, &this->texture1_sampler);
+	VkResult result = vkCreateSampler(this->device, &sampler_info, nullptr, &this->texture_sampler);
 	ASSERT_VULKAN(result);
+}
 
-	stbi_image_free(img_data);
+VkDeviceSize FirstVulkan::vulkan_query_texture_budget(void)
+{
+	VkDeviceSize budget = (VkDeviceSize)this->settings.texture_budget_mb * 1024 * 1024;
+	if (!this->memory_budget_supported)
+		return budget;
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {};
+	budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+	budget_properties.pNext = nullptr;
+
+	VkPhysicalDeviceMemoryProperties2 memory_properties = {};
+	memory_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	memory_properties.pNext = &budget_properties;
+	vkGetPhysicalDeviceMemoryProperties2(this->physical_devices[0], &memory_properties);
+
+	/* Other processes share the heap, the budget of the process changes over time. Streamed
+	   textures may grow into 90% of what is left, the rest is headroom for other allocations. */
+	for (uint32_t i = 0; i < memory_properties.memoryProperties.memoryHeapCount; i++)
+	{
+		if (!(memory_properties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+			continue;
+		VkDeviceSize usage = budget_properties.heapUsage[i];
+		VkDeviceSize available = (budget_properties.heapBudget[i] > usage) ? (budget_properties.heapBudget[i] - usage) / 10 * 9 : 0;
+		return std::min(budget, this->texture_streamer.get_resident_size() + available);
+	}
+	return budget;
+}
+
+void FirstVulkan::vulkan_update_texture_descriptors(frame_t& frame)
+{
+	// the GPU has finished the frame's last use of the set, it can be written without a stall
+	if (frame.descriptor_version == this->texture_descriptor_version)
+		return;
+
+	VkDescriptorImageInfo descr_image_info = {};
+	descr_image_info.sampler = this->texture_sampler;
+	descr_image_info.imageView = this->textures[0].view;
+	descr_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write_sampler_set = {};
+	write_sampler_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write_sampler_set.pNext = nullptr;
+	write_sampler_set.dstSet = frame.descriptor_set;
+	write_sampler_set.dstBinding = 1;
+	write_sampler_set.dstArrayElement = 0;
+	write_sampler_set.descriptorCount = 1;
+	write_sampler_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write_sampler_set.pImageInfo = &descr_image_info;
+	write_sampler_set.pBufferInfo = nullptr;
+	write_sampler_set.pTexelBufferView = nullptr;
+
+	vkUpdateDescriptorSets(this->device, 1, &write_sampler_set, 0, nullptr);
+
+	// every texture is an element of the array, the elements after the last texture stay unwritten
+	if (this->bindless_textures)
+	{
+		uint32_t n_textures = static_cast<uint32_t>(this->textures.size());
+		VkDescriptorImageInfo texture_infos[n_textures];
+		for (uint32_t i = 0; i < n_textures; i++)
+		{
+			texture_infos[i].sampler = this->texture_sampler;
+			texture_infos[i].imageView = this->textures[i].view;
+			texture_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+
+		VkWriteDescriptorSet write_texture_array = {};
+		write_texture_array.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write_texture_array.pNext = nullptr;
+		write_texture_array.dstSet = frame.bindless_descriptor_set;
+		write_texture_array.dstBinding = 0;
+		write_texture_array.dstArrayElement = 0;
+		write_texture_array.descriptorCount = n_textures;
+		write_texture_array.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write_texture_array.pImageInfo = texture_infos;
+		write_texture_array.pBufferInfo = nullptr;
+		write_texture_array.pTexelBufferView = nullptr;
+
+		vkUpdateDescriptorSets(this->device, 1, &write_texture_array, 0, nullptr);
+	}
+	frame.descriptor_version = this->texture_descriptor_version;
 }
 
-void FirstVulkan::vulkan_create_depth_image(VkPhysicalDevice physicalDevice, VkQueue queue)
+void FirstVulkan::vulkan_create_depth_image(VkPhysicalDevice physicalDevice)
 {
 	VkFormat depth_format = this->vulkan_find_depth_format(physicalDevice);
 
@@ -885,23 +1751,8 @@ void FirstVulkan::vulkan_create_depth_image(VkPhysicalDevice physicalDevice, VkQ
 	VkResult result = vkCreateImage(this->device, &depth_info, nullptr, &this->depth_image);
 	ASSERT_VULKAN(result);
 
-	// memory requierements of texture's image
-	VkMemoryRequirements mem_req = {};
-	vkGetImageMemoryRequirements(this->device, this->depth_image, &mem_req);
-
-	// allocation info for texture's memory
-	VkMemoryAllocateInfo mem_alloc_info = {};
-	mem_alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	mem_alloc_info.pNext = nullptr;
-	mem_alloc_info.allocationSize = mem_req.size;
-	mem_alloc_info.memoryTypeIndex = this->vulkan_find_mem_type_index(mem_req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-	// allocate actual memory on the GPU for the image
-	result = vkAllocateMemory(this->device, &mem_alloc_info, nullptr, &this->depth_memory);
-	ASSERT_VULKAN(result);
-
-	result = vkBindImageMemory(this->device, this->depth_image, this->depth_memory, 0);
-	ASSERT_VULKAN(result);
+	// allocate memory on the GPU for the image, it's bound by the allocator
+	this->depth_memory = this->allocator.allocate_image(this->depth_image, depth_info.tiling, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
 	VkImageViewCreateInfo depth_img_view_info = {};
 	depth_img_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -925,10 +1776,10 @@ void FirstVulkan::vulkan_create_depth_image(VkPhysicalDevice physicalDevice, VkQ
 
 	// change layout from depth buffer
 	VkImageLayout img_layout = VK_IMAGE_LAYOUT_UNDEFINED;
-	this->vulkan_change_layout(this->cmd_pool, queue, this->depth_image, depth_format, img_layout, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	this->vulkan_change_layout(this->depth_image, depth_format, img_layout, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 }
 
-void FirstVulkan::vulkan_create_buffer(VkDeviceSize size, VkBufferUsageFlags usage_flags, VkBuffer& buffer, VkMemoryPropertyFlags mem_flags, VkDeviceMemory& device_mem)
+void FirstVulkan::vulkan_create_buffer(VkDeviceSize size, VkBufferUsageFlags usage_flags, VkBuffer& buffer, VkMemoryPropertyFlags mem_flags, allocation_t& allocation, MemoryAllocator::strategy_t strategy)
 {
 	VkBufferCreateInfo buffer_info = {};
 	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -943,103 +1794,288 @@ void FirstVulkan::vulkan_create_buffer(VkDeviceSize size, VkBufferUsageFlags usa
 	VkResult result = vkCreateBuffer(this->device, &buffer_info, nullptr, &buffer);
 	ASSERT_VULKAN(result);
 
-	VkMemoryRequirements mem_requierements = {};
-	vkGetBufferMemoryRequirements(this->device, buffer, &mem_requierements);
-
-	VkMemoryAllocateInfo mem_alloc_info = {};
-	mem_alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	mem_alloc_info.pNext = nullptr;
-	mem_alloc_info.allocationSize = mem_requierements.size;
-	mem_alloc_info.memoryTypeIndex = this->vulkan_find_mem_type_index(mem_requierements.memoryTypeBits, mem_flags);
+	// sub-allocate memory for the buffer and connect it with the buffer
+	allocation = this->allocator.allocate_buffer(buffer, mem_flags, strategy);
+}
 
-	// allocate actual memory for buffer
-	result = vkAllocateMemory(this->device, &mem_alloc_info, nullptr, &device_mem);
-	ASSERT_VULKAN(result);
+void FirstVulkan::vulkan_destroy_buffer(VkBuffer buffer, allocation_t& allocation)
+{
+	vkDestroyBuffer(this->device, buffer, nullptr);
+	this->allocator.free(allocation);
+}
 
-	// connect memory with our vertex buffer
-	vkBindBufferMemory(this->device, buffer, device_mem, 0);
+void FirstVulkan::vulkan_copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize src_offset)
+{
+	// recorded into the upload batch, the copy is executed when the batch is submitted
+	this->upload_batch.copy_buffer(src, dst, size, src_offset);
 }
 
-void FirstVulkan::vulkan_copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size)
+void FirstVulkan::vulkan_create_vertex_buffer(void)
 {
-	// command buffer for copy operation
-	VkCommandBufferAllocateInfo cmd_buffer_info = {};
-	cmd_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cmd_buffer_info.pNext = nullptr;
-	cmd_buffer_info.commandPool = this->cmd_pool;
-	cmd_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	cmd_buffer_info.commandBufferCount = 1;
+	/* Scene files are copied by the GPU out of the imported mapping if the device supports it, otherwise
+	   straight out of the mapping into staging memory. Nothing is copied into the heap in between. */
+	VkDeviceSize vertex_size = this->get_vertex_count() * sizeof(vertex_t);
+	if (!this->scene.is_loaded() || !this->import_and_upload_buffer(this->get_vertex_data(), vertex_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, this->vertex_buffer, this->vertex_buffer_memory))
+		this->create_and_upload_buffer<vertex_t>(this->get_vertex_data(), this->get_vertex_count(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, this->vertex_buffer, this->vertex_buffer_memory);
+	if (!this->scene.is_loaded() || !this->import_and_upload_buffer(this->get_index_data(), this->get_index_data_size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, this->index_buffer, this->index_buffer_memory))
+		this->create_and_upload_buffer<uint8_t>(this->get_index_data(), this->get_index_data_size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, this->index_buffer, this->index_buffer_memory);
+}
 
-	VkCommandBuffer cmd_buffer = {};
-	VkResult result = vkAllocateCommandBuffers(this->device, &cmd_buffer_info, &cmd_buffer);
-	ASSERT_VULKAN(result);
+bool FirstVulkan::import_and_upload_buffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, allocation_t& mem)
+{
+	/* The imported range must start and end at multiples of minImportedHostPointerAlignment. The sections
+	   of scene files are page aligned and padded, the padding is imported with the data. */
+	VkDeviceSize alignment = this->host_import_alignment;
+	if (alignment == 0 || alignment > SceneFile::SECTION_ALIGNMENT || size == 0 || reinterpret_cast<uintptr_t>(data) % alignment != 0)
+		return false;
+	VkDeviceSize import_size = (size + alignment - 1) / alignment * alignment;
+
+	VkMemoryHostPointerPropertiesEXT pointer_properties = {};
+	pointer_properties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+	pointer_properties.pNext = nullptr;
+	VkResult result = this->get_memory_host_pointer_properties(this->device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, data, &pointer_properties);
+	if (result != VK_SUCCESS || pointer_properties.memoryTypeBits == 0)
+		return false;
+
+	VkExternalMemoryBufferCreateInfo external_info = {};
+	external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+	external_info.pNext = nullptr;
+	external_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
 
-	// begin info for copy operation
-	VkCommandBufferBeginInfo begin_info = {};
-	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	begin_info.pNext = nullptr;
-	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;	// one-time usage of the command buffer
-	begin_info.pInheritanceInfo = nullptr;
+	VkBufferCreateInfo buffer_info = {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.pNext = &external_info;
+	buffer_info.flags = 0;
+	buffer_info.size = import_size;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	buffer_info.queueFamilyIndexCount = 0;
+	buffer_info.pQueueFamilyIndices = nullptr;
 
-	// begin recording copy operation
-	result = vkBeginCommandBuffer(cmd_buffer, &begin_info);
+	host_import_t import = {};
+	result = vkCreateBuffer(this->device, &buffer_info, nullptr, &import.buffer);
 	ASSERT_VULKAN(result);
 
-	// copy information
-	VkBufferCopy buffer_copy = {};
-	buffer_copy.srcOffset = 0;
-	buffer_copy.dstOffset = 0;
-	buffer_copy.size = size;
-	
-	vkCmdCopyBuffer(cmd_buffer, src, dst, 1, &buffer_copy);
-
-	result = vkEndCommandBuffer(cmd_buffer);
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(this->device, import.buffer, &requirements);
+	uint32_t memory_types = requirements.memoryTypeBits & pointer_properties.memoryTypeBits;
+	uint32_t memory_type = 0;
+	while (memory_type < 32 && !(memory_types & (1u << memory_type)))
+		memory_type++;
+
+	// the pointer is only read, but the import takes a non-const pointer
+	VkImportMemoryHostPointerInfoEXT import_info = {};
+	import_info.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+	import_info.pNext = nullptr;
+	import_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	import_info.pHostPointer = const_cast<void*>(data);
+
+	VkMemoryAllocateInfo allocate_info = {};
+	allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocate_info.pNext = &import_info;
+	allocate_info.allocationSize = import_size;
+	allocate_info.memoryTypeIndex = memory_type;
+
+	// drivers may refuse file mappings, the data is staged then
+	if (memory_types == 0 || vkAllocateMemory(this->device, &allocate_info, nullptr, &import.memory) != VK_SUCCESS)
+	{
+		vkDestroyBuffer(this->device, import.buffer, nullptr);
+		return false;
+	}
+	result = vkBindBufferMemory(this->device, import.buffer, import.memory, 0);
 	ASSERT_VULKAN(result);
+	this->host_imports.push_back(import);
 
-	// submit copy command (actually the command buffer) to the command queue
-	VkSubmitInfo submit_info = {};
-	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.pNext = nullptr;
-	submit_info.waitSemaphoreCount = 0;
-	submit_info.pWaitSemaphores = nullptr;
-	submit_info.pWaitDstStageMask = nullptr;
-	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &cmd_buffer;
-	submit_info.signalSemaphoreCount = 0;
-	submit_info.pSignalSemaphores = nullptr;
+	this->vulkan_create_buffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mem);
+	this->vulkan_copy_buffer(import.buffer, buffer, size, 0);
 
-	result = vkQueueSubmit(this->queue, 1, &submit_info, VK_NULL_HANDLE);
-	ASSERT_VULKAN(result);
+	VkAccessFlags dst_access = 0;
+	if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)	dst_access |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)	dst_access |= VK_ACCESS_INDEX_READ_BIT;
+	this->upload_batch.transfer_ownership(buffer, dst_access, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	return true;
+}
 
-	// wait for command to be submitted
-	vkQueueWaitIdle(queue);
+void FirstVulkan::add_draw(const uint32_t* indices, size_t count, uint32_t first_vertex, uint32_t n_vertices, uint32_t material)
+{
+	// primitive restart is disabled, so the whole 16 bit range can be used
+	draw_t draw = {};
+	draw.index_type = (n_vertices <= 65536) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	draw.index_count = static_cast<uint32_t>(count);
+	draw.vertex_offset = static_cast<int32_t>(first_vertex);
+	draw.material = material;
+
+	// bind offsets must be a multiple of the index size, 4 bytes fit both widths
+	size_t index_size = (draw.index_type == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t);
+	draw.index_offset = (this->index_data.size() + 3) & ~static_cast<size_t>(3);
+	this->index_data.resize(draw.index_offset + count * index_size);
+
+	uint8_t* dst = this->index_data.data() + draw.index_offset;
+	if (draw.index_type == VK_INDEX_TYPE_UINT16)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			uint16_t index = static_cast<uint16_t>(indices[i]);
+			memcpy(dst + i * sizeof(uint16_t), &index, sizeof(uint16_t));
+		}
+	}
+	else
+		memcpy(dst, indices, count * sizeof(uint32_t));
+	this->draws.push_back(draw);
+}
 
-	// free command buffer
-	vkFreeCommandBuffers(this->device, this->cmd_pool, 1, &cmd_buffer);
+void FirstVulkan::vulkan_create_uniform_buffer(void)
+{
+	// dynamic offsets must be a multiple of minUniformBufferOffsetAlignment
+	VkPhysicalDeviceProperties device_properties = {};
+	vkGetPhysicalDeviceProperties(this->physical_devices[0], &device_properties);
+	this->uniform_alignment = device_properties.limits.minUniformBufferOffsetAlignment;
+	if (this->uniform_alignment == 0)
+		this->uniform_alignment = 1;
+
+	// one slot for every frame in flight, the GPU never reads a slot the CPU is writing to
+	this->uniform_slot_size = (UNIFORM_SLOT_SIZE + this->uniform_alignment - 1) / this->uniform_alignment * this->uniform_alignment;
+	VkDeviceSize buff_size = this->uniform_slot_size * this->n_frames_in_flight;
+	// the streams live as long as the device, bump allocation doesn't round them up to a power of two like the buddy strategy
+	this->vulkan_create_buffer(buff_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, this->uniform_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->uniform_buffer_memory, MemoryAllocator::STRATEGY_LINEAR);
+
+	// host visible memory stays mapped for its whole lifetime
+	this->uniform_buffer_mapped = this->uniform_buffer_memory.mapped;
+	this->uniform_stream_begin_frame(0);
 }
 
-void FirstVulkan::vulkan_create_vertex_buffer(void)
+void FirstVulkan::vulkan_create_instance_buffer(void)
 {
-	// this can be done more optimized with creating and uploading multiple buffers at once
-	this->create_and_upload_buffer<vertex_t>(this->vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, this->vertex_buffer, this->vertex_buffer_memory);
-	this->create_and_upload_buffer<uint32_t>(this->indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, this->index_buffer, this->index_buffer_memory);
+	// one slot for every frame in flight like the uniform stream, the instances are written again every frame
+	VkPhysicalDeviceProperties device_properties = {};
+	vkGetPhysicalDeviceProperties(this->physical_devices[0], &device_properties);
+	VkDeviceSize storage_alignment = std::max<VkDeviceSize>(device_properties.limits.minStorageBufferOffsetAlignment, 1);
+
+	// the slots are read by the cull pass, their offsets must be aligned for storage buffer descriptors
+	this->instance_slot_size = (VkDeviceSize)this->settings.instance_count * sizeof(instance_t);
+	this->instance_slot_size = (this->instance_slot_size + storage_alignment - 1) / storage_alignment * storage_alignment;
+	VkDeviceSize buff_size = this->instance_slot_size * this->n_frames_in_flight;
+	// bump allocated like the uniform stream, the culled instances and indirect draws as well
+	this->vulkan_create_buffer(buff_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, this->instance_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->instance_buffer_memory, MemoryAllocator::STRATEGY_LINEAR);
+
+	// written and read by the GPU only
+	this->vulkan_create_buffer(buff_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, this->culled_instance_buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->culled_instance_buffer_memory, MemoryAllocator::STRATEGY_LINEAR);
+	this->indirect_slot_size = this->draws.size() * sizeof(VkDrawIndexedIndirectCommand);
+	this->indirect_slot_size = (std::max<VkDeviceSize>(this->indirect_slot_size, 4) + storage_alignment - 1) / storage_alignment * storage_alignment;
+	this->vulkan_create_buffer(this->indirect_slot_size * this->n_frames_in_flight, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		this->indirect_buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->indirect_buffer_memory, MemoryAllocator::STRATEGY_LINEAR);
+
+	// the draws are put into slots, 16 bit draws first, so every index type is one range of slots
+	this->draw_slots.clear();
+	this->draw_ranges.clear();
+	const VkIndexType index_types[] = { VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32 };
+	for (VkIndexType index_type : index_types)
+	{
+		draw_range_t range;
+		range.index_type = index_type;
+		range.first_slot = static_cast<uint32_t>(this->draw_slots.size());
+		for (size_t i = 0; i < this->draws.size(); i++)
+		{
+			if (this->draws[i].index_type == index_type)
+				this->draw_slots.push_back(static_cast<uint32_t>(i));
+		}
+		range.n_slots = static_cast<uint32_t>(this->draw_slots.size()) - range.first_slot;
+		if (range.n_slots > 0)
+			this->draw_ranges.push_back(range);
+	}
+
+	// the draws never change, the template is written once and copied into the frame's slot before the cull pass
+	this->vulkan_create_buffer(this->indirect_slot_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, this->indirect_template_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->indirect_template_memory, MemoryAllocator::STRATEGY_LINEAR);
+	VkDrawIndexedIndirectCommand* commands = reinterpret_cast<VkDrawIndexedIndirectCommand*>(this->indirect_template_memory.mapped);
+	for (size_t slot = 0; slot < this->draw_slots.size(); slot++)
+	{
+		const draw_t& draw = this->draws[this->draw_slots[slot]];
+		commands[slot].indexCount = draw.index_count;
+		commands[slot].instanceCount = 0;
+		commands[slot].firstIndex = this->get_draw_first_index(draw);		// the range binds the index buffer at 0
+		commands[slot].vertexOffset = draw.vertex_offset;
+		commands[slot].firstInstance = 0;
+	}
+
+	// bindless.vert reads the texture of its draw slot, the materials never change either
+	if (this->bindless_textures)
+	{
+		VkDeviceSize draw_texture_size = std::max<VkDeviceSize>(this->draw_slots.size(), 1) * sizeof(uint32_t);
+		this->vulkan_create_buffer(draw_texture_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, this->draw_texture_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->draw_texture_memory, MemoryAllocator::STRATEGY_LINEAR);
+		uint32_t* draw_textures = reinterpret_cast<uint32_t*>(this->draw_texture_memory.mapped);
+		for (size_t slot = 0; slot < this->draw_slots.size(); slot++)
+			draw_textures[slot] = this->get_draw_texture(this->draws[this->draw_slots[slot]]);
+	}
 }
 
-void FirstVulkan::vulkan_create_uniform_buffer(void)
+void FirstVulkan::vulkan_create_cull_descriptor_sets(void)
 {
-	VkDeviceSize buff_size = sizeof(this->MVP);
-	this->vulkan_create_buffer(buff_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, this->uniform_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->uniform_buffer_memory);
+	VkDescriptorPoolSize pool_size = {};
+	pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_size.descriptorCount = 3 * this->n_frames_in_flight;
+
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.pNext = nullptr;
+	pool_info.flags = 0;
+	pool_info.maxSets = this->n_frames_in_flight;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+
+	VkResult result = vkCreateDescriptorPool(this->device, &pool_info, nullptr, &this->cull_descriptor_pool);
+	ASSERT_VULKAN(result);
+
+	// every frame in flight culls into its own slots, the sets are written once
+	for (uint32_t i = 0; i < this->n_frames_in_flight; i++)
+	{
+		VkDescriptorSetAllocateInfo set_alloc_info = {};
+		set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		set_alloc_info.pNext = nullptr;
+		set_alloc_info.descriptorPool = this->cull_descriptor_pool;
+		set_alloc_info.descriptorSetCount = 1;
+		set_alloc_info.pSetLayouts = &this->cull_descriptor_set_layout;
+
+		result = vkAllocateDescriptorSets(this->device, &set_alloc_info, &this->frames[i].cull_descriptor_set);
+		ASSERT_VULKAN(result);
+
+		VkDescriptorBufferInfo buffer_infos[3] = {};
+		buffer_infos[0].buffer = this->instance_buffer;
+		buffer_infos[0].offset = i * this->instance_slot_size;
+		buffer_infos[0].range = this->instance_slot_size;
+		buffer_infos[1].buffer = this->culled_instance_buffer;
+		buffer_infos[1].offset = i * this->instance_slot_size;
+		buffer_infos[1].range = this->instance_slot_size;
+		buffer_infos[2].buffer = this->indirect_buffer;
+		buffer_infos[2].offset = i * this->indirect_slot_size;
+		buffer_infos[2].range = this->indirect_slot_size;
+
+		VkWriteDescriptorSet writes[3] = {};
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[j].pNext = nullptr;
+			writes[j].dstSet = this->frames[i].cull_descriptor_set;
+			writes[j].dstBinding = j;
+			writes[j].dstArrayElement = 0;
+			writes[j].descriptorCount = 1;
+			writes[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[j].pImageInfo = nullptr;
+			writes[j].pBufferInfo = &buffer_infos[j];
+			writes[j].pTexelBufferView = nullptr;
+		}
+		vkUpdateDescriptorSets(this->device, 3, writes, 0, nullptr);
+	}
 }
 
 void FirstVulkan::vulkan_create_descriptor_pool(void)
 {
 	VkDescriptorPoolSize uniform_pool_size = {};
-	uniform_pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uniform_pool_size.descriptorCount = 1;
+	uniform_pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	uniform_pool_size.descriptorCount = this->n_frames_in_flight;
 
 	VkDescriptorPoolSize sampler_pool_size = {};
 	sampler_pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	sampler_pool_size.descriptorCount = 1;
+	sampler_pool_size.descriptorCount = this->n_frames_in_flight;
 
 	std::vector<VkDescriptorPoolSize> descriptor_pool_sizes = {
 		uniform_pool_size,
@@ -1050,183 +2086,361 @@ void FirstVulkan::vulkan_create_descriptor_pool(void)
 	descr_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descr_pool_info.pNext = nullptr;
 	descr_pool_info.flags = 0;
-	descr_pool_info.maxSets = 1;
+	descr_pool_info.maxSets = this->n_frames_in_flight;		// one set per frame in flight
 	descr_pool_info.poolSizeCount = descriptor_pool_sizes.size();
 	descr_pool_info.pPoolSizes = descriptor_pool_sizes.data();
 
 	VkResult result = vkCreateDescriptorPool(this->device, &descr_pool_info, nullptr, &this->descriptor_pool);
 	ASSERT_VULKAN(result);
+
+	// sets of update-after-bind layouts need a pool of their own
+	this->bindless_descriptor_pool = VK_NULL_HANDLE;
+	if (!this->bindless_textures)
+		return;
+
+	VkDescriptorPoolSize bindless_pool_sizes[2] = {};
+	bindless_pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindless_pool_sizes[0].descriptorCount = MAX_BINDLESS_TEXTURES * this->n_frames_in_flight;
+	bindless_pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindless_pool_sizes[1].descriptorCount = this->n_frames_in_flight;
+
+	VkDescriptorPoolCreateInfo bindless_pool_info = {};
+	bindless_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	bindless_pool_info.pNext = nullptr;
+	bindless_pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	bindless_pool_info.maxSets = this->n_frames_in_flight;
+	bindless_pool_info.poolSizeCount = 2;
+	bindless_pool_info.pPoolSizes = bindless_pool_sizes;
+
+	result = vkCreateDescriptorPool(this->device, &bindless_pool_info, nullptr, &this->bindless_descriptor_pool);
+	ASSERT_VULKAN(result);
 }
 
 void FirstVulkan::vulkan_create_descriptor_set(void)
 {
+	// every frame in flight owns a set, texture views are swapped in a set when its frame begins
+	VkDescriptorSetLayout layouts[this->n_frames_in_flight];
+	VkDescriptorSet sets[this->n_frames_in_flight];
+	for (uint32_t i = 0; i < this->n_frames_in_flight; i++)
+		layouts[i] = this->descriptor_set_layout;
+
 	VkDescriptorSetAllocateInfo descr_set_alloc_info = {};
 	descr_set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	descr_set_alloc_info.pNext = nullptr;
 	descr_set_alloc_info.descriptorPool = this->descriptor_pool;
-	descr_set_alloc_info.descriptorSetCount = 1;
-	descr_set_alloc_info.pSetLayouts = &this->descriptor_set_layout;
+	descr_set_alloc_info.descriptorSetCount = this->n_frames_in_flight;
+	descr_set_alloc_info.pSetLayouts = layouts;
 
-	VkResult result = vkAllocateDescriptorSets(this->device, &descr_set_alloc_info, &this->descriptor_set);
+	VkResult result = vkAllocateDescriptorSets(this->device, &descr_set_alloc_info, sets);
 	ASSERT_VULKAN(result);
 
 	// descriptor info for uniform buffer
 	VkDescriptorBufferInfo descr_buffer_info = {};
 	descr_buffer_info.buffer = this->uniform_buffer;
-	descr_buffer_info.offset = 0;
-	descr_buffer_info.range = sizeof(MVP);
-
-	VkWriteDescriptorSet write_uniform_set = {};
-	write_uniform_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	write_uniform_set.pNext = nullptr;
-	write_uniform_set.dstSet = this->descriptor_set;
-	write_uniform_set.dstBinding = 0;
-	write_uniform_set.dstArrayElement = 0;
-	write_uniform_set.descriptorCount = 1;
-	write_uniform_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	write_uniform_set.pImageInfo = nullptr;
-	write_uniform_set.pBufferInfo = &descr_buffer_info;
-	write_uniform_set.pTexelBufferView = nullptr;
-
-	// descriptor info for texture sampler (texture1)
-	VkDescriptorImageInfo descr_image_info = {};
-	descr_image_info.sampler = this->texture1_sampler;
-	descr_image_info.imageView = this->texture1_view;
-	descr_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	descr_buffer_info.offset = 0;					// the actual offset is passed as dynamic offset when binding
+	descr_buffer_info.range = sizeof(scene_uniforms_t);
 
-	VkWriteDescriptorSet write_sampler_set = {};
-	write_sampler_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	write_sampler_set.pNext = nullptr;
-	write_sampler_set.dstSet = this->descriptor_set;
-	write_sampler_set.dstBinding = 1;
-	write_sampler_set.dstArrayElement = 0;
-	write_sampler_set.descriptorCount = 1;
-	write_sampler_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	write_sampler_set.pImageInfo = &descr_image_info;
-	write_sampler_set.pBufferInfo = nullptr;
-	write_sampler_set.pTexelBufferView = nullptr;
-
-	std::vector<VkWriteDescriptorSet> write_descr_sets = {
-		write_uniform_set,
-		write_sampler_set
-	};
-
-	vkUpdateDescriptorSets(this->device, write_descr_sets.size(), write_descr_sets.data(), 0, nullptr);
+	for (uint32_t i = 0; i < this->n_frames_in_flight; i++)
+	{
+		VkWriteDescriptorSet write_uniform_set = {};
+		write_uniform_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write_uniform_set.pNext = nullptr;
+		write_uniform_set.dstSet = sets[i];
+		write_uniform_set.dstBinding = 0;
+		write_uniform_set.dstArrayElement = 0;
+		write_uniform_set.descriptorCount = 1;
+		write_uniform_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		write_uniform_set.pImageInfo = nullptr;
+		write_uniform_set.pBufferInfo = &descr_buffer_info;
+		write_uniform_set.pTexelBufferView = nullptr;
+
+		vkUpdateDescriptorSets(this->device, 1, &write_uniform_set, 0, nullptr);
+
+		// descriptor info for texture sampler (first texture)
+		this->frames[i].descriptor_set = sets[i];
+		this->frames[i].bindless_descriptor_set = VK_NULL_HANDLE;
+		if (this->bindless_textures)
+		{
+			VkDescriptorSetAllocateInfo bindless_alloc_info = {};
+			bindless_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			bindless_alloc_info.pNext = nullptr;
+			bindless_alloc_info.descriptorPool = this->bindless_descriptor_pool;
+			bindless_alloc_info.descriptorSetCount = 1;
+			bindless_alloc_info.pSetLayouts = &this->bindless_descriptor_set_layout;
+
+			result = vkAllocateDescriptorSets(this->device, &bindless_alloc_info, &this->frames[i].bindless_descriptor_set);
+			ASSERT_VULKAN(result);
+
+			// the textures of the draw slots never change
+			VkDescriptorBufferInfo draw_texture_info = {};
+			draw_texture_info.buffer = this->draw_texture_buffer;
+			draw_texture_info.offset = 0;
+			draw_texture_info.range = VK_WHOLE_SIZE;
+
+			VkWriteDescriptorSet write_draw_textures = {};
+			write_draw_textures.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write_draw_textures.pNext = nullptr;
+			write_draw_textures.dstSet = this->frames[i].bindless_descriptor_set;
+			write_draw_textures.dstBinding = 1;
+			write_draw_textures.dstArrayElement = 0;
+			write_draw_textures.descriptorCount = 1;
+			write_draw_textures.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write_draw_textures.pImageInfo = nullptr;
+			write_draw_textures.pBufferInfo = &draw_texture_info;
+			write_draw_textures.pTexelBufferView = nullptr;
+
+			vkUpdateDescriptorSets(this->device, 1, &write_draw_textures, 0, nullptr);
+		}
+		this->frames[i].descriptor_version = this->texture_descriptor_version - 1;
+		this->vulkan_update_texture_descriptors(this->frames[i]);
+	}
 }
 
-void FirstVulkan::vulkan_record_command_buffers(void)
+void FirstVulkan::vulkan_record_command_buffer(VkCommandBuffer cmd_buffer, uint32_t image_index)
 {
 	// specifies how commands should be recorded (loaded into the buffer)
 	VkCommandBufferBeginInfo cmd_buffer_begin_info = {};
 	cmd_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	cmd_buffer_begin_info.pNext = nullptr;
-	cmd_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT; // allowes to have the same command multiple times in a queue
+	cmd_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // command buffer is recorded new every frame
 	cmd_buffer_begin_info.pInheritanceInfo = nullptr; // used for secondary command buffers
 
-	// start recording command buffers for every image in the swapchain or for every command buffer respectively
-	for (size_t i = 0; i < this->n_images_swapchain; i++)
-	{
-		VkResult result = vkBeginCommandBuffer(this->cmd_buffers[i], &cmd_buffer_begin_info);
-		ASSERT_VULKAN(result);
+	// start recording the command buffer of the current frame
+	VkResult result = vkBeginCommandBuffer(cmd_buffer, &cmd_buffer_begin_info);
+	ASSERT_VULKAN(result);
 
-		// specifies the begin of the render pass
-		VkRenderPassBeginInfo render_pass_begin_info = {};
-		render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		render_pass_begin_info.pNext = nullptr;
-		render_pass_begin_info.renderPass = this->renderpass;
-		render_pass_begin_info.framebuffer = this->fbos_swapchain[i];
-		render_pass_begin_info.renderArea.offset = { 0, 0 };			// render full screen (framebuffer) 
-		render_pass_begin_info.renderArea.extent = { width, height };
-
-		VkClearValue clear_color = { 0.0f, 0.0f, 0.0f, 1.0f };			// equivalent to glClearColor
-		VkClearValue depth_clear = { 1.0f, 0.0f };						// equivalent to glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT)
-
-		std::vector<VkClearValue> clear_values = {
-			clear_color,
-			depth_clear
-		};
+	// the queries of this frame slot are reset before the first scope
+	this->gpu_profiler.begin_frame(cmd_buffer, this->current_frame, this->frame_number);
+	this->gpu_profiler.begin_scope(cmd_buffer, this->gpu_scope_frame);
+
+	// specifies the begin of the render pass
+	VkRenderPassBeginInfo render_pass_begin_info = {};
+	render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	render_pass_begin_info.pNext = nullptr;
+	render_pass_begin_info.renderPass = this->renderpass;
+	render_pass_begin_info.framebuffer = this->fbos_swapchain[image_index];
+	render_pass_begin_info.renderArea.offset = { 0, 0 };			// render full screen (framebuffer) 
+	render_pass_begin_info.renderArea.extent = { width, height };
+
+	VkClearValue clear_color = { 0.0f, 0.0f, 0.0f, 1.0f };			// equivalent to glClearColor
+	VkClearValue depth_clear = { 1.0f, 0.0f };						// equivalent to glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT)
+
+	std::vector<VkClearValue> clear_values = {
+		clear_color,
+		depth_clear
+	};
+
+	render_pass_begin_info.clearValueCount = clear_values.size();
+	render_pass_begin_info.pClearValues = clear_values.data();
 
-		render_pass_begin_info.clearValueCount = clear_values.size();
-		render_pass_begin_info.pClearValues = clear_values.data();
+	// the cull pass writes the indirect draws of the render pass, it runs before the pass begins
+	if (this->gpu_culling)
+		this->vulkan_record_culling(cmd_buffer);
 
-		// start render pass												// we only use primary command buffers
-		vkCmdBeginRenderPass(this->cmd_buffers[i], &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	this->gpu_profiler.begin_statistics(cmd_buffer);
+	this->gpu_profiler.begin_scope(cmd_buffer, this->gpu_scope_renderpass);
 
-		// use our pipeline to render
-		vkCmdBindPipeline(this->cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline);
+	// start render pass, the draws are either recorded inline or executed from secondary command buffers
+	vkCmdBeginRenderPass(cmd_buffer, &render_pass_begin_info, this->parallel_recording ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+	if (this->parallel_recording)
+		this->vulkan_record_parallel(cmd_buffer, image_index);
+	else
+		this->vulkan_record_draws(cmd_buffer, 0, this->draws.size());
+	vkCmdEndRenderPass(cmd_buffer);
 
-		VkViewport viewport;
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = this->width;
-		viewport.height = this->height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		vkCmdSetViewport(this->cmd_buffers[i], 0, 1, &viewport);
+	this->gpu_profiler.end_scope(cmd_buffer, this->gpu_scope_renderpass);
+	this->gpu_profiler.end_statistics(cmd_buffer);
+	this->gpu_profiler.end_scope(cmd_buffer, this->gpu_scope_frame);
 
-		VkRect2D scissor;
-		scissor.offset = { 0, 0 };
-		scissor.extent = { this->width, this->height };
-		vkCmdSetScissor(this->cmd_buffers[i], 0, 1, &scissor);
+	result = vkEndCommandBuffer(cmd_buffer);
+	ASSERT_VULKAN(result);
+}
 
-		VkDeviceSize offsets[] = { 0 };
+void FirstVulkan::vulkan_record_draws(VkCommandBuffer cmd_buffer, size_t first_slot, size_t n_slots)
+{
+	// secondary command buffers don't inherit any state, every one binds everything again
 
-		// actual draw command
-		vkCmdBindVertexBuffers(this->cmd_buffers[i], 0, 1, &this->vertex_buffer, offsets);
-		vkCmdBindIndexBuffer(this->cmd_buffers[i], this->index_buffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdBindDescriptorSets(this->cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline_layout, 0, 1, &this->descriptor_set, 0, nullptr);
+	// use our pipeline to render
+	vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline);
 
-		//vkCmdDraw(this->cmd_buffers[i], this->vertices.size(), 1, 0, 0)
-		vkCmdDrawIndexed(this->cmd_buffers[i], this->indices.size(), 1, 0, 0, 0);
+	VkViewport viewport;
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = this->width;
+	viewport.height = this->height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
 
-		vkCmdEndRenderPass(this->cmd_buffers[i]);
+	VkRect2D scissor;
+	scissor.offset = { 0, 0 };
+	scissor.extent = { this->width, this->height };
+	vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+	// the culled instances lie in the same slot of their own buffer
+	VkBuffer vertex_buffers[] = { this->vertex_buffer, this->gpu_culling ? this->culled_instance_buffer : this->instance_buffer };
+	VkDeviceSize offsets[] = { 0, this->current_frame * this->instance_slot_size };
+
+	// actual draw command
+	vkCmdBindVertexBuffers(cmd_buffer, 0, 2, vertex_buffers, offsets);
+	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline_layout, 0, 1, &this->frames[this->current_frame].descriptor_set, 1, &this->mvp_offset);
+	if (this->bindless_textures)
+		vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline_layout, 1, 1, &this->frames[this->current_frame].bindless_descriptor_set, 0, nullptr);
+
+	//vkCmdDraw(cmd_buffer, this->vertices.size(), 1, 0, 0)
+	/* A range of slots binds the index buffer once, its draws find their indices with the first index. With
+	   GPU culling and multi-draw indirect the range is drawn with one call (split at maxDrawIndirectCount),
+	   otherwise every draw is a call of its own. bindless.vert adds gl_DrawID to the pushed first slot. */
+	VkDeviceSize indirect_offset = this->current_frame * this->indirect_slot_size;
+	size_t max_call_slots = (this->gpu_culling && this->multi_draw_indirect) ? this->max_draw_indirect_count : 1;
+	for (const draw_range_t& range : this->draw_ranges)
+	{
+		size_t begin = std::max<size_t>(first_slot, range.first_slot);
+		size_t end = std::min<size_t>(first_slot + n_slots, range.first_slot + range.n_slots);
+		if (begin >= end)
+			continue;
 
-		result = vkEndCommandBuffer(this->cmd_buffers[i]);
-		ASSERT_VULKAN(result);
+		vkCmdBindIndexBuffer(cmd_buffer, this->index_buffer, 0, range.index_type);
+		for (size_t slot = begin; slot < end; slot += max_call_slots)
+		{
+			uint32_t n_call_slots = static_cast<uint32_t>(std::min(max_call_slots, end - slot));
+			if (this->bindless_textures)
+			{
+				uint32_t call_first_slot = static_cast<uint32_t>(slot);
+				vkCmdPushConstants(cmd_buffer, this->pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &call_first_slot);
+			}
+			if (this->gpu_culling)
+				vkCmdDrawIndexedIndirect(cmd_buffer, this->indirect_buffer, indirect_offset + slot * sizeof(VkDrawIndexedIndirectCommand), n_call_slots, sizeof(VkDrawIndexedIndirectCommand));
+			else
+			{
+				const draw_t& draw = this->draws[this->draw_slots[slot]];
+				vkCmdDrawIndexed(cmd_buffer, draw.index_count, this->visible_instance_count, this->get_draw_first_index(draw), draw.vertex_offset, 0);
+			}
+		}
 	}
 }
 
-void FirstVulkan::vulkan_change_layout(VkCommandPool cmd_pool, VkQueue queue, VkImage img, VkFormat format, VkImageLayout& old_layout, VkImageLayout new_layout)
+void FirstVulkan::vulkan_record_culling(VkCommandBuffer cmd_buffer)
 {
-	VkCommandBufferAllocateInfo cmd_buff_info = {};
-	cmd_buff_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cmd_buff_info.pNext = nullptr;
-	cmd_buff_info.commandPool = cmd_pool;
-	cmd_buff_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	cmd_buff_info.commandBufferCount = 1; 
+	// the scope covers the copy of the template and the barriers, everything the GPU path adds to the frame
+	this->gpu_profiler.begin_scope(cmd_buffer, this->gpu_scope_cull);
+
+	// the draws of the frame start without instances, the cull pass counts the visible ones
+	VkDeviceSize indirect_offset = this->current_frame * this->indirect_slot_size;
+	VkBufferCopy copy_region = {};
+	copy_region.srcOffset = 0;
+	copy_region.dstOffset = indirect_offset;
+	copy_region.size = this->indirect_slot_size;
+	vkCmdCopyBuffer(cmd_buffer, this->indirect_template_buffer, this->indirect_buffer, 1, &copy_region);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cull_pipeline);
+	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cull_pipeline_layout, 0, 1, &this->frames[this->current_frame].cull_descriptor_set, 0, nullptr);
+	vkCmdPushConstants(cmd_buffer, this->cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cull_constants_t), &this->cull_constants);
+	vkCmdDispatch(cmd_buffer, (this->settings.instance_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// the draws read the counts as indirect parameters and the culled instances as vertex attributes
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	this->gpu_profiler.end_scope(cmd_buffer, this->gpu_scope_cull);
+}
 
-	VkCommandBuffer tmp_cmd_buffer = {};
-	VkResult result = vkAllocateCommandBuffers(this->device, &cmd_buff_info, &tmp_cmd_buffer);
-	ASSERT_VULKAN(result);
+void FirstVulkan::vulkan_record_secondary(recorder_t& recorder, uint32_t image_index, size_t first_slot, size_t n_slots)
+{
+	// the secondary command buffer continues the render pass of the primary one
+	VkCommandBufferInheritanceInfo inheritance_info = {};
+	inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance_info.pNext = nullptr;
+	inheritance_info.renderPass = this->renderpass;
+	inheritance_info.subpass = 0;
+	inheritance_info.framebuffer = this->fbos_swapchain[image_index];
+	inheritance_info.occlusionQueryEnable = VK_FALSE;
+	inheritance_info.queryFlags = 0;
+	inheritance_info.pipelineStatistics = this->gpu_profiler.has_statistics() ? GpuProfiler::STATISTIC_FLAGS : 0;
 
-	VkCommandBufferBeginInfo cmd_buff_begin_info = {};
-	cmd_buff_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	cmd_buff_begin_info.pNext = nullptr;
-	cmd_buff_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-	cmd_buff_begin_info.pInheritanceInfo = nullptr;
+	VkCommandBufferBeginInfo cmd_buffer_begin_info = {};
+	cmd_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmd_buffer_begin_info.pNext = nullptr;
+	cmd_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	cmd_buffer_begin_info.pInheritanceInfo = &inheritance_info;
 
-	result = vkBeginCommandBuffer(tmp_cmd_buffer, &cmd_buff_begin_info);
+	VkResult result = vkBeginCommandBuffer(recorder.cmd_buffer, &cmd_buffer_begin_info);
+	ASSERT_VULKAN(result);
+	this->vulkan_record_draws(recorder.cmd_buffer, first_slot, n_slots);
+	result = vkEndCommandBuffer(recorder.cmd_buffer);
 	ASSERT_VULKAN(result);
+}
+
+void FirstVulkan::vulkan_record_parallel(VkCommandBuffer cmd_buffer, uint32_t image_index)
+{
+	/* The draw slots are split into contiguous slices, one per recorder, every slice goes into the
+	   secondary command buffer of its recorder. The workers of the thread pool record all slices
+	   but the first, which is recorded by this thread in the meantime. The slices are executed in
+	   order, the result is the same as recording inline. */
+	std::vector<recorder_t>& recorders = this->frames[this->current_frame].recorders;
+	size_t n_draws = this->draws.size();
+	size_t n_slices = std::max<size_t>(std::min(recorders.size(), (n_draws + MIN_DRAWS_PER_SLICE - 1) / MIN_DRAWS_PER_SLICE), 1);
+	size_t slice_size = (n_draws + n_slices - 1) / n_slices;
+
+	std::vector<std::future<void>> slices;
+	slices.reserve(n_slices - 1);
+	for (size_t i = 1; i < n_slices; i++)
+	{
+		recorder_t* recorder = &recorders[i];
+		size_t first_draw = std::min(i * slice_size, n_draws);
+		size_t count = std::min(slice_size, n_draws - first_draw);
+		slices.push_back(this->thread_pool.submit([this, recorder, image_index, first_draw, count](void) {
+			this->vulkan_record_secondary(*recorder, image_index, first_draw, count);
+		}));
+	}
+	this->vulkan_record_secondary(recorders[0], image_index, 0, std::min(slice_size, n_draws));
+
+	VkCommandBuffer secondary_buffers[n_slices];
+	secondary_buffers[0] = recorders[0].cmd_buffer;
+	for (size_t i = 1; i < n_slices; i++)
+	{
+		slices[i - 1].get();
+		secondary_buffers[i] = recorders[i].cmd_buffer;
+	}
+	vkCmdExecuteCommands(cmd_buffer, static_cast<uint32_t>(n_slices), secondary_buffers);
+}
 
+void FirstVulkan::vulkan_change_layout(VkImage img, VkFormat format, VkImageLayout& old_layout, VkImageLayout new_layout, uint32_t mip_levels)
+{
 	// image memory barrier needed that no other queue can read from that memory while another queue is changing something
 	VkImageMemoryBarrier mem_barrier = {};
 	mem_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	mem_barrier.pNext = nullptr;
 
+	VkPipelineStageFlags src_stage, dst_stage;
 	if (old_layout == VK_IMAGE_LAYOUT_PREINITIALIZED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
 	{
 		mem_barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
 		mem_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		src_stage = VK_PIPELINE_STAGE_HOST_BIT;
+		dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 	}
 	else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
 	{
 		mem_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 		mem_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 	}
 	else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
 	{
 		mem_barrier.srcAccessMask = 0;
 		mem_barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		dst_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	}
 	else
 	{
@@ -1238,7 +2452,7 @@ void FirstVulkan::vulkan_change_layout(VkCommandPool cmd_pool, VkQueue queue, Vk
 	mem_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	mem_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	mem_barrier.image = img;
-	if (new_layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
+	if (new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
 	{
 		mem_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
 		if (this->vulkan_is_stencil_format(format))
@@ -1249,92 +2463,25 @@ void FirstVulkan::vulkan_change_layout(VkCommandPool cmd_pool, VkQueue queue, Vk
 		mem_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	}
 	mem_barrier.subresourceRange.baseMipLevel = 0;
-	mem_barrier.subresourceRange.levelCount = 1;
+	mem_barrier.subresourceRange.levelCount = mip_levels;
 	mem_barrier.subresourceRange.baseArrayLayer = 0;
 	mem_barrier.subresourceRange.layerCount = 1;
 
-	if (old_layout == VK_IMAGE_LAYOUT_PREINITIALIZED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-		vkCmdPipelineBarrier(tmp_cmd_buffer, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mem_barrier);
-	else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-		vkCmdPipelineBarrier(tmp_cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &mem_barrier);
-
-	result = vkEndCommandBuffer(tmp_cmd_buffer);
-	ASSERT_VULKAN(result);
-
-	VkSubmitInfo submit_info = {};
-	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.pNext = nullptr;
-	submit_info.waitSemaphoreCount = 0;
-	submit_info.pWaitSemaphores = nullptr;
-	submit_info.pWaitDstStageMask = nullptr;
-	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &tmp_cmd_buffer;
-	submit_info.signalSemaphoreCount = 0;
-	submit_info.pSignalSemaphores = nullptr;
-
-	result = vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
-	ASSERT_VULKAN(result);
-	vkQueueWaitIdle(queue);
-
-	vkFreeCommandBuffers(this->device, cmd_pool, 1, &tmp_cmd_buffer);
-
+	/* Recorded into the upload batch, the transition is executed when the batch is submitted.
+	   The transition after the copies hands the image over to the graphics queue, depth images
+	   are never touched by the transfer queue and are transitioned on the graphics queue. */
+	if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+		this->upload_batch.transfer_ownership(mem_barrier, dst_stage);
+	else if (new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+		this->upload_batch.dst_image_barrier(mem_barrier, src_stage, dst_stage);
+	else
+		this->upload_batch.image_barrier(mem_barrier, src_stage, dst_stage);
 	old_layout = new_layout;
 }
 
-void FirstVulkan::vulkan_write_buffer_to_image(VkCommandPool cmd_pool, VkQueue queue, VkBuffer buff, int w, int h)
+void FirstVulkan::vulkan_write_buffer_to_image(VkBuffer buff, VkImage img, int w, int h, VkDeviceSize src_offset, uint32_t mip_level)
 {
-	VkCommandBufferAllocateInfo cmd_buff_info = {};
-	cmd_buff_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cmd_buff_info.pNext = nullptr;
-	cmd_buff_info.commandPool = cmd_pool;
-	cmd_buff_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	cmd_buff_info.commandBufferCount = 1;
-
-	VkCommandBuffer tmp_cmd_buffer = {};
-	VkResult result = vkAllocateCommandBuffers(this->device, &cmd_buff_info, &tmp_cmd_buffer);
-	ASSERT_VULKAN(result);
-
-	VkCommandBufferBeginInfo cmd_buff_begin_info = {};
-	cmd_buff_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	cmd_buff_begin_info.pNext = nullptr;
-	cmd_buff_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-	cmd_buff_begin_info.pInheritanceInfo = nullptr;
-
-	result = vkBeginCommandBuffer(tmp_cmd_buffer, &cmd_buff_begin_info);
-	ASSERT_VULKAN(result);
-
-	VkBufferImageCopy buff_img_cpy = {};
-	buff_img_cpy.bufferOffset = 0;
-	buff_img_cpy.bufferRowLength = 0;
-	buff_img_cpy.bufferImageHeight = 0;
-	buff_img_cpy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	buff_img_cpy.imageSubresource.mipLevel = 0;
-	buff_img_cpy.imageSubresource.baseArrayLayer = 0;
-	buff_img_cpy.imageSubresource.layerCount = 1;
-	buff_img_cpy.imageOffset = { 0, 0, 0 };
-	buff_img_cpy.imageExtent = { (uint32_t)w, (uint32_t)h, 1};
-
-	vkCmdCopyBufferToImage(tmp_cmd_buffer, buff, this->texture1_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buff_img_cpy);
-
-	result = vkEndCommandBuffer(tmp_cmd_buffer);
-	ASSERT_VULKAN(result);
-
-	VkSubmitInfo submit_info = {};
-	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.pNext = nullptr;
-	submit_info.waitSemaphoreCount = 0;
-	submit_info.pWaitSemaphores = nullptr;
-	submit_info.pWaitDstStageMask = nullptr;
-	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &tmp_cmd_buffer;
-	submit_info.signalSemaphoreCount = 0;
-	submit_info.pSignalSemaphores = nullptr;
-
-	result = vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
-	ASSERT_VULKAN(result);
-	vkQueueWaitIdle(queue);
-
-	vkFreeCommandBuffers(this->device, cmd_pool, 1, &tmp_cmd_buffer);
+	this->upload_batch.copy_buffer_to_image(buff, img, (uint32_t)w, (uint32_t)h, src_offset, mip_level);
 }
 
 bool FirstVulkan::vulkan_is_format_supported(VkPhysicalDevice device, VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags flags)
@@ -1369,34 +2516,174 @@ VkFormat FirstVulkan::vulkan_find_depth_format(VkPhysicalDevice physical_device)
 
 bool FirstVulkan::vulkan_is_stencil_format(VkFormat format)
 {
-	return (format == VK_FORMAT_D32_SFLOAT_S8_UINT || VK_FORMAT_D24_UNORM_S8_UINT);
+	return (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT);
+}
+
+void FirstVulkan::load_mesh(const std::string& path)
+{
+	Mesh mesh;
+	if (!mesh.load_obj(path))
+		throw std::runtime_error("Unable to load mesh " + path + "!");
+
+	/* vertex_t has no normal, corners of faceted meshes that only differ in their normal are welded too.
+	   The index order is optimized for the vertex cache first, the vertex order follows the index order. */
+	size_t n_corners = mesh.get_vertices().size();
+	mesh.clear_normals();
+	mesh.weld();
+	Mesh::statistics_t before = mesh.analyze_vertex_cache();
+	mesh.optimize_vertex_cache();
+	if (this->settings.optimize_overdraw)
+		mesh.optimize_overdraw();
+	mesh.optimize_vertex_fetch();
+	Mesh::statistics_t after = mesh.analyze_vertex_cache();
+	std::cout << "Mesh " << path << ": " << mesh.get_vertices().size() << " vertices (" << n_corners << " before welding), " << mesh.get_triangle_count() << " triangles, "
+		<< "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+
+	// OBJ files have no vertex colors, the texture is shown as it is
+	std::vector<unpacked_vertex_t> unpacked;
+	unpacked.reserve(mesh.get_vertices().size());
+	for (const Mesh::vertex_t& vertex : mesh.get_vertices())
+		unpacked.push_back({ vertex.pos, glm::vec4(1.0f), vertex.uv_coord });
+	this->quantize_vertices(unpacked);
+	this->indices = mesh.get_indices();
+
+	glm::vec3 min, max;
+	mesh.get_bounds(min, max);
+	glm::vec3 extent = max - min;
+	float size = std::max(extent.x, std::max(extent.y, extent.z));
+	this->mesh_transform = glm::scale(glm::mat4(1.0f), glm::vec3(size > 0.0f ? 1.0f / size : 1.0f)) * glm::translate(glm::mat4(1.0f), (min + max) * -0.5f);
+}
+
+uint32_t FirstVulkan::get_index(const draw_t& draw, uint32_t i) const
+{
+	const uint8_t* data = this->get_index_data() + draw.index_offset;
+	if (draw.index_type == VK_INDEX_TYPE_UINT16)
+	{
+		uint16_t index;
+		memcpy(&index, data + i * sizeof(uint16_t), sizeof(uint16_t));
+		return index;
+	}
+	uint32_t index;
+	memcpy(&index, data + i * sizeof(uint32_t), sizeof(uint32_t));
+	return index;
+}
+
+void FirstVulkan::load_scene(const std::string& path)
+{
+	double t_begin = get_time();
+	if (!this->scene.load(path))
+		throw std::runtime_error("Unable to load scene " + path + "!");
+	if (this->scene.get_vertex_stride() != sizeof(vertex_t))
+		throw std::runtime_error("Scene " + path + " uses a different vertex layout!");
+
+	// vertex and index data stays in the mapping, only the draws are copied
+	this->vertices.clear();
+	this->indices.clear();
+	this->index_data.clear();
+	this->draws.resize(this->scene.get_draw_count());
+	for (uint32_t i = 0; i < this->scene.get_draw_count(); i++)
+		this->draws[i] = this->scene.get_draw(i);
+	this->mesh_transform = this->scene.get_transform();
+	this->vertex_dequantization = glm::mat4(1.0f);
+	std::cout << "Scene " << path << ": " << this->scene.get_vertex_count() << " vertices, " << this->draws.size() << " draws, mapped in "
+		<< (get_time() - t_begin) * 1000.0 << " ms" << std::endl;
+}
+
+void FirstVulkan::export_scene(const std::string& path)
+{
+	// the mapping of the loaded scene must not be overwritten
+	if (this->scene.is_loaded() && path == this->settings.scene_path)
+		throw std::invalid_argument("The scene can't be exported into the file it is loaded from!");
+
+	SceneFile::save(path, sizeof(vertex_t), this->get_vertex_data(), this->get_vertex_count() * sizeof(vertex_t), this->get_index_data(), this->get_index_data_size(),
+		this->draws.data(), static_cast<uint32_t>(this->draws.size()), this->mesh_transform * this->vertex_dequantization);
+	std::cout << "Scene written to " << path << std::endl;
+}
+
+void FirstVulkan::quantize_vertices(const std::vector<unpacked_vertex_t>& unpacked)
+{
+	/* Positions are stored relative to the bounds of the vertex data, which uses the whole range of
+	   the 16 bit normalized integers. The model matrix scales and moves them back, the vertex shader
+	   does not need to know about it. */
+	glm::vec3 min(0.0f), max(0.0f);
+	if (!unpacked.empty())
+		min = max = unpacked[0].pos;
+	for (const unpacked_vertex_t& vertex : unpacked)
+	{
+		min = glm::min(min, vertex.pos);
+		max = glm::max(max, vertex.pos);
+	}
+	glm::vec3 center = (min + max) * 0.5f;
+	glm::vec3 half_extent = glm::max((max - min) * 0.5f, glm::vec3(1e-6f));
+
+	this->vertices.resize(unpacked.size());
+	for (size_t i = 0; i < unpacked.size(); i++)
+	{
+		this->vertices[i].pos = snorm16x4_t(glm::vec4((unpacked[i].pos - center) / half_extent, 0.0f));
+		this->vertices[i].color = unorm8x4_t(unpacked[i].color);
+		this->vertices[i].uv_coord = half2_t(unpacked[i].uv_coord);
+	}
+	this->vertex_dequantization = glm::translate(glm::mat4(1.0f), center) * glm::scale(glm::mat4(1.0f), half_extent);
 }
 
 void FirstVulkan::vulkan_init(void)
 {
 	this->vulkan_create_app_info();
 	this->vulkan_create_instance();
-	this->vulkan_create_glfw_window_surface();
+	if (!this->settings.headless)
+		this->vulkan_create_glfw_window_surface();
 	this->vulkan_create_device();
 	this->vulkan_create_queues();
-	this->vulkan_check_surface_support();
-	this->vulkan_create_swapchain();
+	this->allocator.create(this->device, this->physical_devices[0]);
+	this->texture_streamer.set_budget(this->vulkan_query_texture_budget());
+	this->thread_pool.create();
+	this->pipeline_cache.create(this->device, this->physical_devices[0], this->settings.pipeline_cache_path);
+	this->upload_batch.create(this->device, this->transfer_queue, this->queue_families.transfer, this->queue, this->queue_families.graphics, &this->allocator);
+	if (this->settings.headless)
+	{
+		this->vulkan_create_offscreen_images();
+	}
+	else
+	{
+		this->vulkan_check_surface_support();
+		this->vulkan_query_swapchain_support();
+		this->vulkan_choose_swapchain_config();
+		this->vulkan_create_swapchain();
+	}
 	this->vulkan_create_image_views();
 	this->vulkan_create_render_pass();
 	this->vulkan_create_shader_modules();
 	this->vulkan_create_descriptor_set_layout();
 	this->vulkan_create_pipeline();
 	this->vulkan_create_command_pool();
-	this->vulkan_create_depth_image(this->physical_devices[0], this->queue);
+
+	// all uploads of the initialization are submitted at once, the CPU continues while the GPU copies
+	this->upload_batch.begin();
+	this->vulkan_create_depth_image(this->physical_devices[0]);
 	this->vulkan_create_framebuffers();
-	this->vulkan_load_texture();
+	this->vulkan_load_textures(this->settings.texture_paths);
 	this->vulkan_create_vertex_buffer();
+	this->upload_batch.submit();
 	this->vulkan_create_uniform_buffer();
+	this->vulkan_create_instance_buffer();
 	this->vulkan_create_descriptor_pool();
-	this->vulkan_create_descriptor_set();	
+	this->frames = new frame_t[this->n_frames_in_flight];
+	this->vulkan_create_descriptor_set();
+	this->vulkan_create_cull_pipeline();
+	this->vulkan_create_cull_descriptor_sets();
 	this->vulkan_create_command_buffers();
-	this->vulkan_record_command_buffers();
-	this->vulkan_create_semaphores();
+	this->vulkan_create_sync_objects();
+	this->vulkan_create_image_fences();
+	this->gpu_profiler.create(this->device, this->physical_devices[0], this->queue_families.graphics, this->n_frames_in_flight, this->settings.gpu_timestamps, this->settings.pipeline_statistics);
+	this->upload_batch.wait();
+	// the GPU has finished the copies out of imported host memory
+	for (const host_import_t& import : this->host_imports)
+	{
+		vkDestroyBuffer(this->device, import.buffer, nullptr);
+		vkFreeMemory(this->device, import.memory, nullptr);
+	}
+	this->host_imports.clear();
+	this->allocator.print_statistics();
 }
 
 void FirstVulkan::glfw_on_window_resize(GLFWwindow* window, int width, int height)
@@ -1429,31 +2716,56 @@ void FirstVulkan::glfw_init(void)
 void FirstVulkan::vulkan_destroy(void)
 {
 	vkDeviceWaitIdle(this->device);
+	this->thread_pool.destroy();
 
 	vkDestroyImageView(this->device, this->depth_image_view, nullptr);
 	vkDestroyImage(this->device, this->depth_image, nullptr);
-	vkFreeMemory(this->device, this->depth_memory, nullptr);
-
-	vkDestroySampler(this->device, this->texture1_sampler, nullptr);
-	vkDestroyImageView(this->device, this->texture1_view, nullptr);
-	vkDestroyImage(this->device, this->texture1_image, nullptr);
-	vkFreeMemory(this->device, this->texture1_memory, nullptr);
+	this->allocator.free(this->depth_memory);
+
+	vkDestroySampler(this->device, this->texture_sampler, nullptr);
+	for (texture_t& texture : this->textures)
+		this->vulkan_destroy_texture(texture);
+	for (texture_swap_t& swap : this->texture_swaps)
+		this->vulkan_destroy_texture(swap.replacement);
+	for (retired_texture_t& retired : this->retired_textures)
+		this->vulkan_destroy_texture(retired.texture);
+	this->textures.clear();
+	this->texture_swaps.clear();
+	this->retired_textures.clear();
+	this->texture_sources.clear();
 
 	vkDestroyDescriptorSetLayout(this->device, this->descriptor_set_layout, nullptr);
 	vkDestroyDescriptorPool(this->device, this->descriptor_pool, nullptr);
-	vkFreeMemory(this->device, this->uniform_buffer_memory, nullptr);
-	vkDestroyBuffer(this->device, this->uniform_buffer, nullptr);
-
-	vkFreeMemory(this->device, this->vertex_buffer_memory, nullptr);
-	vkDestroyBuffer(this->device, this->vertex_buffer, nullptr);
-	vkFreeMemory(this->device, this->index_buffer_memory, nullptr);
-	vkDestroyBuffer(this->device, this->index_buffer, nullptr);
-
-	vkDestroySemaphore(this->device, this->semaphore_img_aviable, nullptr);
-	vkDestroySemaphore(this->device, this->semaphore_rendering_done, nullptr);
-
-	vkFreeCommandBuffers(this->device, this->cmd_pool, this->n_images_swapchain, this->cmd_buffers);
-	delete[] this->cmd_buffers;
+	vkDestroyDescriptorSetLayout(this->device, this->bindless_descriptor_set_layout, nullptr);
+	vkDestroyDescriptorPool(this->device, this->bindless_descriptor_pool, nullptr);
+	this->vulkan_destroy_buffer(this->uniform_buffer, this->uniform_buffer_memory);
+	this->vulkan_destroy_buffer(this->instance_buffer, this->instance_buffer_memory);
+	this->vulkan_destroy_buffer(this->culled_instance_buffer, this->culled_instance_buffer_memory);
+	this->vulkan_destroy_buffer(this->indirect_buffer, this->indirect_buffer_memory);
+	this->vulkan_destroy_buffer(this->indirect_template_buffer, this->indirect_template_memory);
+	if (this->bindless_textures)
+		this->vulkan_destroy_buffer(this->draw_texture_buffer, this->draw_texture_memory);
+
+	this->vulkan_destroy_buffer(this->vertex_buffer, this->vertex_buffer_memory);
+	this->vulkan_destroy_buffer(this->index_buffer, this->index_buffer_memory);
+	this->scene.close();
+
+	for (uint32_t i = 0; i < this->n_frames_in_flight; i++)
+	{
+		vkDestroySemaphore(this->device, this->frames[i].semaphore_img_aviable, nullptr);
+		vkDestroySemaphore(this->device, this->frames[i].semaphore_rendering_done, nullptr);
+		vkDestroyFence(this->device, this->frames[i].fence_in_flight, nullptr);
+		vkFreeCommandBuffers(this->device, this->frames[i].cmd_pool, 1, &this->frames[i].cmd_buffer);
+		vkDestroyCommandPool(this->device, this->frames[i].cmd_pool, nullptr);
+		for (recorder_t& recorder : this->frames[i].recorders)
+		{
+			vkFreeCommandBuffers(this->device, recorder.cmd_pool, 1, &recorder.cmd_buffer);
+			vkDestroyCommandPool(this->device, recorder.cmd_pool, nullptr);
+		}
+	}
+	delete[] this->frames;
+	delete[] this->fences_images_in_flight;
+	this->gpu_profiler.destroy();
 
 	vkDestroyCommandPool(this->device, this->cmd_pool, nullptr);
 
@@ -1462,24 +2774,50 @@ void FirstVulkan::vulkan_destroy(void)
 	delete[] this->fbos_swapchain;
 
 	vkDestroyPipeline(this->device, this->pipeline, nullptr);
+	vkDestroyPipeline(this->device, this->cull_pipeline, nullptr);
+	if (!this->pipeline_cache.save())
+		std::cerr << "Failed to write pipeline cache " << this->settings.pipeline_cache_path << std::endl;
+	this->pipeline_cache.destroy();
 
 	vkDestroyRenderPass(this->device, this->renderpass, nullptr);
 
 	vkDestroyPipelineLayout(this->device, this->pipeline_layout, nullptr);
+	vkDestroyPipelineLayout(this->device, this->cull_pipeline_layout, nullptr);
+	vkDestroyDescriptorPool(this->device, this->cull_descriptor_pool, nullptr);
+	vkDestroyDescriptorSetLayout(this->device, this->cull_descriptor_set_layout, nullptr);
 
 	vkDestroyShaderModule(this->device, this->shadermodule_main_vert, nullptr);
 	vkDestroyShaderModule(this->device, this->shadermodule_main_frag, nullptr);
+	vkDestroyShaderModule(this->device, this->shadermodule_cull_comp, nullptr);
+	vkDestroyShaderModule(this->device, this->shadermodule_bindless_vert, nullptr);
+	vkDestroyShaderModule(this->device, this->shadermodule_bindless_frag, nullptr);
 
 	for (size_t i = 0; i < this->n_images_swapchain; i++)
 		vkDestroyImageView(this->device, this->image_views[i], nullptr);
 	delete[] this->image_views;
 
-	vkDestroySwapchainKHR(this->device, this->swapchain, nullptr);
+	if (this->settings.headless)
+	{
+		for (size_t i = 0; i < this->n_images_swapchain; i++)
+		{
+			vkDestroyImage(this->device, this->offscreen_images[i], nullptr);
+			this->allocator.free(this->offscreen_memory[i]);
+		}
+		delete[] this->offscreen_images;
+		delete[] this->offscreen_memory;
+	}
+	else
+	{
+		vkDestroySwapchainKHR(this->device, this->swapchain, nullptr);
+	}
 
+	this->upload_batch.destroy();
+	this->allocator.destroy();
 	vkDestroyDevice(this->device, nullptr);
 	delete[] this->physical_devices;
 
-	vkDestroySurfaceKHR(this->instance, this->surface, nullptr);
+	if (this->surface != VK_NULL_HANDLE)
+		vkDestroySurfaceKHR(this->instance, this->surface, nullptr);
 
 	vkDestroyInstance(this->instance, nullptr);
 
@@ -1491,9 +2829,29 @@ void FirstVulkan::glfw_destroy(void)
 	glfwTerminate();
 }
 
+void FirstVulkan::uniform_stream_begin_frame(uint32_t frame_index)
+{
+	// everything that was written into this slot before has been consumed by the GPU
+	this->uniform_head = frame_index * this->uniform_slot_size;
+	this->uniform_slot_end = this->uniform_head + this->uniform_slot_size;
+}
+
+uint32_t FirstVulkan::uniform_stream_write(const void* data, VkDeviceSize size)
+{
+	// sub-allocate from the slot of the current frame, returns the dynamic offset of the data
+	VkDeviceSize offset = this->uniform_head;
+	VkDeviceSize aligned_size = (size + this->uniform_alignment - 1) / this->uniform_alignment * this->uniform_alignment;
+	if (offset + aligned_size > this->uniform_slot_end)
+		throw std::runtime_error("Uniform stream slot is full!");
+
+	memcpy(this->uniform_buffer_mapped + offset, data, size);	// memory is coherent, no flush needed
+	this->uniform_head += aligned_size;
+	return static_cast<uint32_t>(offset);
+}
+
 void FirstVulkan::update_mvp(void)
 {
-	const double t_app_cur = glfwGetTime();
+	const double t_app_cur = get_time();
 	const double deltatime = (t_app_cur - this->t_app_start);
 
 	glm::mat4 model(1.0f);
@@ -1502,71 +2860,550 @@ void FirstVulkan::update_mvp(void)
 	glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)this->width / (float)this->height, 0.01f, 100.0f);
 	projection[1][1] *= -1.0f;	// invert screen y axis
 
-	this->MVP = projection * view * model;
+	scene_uniforms_t uniforms;
+	uniforms.view_projection = projection * view * model;
+	uniforms.mesh = this->mesh_transform * this->vertex_dequantization;
+	this->view_projection = uniforms.view_projection;
+	this->mesh_matrix = uniforms.mesh;
+
+	/* Frustum planes in the space of the instances, for the CPU and the GPU culling. The mesh lies in
+	   the cube [-1, 1] before the mesh matrix, the sphere around the cube bounds it. */
+	FrustumCuller::extract_planes(uniforms.view_projection, this->cull_constants.planes);
+	float scale = std::max(glm::length(glm::vec3(uniforms.mesh[0])), std::max(glm::length(glm::vec3(uniforms.mesh[1])), glm::length(glm::vec3(uniforms.mesh[2]))));
+	this->cull_constants.bounds = glm::vec4(glm::vec3(uniforms.mesh[3]), scale * std::sqrt(3.0f));
+	this->cull_constants.instance_count = this->settings.instance_count;
+	this->cull_constants.draw_count = static_cast<uint32_t>(this->draws.size());
+
+	this->mvp_offset = this->uniform_stream_write(&uniforms, sizeof(uniforms));
+}
+
+void FirstVulkan::update_instances(void)
+{
+	/* The instances sit on a square grid that fills the unit cube, every one spins around its
+	   own axis at its own speed. A single instance is the mesh as it is, without transform. */
+	const float t = static_cast<float>(get_time() - this->t_app_start);
+	const uint32_t n = this->settings.instance_count;
+	const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+	const float cell = 1.0f / side;
+	const float scale = (n > 1) ? cell * 0.8f : 1.0f;
+
+	if (this->frustum_culler.get_object_count() != n)
+	{
+		this->frustum_culler.resize(n);
+		this->visible_instances.resize(n);
+	}
+	for (uint32_t i = 0; i < n; i++)
+	{
+		float angle = (n > 1) ? t * (0.5f + (i % 7) * 0.25f) + i : 0.0f;
+		float c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+		float x = (n > 1) ? ((i % side) + 0.5f) * cell - 0.5f : 0.0f;
+		float z = (n > 1) ? ((i / side) + 0.5f) * cell - 0.5f : 0.0f;
+
+		glm::vec4 transform[3] = { glm::vec4(c, 0.0f, s, x), glm::vec4(0.0f, scale, 0.0f, 0.0f), glm::vec4(-s, 0.0f, c, z) };
+		this->frustum_culler.set_transform(i, transform);
+	}
 
-	void* data;
-	vkMapMemory(this->device, this->uniform_buffer_memory, 0, sizeof(this->MVP), 0, &data);
-	memcpy(data, &this->MVP, sizeof(MVP));
-	vkUnmapMemory(this->device, this->uniform_buffer_memory);
+	// the GPU culls the whole slot itself, it needs all instances
+	bool cull = this->settings.cpu_culling && !this->gpu_culling;
+	if (cull)
+	{
+		this->frustum_culler.update_bounds(this->cull_constants.bounds);
+		this->visible_instance_count = this->frustum_culler.cull(this->cull_constants.planes, this->visible_instances.data());
+	}
+	else
+		this->visible_instance_count = n;
+
+	instance_t* instances = reinterpret_cast<instance_t*>(this->instance_buffer_memory.mapped + this->current_frame * this->instance_slot_size);
+	for (uint32_t j = 0; j < this->visible_instance_count; j++)
+	{
+		uint32_t i = cull ? this->visible_instances[j] : j;
+
+		// memory is coherent and written sequentially, no flush needed
+		instance_t instance;
+		this->frustum_culler.get_transform(i, instance.transform);
+		instance.color = (n > 1) ? unorm8x4_t(glm::vec4(0.6f + 0.4f * std::cos(i * 0.9f), 0.6f + 0.4f * std::cos(i * 1.3f + 2.0f), 0.6f + 0.4f * std::cos(i * 1.7f + 4.0f), 1.0f)) : unorm8x4_t(glm::vec4(1.0f));
+		instances[j] = instance;
+	}
+}
+
+uint32_t FirstVulkan::get_draw_texture(const draw_t& draw) const
+{
+	// materials without a texture of their own share the loaded ones
+	return this->bindless_textures ? draw.material % static_cast<uint32_t>(this->textures.size()) : 0;
+}
+
+uint32_t FirstVulkan::get_draw_first_index(const draw_t& draw)
+{
+	// the index offset is aligned to the index size
+	return static_cast<uint32_t>(draw.index_offset / ((draw.index_type == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t)));
+}
+
+uint32_t FirstVulkan::estimate_texture_base_level(uint32_t texture)
+{
+	/* Usage feedback of the mesh, which samples the texture. The texel density of a triangle on
+	   screen gives the level the hardware selects, the most detailed level of all triangles is
+	   needed. Triangles that cross the camera plane can get arbitrarily close, they need level 0.
+	   Large meshes are sampled, a few thousand triangles are enough for an estimate. Only the draws
+	   that sample the texture count. The nearest instance in front of the camera needs the most
+	   detail, its transform places the mesh. */
+	glm::mat4 instance_transform(1.0f);
+	float nearest = std::numeric_limits<float>::max();
+	bool cull = this->settings.cpu_culling && !this->gpu_culling;
+	for (uint32_t j = 0; j < this->visible_instance_count; j++)
+	{
+		uint32_t i = cull ? this->visible_instances[j] : j;
+		glm::vec4 rows[3];
+		this->frustum_culler.get_transform(i, rows);
+		glm::mat4 transform = glm::transpose(glm::mat4(rows[0], rows[1], rows[2], glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+		float w = (this->view_projection * transform * glm::vec4(glm::vec3(this->cull_constants.bounds), 1.0f)).w;
+		if (w > 0.0f && w < nearest)
+		{
+			nearest = w;
+			instance_transform = transform;
+		}
+	}
+	glm::mat4 mvp = this->view_projection * instance_transform * this->mesh_matrix;
+
+	const Ktx2Texture& source = this->texture_sources[texture].data;
+	float texels = (float)source.get_width() * source.get_height();
+	float lod = (float)(source.get_level_count() - 1);
+	const vertex_t* vertices = this->get_vertex_data();
+	size_t n_triangles = 0;
+	for (const draw_t& draw : this->draws)
+	{
+		if (this->get_draw_texture(draw) == texture)
+			n_triangles += draw.index_count / 3;
+	}
+	uint32_t stride = static_cast<uint32_t>(std::max<size_t>(n_triangles / MAX_FEEDBACK_TRIANGLES, 1));
+	for (const draw_t& draw : this->draws)
+	{
+		if (this->get_draw_texture(draw) != texture)
+			continue;
+		for (uint32_t i = 0; i < draw.index_count / 3; i += stride)
+		{
+			glm::vec2 screen[3];
+			glm::vec2 uv[3];
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				const vertex_t& vertex = vertices[this->get_index(draw, i * 3 + j) + draw.vertex_offset];
+				glm::vec4 clip = mvp * glm::vec4(glm::vec3(vertex.pos.unpack()), 1.0f);
+				if (clip.w <= 0.0f)
+					return 0;
+				screen[j] = glm::vec2(clip.x / clip.w * 0.5f * this->width, clip.y / clip.w * 0.5f * this->height);
+				uv[j] = vertex.uv_coord.unpack();
+			}
+
+			glm::vec2 e0 = screen[1] - screen[0], e1 = screen[2] - screen[0];
+			glm::vec2 t0 = uv[1] - uv[0], t1 = uv[2] - uv[0];
+			float pixel_area = std::abs(e0.x * e1.y - e0.y * e1.x);
+			float texel_area = std::abs(t0.x * t1.y - t0.y * t1.x) * texels;
+			if (pixel_area <= 0.0f || texel_area <= 0.0f)
+				continue;
+			lod = std::min(lod, 0.5f * std::log2(texel_area / pixel_area));
+		}
+	}
+	return static_cast<uint32_t>(std::max(lod, 0.0f));
+}
+
+void FirstVulkan::texture_streaming_update(void)
+{
+	// feedback for every texture a draw samples, the others keep their small levels
+	for (uint32_t texture = 0; texture < this->textures.size(); texture++)
+	{
+		bool sampled = false;
+		for (const draw_t& draw : this->draws)
+			sampled |= (this->get_draw_texture(draw) == texture);
+		if (sampled)
+			this->texture_streamer.request(texture, this->estimate_texture_base_level(texture), this->frame_number);
+	}
+
+	// the streaming upload has finished, its images replace the current ones in the next descriptor updates
+	if (!this->texture_swaps.empty() && this->upload_batch.poll())
+	{
+		for (texture_swap_t& swap : this->texture_swaps)
+		{
+			this->retired_textures.push_back({ this->textures[swap.texture], this->frame_number });
+			this->textures[swap.texture] = swap.replacement;
+			this->texture_streamer.commit({ swap.texture, swap.replacement.base_level });
+		}
+		this->texture_swaps.clear();
+		this->texture_descriptor_version++;
+	}
+
+	// every frame slot has been waited for since the swap, no set references the old image anymore
+	size_t n_retired = 0;
+	for (retired_texture_t& retired : this->retired_textures)
+	{
+		if (this->frame_number >= retired.retire_frame + this->n_frames_in_flight)
+			this->vulkan_destroy_texture(retired.texture);
+		else
+			this->retired_textures[n_retired++] = retired;
+	}
+	this->retired_textures.resize(n_retired);
+
+	if (this->frame_number % MEMORY_BUDGET_INTERVAL == 0)
+		this->texture_streamer.set_budget(this->vulkan_query_texture_budget());
+
+	// one streaming upload at a time, begin() would wait for the previous one
+	if (!this->texture_swaps.empty() || !this->upload_batch.poll())
+		return;
+
+	std::vector<TextureStreamer::change_t> changes;
+	this->texture_streamer.plan(this->frame_number, TEXTURE_UPLOAD_SIZE, changes);
+	if (changes.empty())
+		return;
+
+	this->upload_batch.begin();
+	for (const TextureStreamer::change_t& change : changes)
+	{
+		texture_swap_t swap;
+		swap.texture = change.texture;
+		this->vulkan_upload_texture(this->texture_sources[change.texture], change.base_level, swap.replacement);
+		this->texture_swaps.push_back(swap);
+	}
+	this->upload_batch.submit();
 }
 
 void FirstVulkan::draw_frame(void)
 {
-	int w, h;
-	glfwGetWindowSize(this->window, &w, &h);
-	if (w != this->width || h != this->height)
-		this->glfw_on_window_resize(this->window, w, h);
+	if (!this->settings.headless)
+	{
+		int w, h;
+		glfwGetWindowSize(this->window, &w, &h);
+		if (w != this->width || h != this->height)
+			this->glfw_on_window_resize(this->window, w, h);
+	}
+
+	frame_t& frame = this->frames[this->current_frame];
+	double t_phase = get_time();
+
+	// wait until the GPU has finished the last frame that used this frame slot, the frames in flight are bounded that way
+	VkResult result = vkWaitForFences(this->device, 1, &frame.fence_in_flight, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	ASSERT_VULKAN(result);
+	this->gpu_profiler_collect(this->current_frame);	// the queries of the slot's last frame are finished now
+	this->benchmark_phase(PHASE_WAIT, t_phase);
+
+	// the uniform slot of this frame can only be written after the wait, the GPU may still read it otherwise
+	this->uniform_stream_begin_frame(this->current_frame);
+	this->update_mvp();
+	this->update_instances();
+	this->benchmark_phase(PHASE_UPDATE_MVP, t_phase);
+
+	// the descriptor set of this frame isn't used by the GPU anymore, swapped textures are written into it
+	if (this->settings.texture_streaming)
+		this->texture_streaming_update();
+	this->vulkan_update_texture_descriptors(frame);
+	this->benchmark_phase(PHASE_STREAM, t_phase);
 
 	// get next image for rendering
 	uint32_t image_index;																		// 1) first step: get image
-	vkAcquireNextImageKHR(this->device, this->swapchain, std::numeric_limits<uint64_t>::max(), this->semaphore_img_aviable, VK_NULL_HANDLE, &image_index);
+	if (this->settings.headless)
+	{
+		image_index = this->current_frame;		// every frame slot owns one offscreen image
+	}
+	else
+	{
+		result = vkAcquireNextImageKHR(this->device, this->swapchain, std::numeric_limits<uint64_t>::max(), frame.semaphore_img_aviable, VK_NULL_HANDLE, &image_index);
+		if (result != VK_SUBOPTIMAL_KHR)	// a suboptimal image can still be used, the window size check recreates the swapchain
+		{
+			ASSERT_VULKAN(result);
+		}
+	}
+
+	// another frame in flight can still render into the acquired image
+	if (this->fences_images_in_flight[image_index] != VK_NULL_HANDLE)
+	{
+		result = vkWaitForFences(this->device, 1, &this->fences_images_in_flight[image_index], VK_TRUE, std::numeric_limits<uint64_t>::max());
+		ASSERT_VULKAN(result);
+	}
+	this->fences_images_in_flight[image_index] = frame.fence_in_flight;
+	this->benchmark_phase(PHASE_ACQUIRE, t_phase);
+
+	// the command buffers of this frame are not in use anymore, record them new
+	result = vkResetCommandPool(this->device, frame.cmd_pool, 0);
+	ASSERT_VULKAN(result);
+	for (recorder_t& recorder : frame.recorders)
+	{
+		result = vkResetCommandPool(this->device, recorder.cmd_pool, 0);
+		ASSERT_VULKAN(result);
+	}
+	this->vulkan_record_command_buffer(frame.cmd_buffer, image_index);
+	this->benchmark_phase(PHASE_RECORD, t_phase);
 
 	// start rendering process
 	VkSubmitInfo submit_info = {};
 	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submit_info.pNext = nullptr;
 	submit_info.waitSemaphoreCount = 1;
-	submit_info.pWaitSemaphores = &this->semaphore_img_aviable;			// 2) wait until next image is aviable
+	submit_info.pWaitSemaphores = &frame.semaphore_img_aviable;			// 2) wait until next image is aviable
 	VkPipelineStageFlags wait_stage_mask[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };	// wait for image at the color blending step (last step in the pipeline)
 	submit_info.pWaitDstStageMask = wait_stage_mask;
 	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = this->cmd_buffers + image_index;
+	submit_info.pCommandBuffers = &frame.cmd_buffer;
 	submit_info.signalSemaphoreCount = 1;
-	submit_info.pSignalSemaphores = &this->semaphore_rendering_done;	// 3) next setep: rendering
+	submit_info.pSignalSemaphores = &frame.semaphore_rendering_done;	// 3) next setep: rendering
+	if (this->settings.headless)
+	{
+		// there is no presentation engine that signals or waits for the semaphores
+		submit_info.waitSemaphoreCount = 0;
+		submit_info.signalSemaphoreCount = 0;
+	}
 
-	VkResult result = vkQueueSubmit(this->queue, 1, &submit_info, VK_NULL_HANDLE);
+	// the fence is signaled when the GPU has finished this frame
+	result = vkResetFences(this->device, 1, &frame.fence_in_flight);
+	ASSERT_VULKAN(result);
+	result = vkQueueSubmit(this->queue, 1, &submit_info, frame.fence_in_flight);
 	ASSERT_VULKAN(result);
+	this->last_image_index = image_index;
+	this->benchmark_phase(PHASE_SUBMIT, t_phase);
+
+	if (this->settings.headless)
+	{
+		this->current_frame = (this->current_frame + 1) % this->n_frames_in_flight;
+		return;
+	}
 
 	VkPresentInfoKHR present_info = {};
 	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	present_info.pNext = nullptr;
 	present_info.waitSemaphoreCount = 1;
-	present_info.pWaitSemaphores = &this->semaphore_rendering_done;		// 4) wait until rendering has finished
+	present_info.pWaitSemaphores = &frame.semaphore_rendering_done;		// 4) wait until rendering has finished
 	present_info.swapchainCount = 1;
 	present_info.pSwapchains = &this->swapchain;
 	present_info.pImageIndices = &image_index;
 	present_info.pResults = nullptr;
 
 	result = vkQueuePresentKHR(this->queue, &present_info);
-	ASSERT_VULKAN(result);
+	if (result != VK_SUBOPTIMAL_KHR)
+	{
+		ASSERT_VULKAN(result);
+	}
+	this->benchmark_phase(PHASE_PRESENT, t_phase);
+
+	this->current_frame = (this->current_frame + 1) % this->n_frames_in_flight;
+}
+
+void FirstVulkan::benchmark_phase(frame_phase_t phase, double& t_phase_begin)
+{
+	// records the time since the begin of the phase and starts the next phase
+	const double t_now = get_time();
+	this->benchmark.record(this->frame_number, phase, (t_now - t_phase_begin) * 1000.0);
+	t_phase_begin = t_now;
+}
+
+void FirstVulkan::gpu_profiler_collect(uint32_t frame_index)
+{
+	double scope_ms[this->gpu_profiler.get_scope_count()];
+	uint64_t statistics[GpuProfiler::N_STATISTICS] = {};
+	uint64_t frame_number;
+	if (!this->gpu_profiler.resolve(frame_index, frame_number, scope_ms, statistics))
+		return;
+
+	// the results belong to the frame that was recorded into the slot, not to the current one
+	for (uint32_t i = 0; i < this->gpu_profiler.get_scope_count(); i++)
+		this->benchmark.record(frame_number, this->gpu_series_begin + i, scope_ms[i]);
+	if (this->gpu_profiler.has_statistics())
+	{
+		const uint32_t statistics_begin = this->gpu_series_begin + this->gpu_profiler.get_scope_count();
+		for (uint32_t i = 0; i < GpuProfiler::N_STATISTICS; i++)
+			this->benchmark.record(frame_number, statistics_begin + i, static_cast<double>(statistics[i]));
+	}
+	this->gpu_frame_ms = scope_ms[this->gpu_scope_frame];
 }
 
 void FirstVulkan::run(void)
 {
-	while (!glfwGetKey(this->window, GLFW_KEY_ESCAPE) && !glfwWindowShouldClose(this->window))
+	uint64_t frame_count = this->settings.frame_count;
+	if (this->settings.benchmark)
 	{
-		double t_begin = glfwGetTime();
-		glfwPollEvents();
+		frame_count = this->settings.benchmark_warmup + this->settings.benchmark_frames;
+		this->benchmark.start(this->settings.benchmark_frames, this->settings.benchmark_warmup);
+	}
+
+	double t_fps_begin = get_time();
+	uint32_t n_fps_frames = 0;
+	for (this->frame_number = 0; frame_count == 0 || this->frame_number < frame_count; this->frame_number++)
+	{
+		if (!this->settings.headless && (glfwGetKey(this->window, GLFW_KEY_ESCAPE) || glfwWindowShouldClose(this->window)))
+			break;
+
+		const double t_begin = get_time();
+		double t_phase = t_begin;
+		if (!this->settings.headless)
+		{
+			glfwPollEvents();
+
+			// G switches between the draws of the CPU and the GPU culled draws, both can be compared at runtime
+			bool cull_key = glfwGetKey(this->window, GLFW_KEY_G) == GLFW_PRESS;
+			if (cull_key && !this->cull_key_down)
+			{
+				this->gpu_culling = !this->gpu_culling;
+				std::cout << "GPU culling " << (this->gpu_culling ? "enabled" : "disabled") << std::endl;
+			}
+			this->cull_key_down = cull_key;
+		}
+		this->benchmark_phase(PHASE_POLL, t_phase);
 
-		this->update_mvp();
 		this->draw_frame();
 
-		double t_end = glfwGetTime();
-		std::cout.precision(3);
-		std::cout << "Framerate: " << 1.0 / ((t_end - t_begin)) << "FPS\r";
+		const double t_end = get_time();
+		this->benchmark.record(this->frame_number, PHASE_FRAME, (t_end - t_begin) * 1000.0);
+
+		// show the average framerate once per second in the window title instead of printing every frame
+		n_fps_frames++;
+		if (!this->settings.headless && t_end - t_fps_begin >= 1.0)
+		{
+			std::string title = "First Vulkan - " + std::to_string(static_cast<int>(n_fps_frames / (t_end - t_fps_begin) + 0.5)) + " FPS";
+			if (!std::isnan(this->gpu_frame_ms))
+				title += " - GPU " + std::to_string(this->gpu_frame_ms) + " ms";
+			glfwSetWindowTitle(this->window, title.c_str());
+			t_fps_begin = t_end;
+			n_fps_frames = 0;
+		}
+	}
+
+	if (this->settings.benchmark)
+	{
+		// the queries of the last frames in flight are only finished once the device is idle
+		VkResult result = vkDeviceWaitIdle(this->device);
+		ASSERT_VULKAN(result);
+		for (uint32_t i = 0; i < this->n_frames_in_flight; i++)
+			this->gpu_profiler_collect(i);
+
+		this->benchmark.print_report();
+		if (!this->benchmark.write_json(this->settings.benchmark_output.c_str()))
+			std::cerr << "Unable to write benchmark results to " << this->settings.benchmark_output << std::endl;
+	}
+
+	if (!this->settings.readback_path.empty())
+	{
+		std::vector<uint8_t> pixels;
+		this->read_back_frame(pixels);
+		this->save_ppm(this->settings.readback_path.c_str(), pixels);
 	}
 }
 
+void FirstVulkan::read_back_frame(std::vector<uint8_t>& pixels)
+{
+	/* Copies the last rendered image into host memory (BGRA, 4 bytes per pixel).
+	   Only supported in headless mode, swapchain images are owned by the presentation engine. */
+	if (!this->settings.headless)
+		throw std::runtime_error("Read back is only supported in headless mode!");
+
+	VkResult result = vkDeviceWaitIdle(this->device);
+	ASSERT_VULKAN(result);
+
+	VkDeviceSize byte_size = this->width * this->height * 4;
+	VkBuffer readback_buffer;
+	allocation_t readback_memory;
+	this->vulkan_create_buffer(byte_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, readback_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readback_memory);
+
+	VkCommandBufferAllocateInfo cmd_buff_info = {};
+	cmd_buff_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmd_buff_info.pNext = nullptr;
+	cmd_buff_info.commandPool = this->cmd_pool;
+	cmd_buff_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmd_buff_info.commandBufferCount = 1;
+
+	VkCommandBuffer tmp_cmd_buffer = {};
+	result = vkAllocateCommandBuffers(this->device, &cmd_buff_info, &tmp_cmd_buffer);
+	ASSERT_VULKAN(result);
+
+	VkCommandBufferBeginInfo cmd_buff_begin_info = {};
+	cmd_buff_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmd_buff_begin_info.pNext = nullptr;
+	cmd_buff_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	cmd_buff_begin_info.pInheritanceInfo = nullptr;
+
+	result = vkBeginCommandBuffer(tmp_cmd_buffer, &cmd_buff_begin_info);
+	ASSERT_VULKAN(result);
+
+	/* The render pass leaves the image in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL. Waiting for the device
+	   only finishes the execution, the color writes must still be made available to the copy. */
+	VkImageMemoryBarrier image_barrier = {};
+	image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_barrier.pNext = nullptr;
+	image_barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.image = this->offscreen_images[this->last_image_index];
+	image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	image_barrier.subresourceRange.baseMipLevel = 0;
+	image_barrier.subresourceRange.levelCount = 1;
+	image_barrier.subresourceRange.baseArrayLayer = 0;
+	image_barrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(tmp_cmd_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+
+	VkBufferImageCopy img_buff_cpy = {};
+	img_buff_cpy.bufferOffset = 0;
+	img_buff_cpy.bufferRowLength = 0;
+	img_buff_cpy.bufferImageHeight = 0;
+	img_buff_cpy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	img_buff_cpy.imageSubresource.mipLevel = 0;
+	img_buff_cpy.imageSubresource.baseArrayLayer = 0;
+	img_buff_cpy.imageSubresource.layerCount = 1;
+	img_buff_cpy.imageOffset = { 0, 0, 0 };
+	img_buff_cpy.imageExtent = { this->width, this->height, 1 };
+
+	vkCmdCopyImageToBuffer(tmp_cmd_buffer, this->offscreen_images[this->last_image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback_buffer, 1, &img_buff_cpy);
+
+	// the copied pixels are read by the host after the queue is idle
+	VkBufferMemoryBarrier buffer_barrier = {};
+	buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	buffer_barrier.pNext = nullptr;
+	buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	buffer_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.buffer = readback_buffer;
+	buffer_barrier.offset = 0;
+	buffer_barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(tmp_cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &buffer_barrier, 0, nullptr);
+
+	result = vkEndCommandBuffer(tmp_cmd_buffer);
+	ASSERT_VULKAN(result);
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = nullptr;
+	submit_info.waitSemaphoreCount = 0;
+	submit_info.pWaitSemaphores = nullptr;
+	submit_info.pWaitDstStageMask = nullptr;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &tmp_cmd_buffer;
+	submit_info.signalSemaphoreCount = 0;
+	submit_info.pSignalSemaphores = nullptr;
+
+	result = vkQueueSubmit(this->queue, 1, &submit_info, VK_NULL_HANDLE);
+	ASSERT_VULKAN(result);
+	vkQueueWaitIdle(this->queue);
+
+	vkFreeCommandBuffers(this->device, this->cmd_pool, 1, &tmp_cmd_buffer);
+
+	pixels.resize(byte_size);
+	memcpy(pixels.data(), readback_memory.mapped, byte_size);
+
+	this->vulkan_destroy_buffer(readback_buffer, readback_memory);
+}
+
+void FirstVulkan::save_ppm(const char* path, const std::vector<uint8_t>& pixels)
+{
+	std::fstream file(path, std::ios::out | std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Unable to write frame!");
+
+	file << "P6\n" << this->width << " " << this->height << "\n255\n";
+	for (size_t i = 0; i + 3 < pixels.size(); i += 4)
+	{
+		const char rgb[3] = { (char)pixels[i + 2], (char)pixels[i + 1], (char)pixels[i] };	// BGRA -> RGB
+		file.write(rgb, 3);
+	}
+	file.close();
+}
+
 void FirstVulkan::print_deviceinfo(const VkPhysicalDevice* devices, size_t n)
 {
 	/* READ MATCHING DEVICE IN AN REAL APPLICATION */
@@ -1618,6 +3455,13 @@ void FirstVulkan::print_deviceinfo(const VkPhysicalDevice* devices, size_t n)
 		}
 		std::cout << std::endl;
 
+		// there is no surface in headless mode
+		if (this->surface == VK_NULL_HANDLE)
+		{
+			std::cout << "----------------------------------------" << std::endl << std::endl;
+			continue;
+		}
+
 		/* FOR REAL APPLICATION CHECK THE CAPABILITIES AND FORMATS, IF THEY ARE SUITED FOR WHAT YOU WANT TO DO */
 		// read surface capabilities
 		VkSurfaceCapabilitiesKHR surface_capabilities = {};
@@ -1692,28 +3536,15 @@ void FirstVulkan::print_instance_extensions(const VkExtensionProperties* extensi
 	std::cout << "------------------------------------------------------" << std::endl;
 }
 
-size_t FirstVulkan::read_shader(const char* path, std::vector<char>& buff)
-{
-	std::fstream shader(path, std::ios::in | std::ios::binary | std::ios::ate); // std::ios::ate begin reading backwards -> cursor at the last character
-	if (!shader) return 0;
-
-	size_t n_bytes = shader.tellg();	// actual cursor position -> number of bytes in a file
-	shader.seekg(0);						// set cursor back to the first charactor of the file
-	buff.resize(n_bytes);
-	shader.read(buff.data(), n_bytes);
-	shader.close(); 
-	return n_bytes;
-}
-
-VkResult FirstVulkan::create_shader_moudle(const std::vector<char>& code, VkShaderModule* shader_module)
+VkResult FirstVulkan::create_shader_moudle(const uint32_t* code, size_t size, VkShaderModule* shader_module)
 {
 	// create shader info
 	VkShaderModuleCreateInfo shader_info;
 	shader_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 	shader_info.pNext = nullptr;
 	shader_info.flags = 0;
-	shader_info.codeSize = code.size();
-	shader_info.pCode = (uint32_t*)code.data();
+	shader_info.codeSize = size;		// in bytes
+	shader_info.pCode = code;
 
 	return vkCreateShaderModule(this->device, &shader_info, nullptr, shader_module);
 }
\ No newline at end of file
@@ -3,19 +3,225 @@
 #define GLFW_INCLUDE_VULKAN	// includes vulkan internally in GLFW
 #include <GLFW/glfw3.h>
 #include <vector>
+#include <string>
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
+#include "FrameBenchmark.h"
+#include "GpuProfiler.h"
+#include "MemoryAllocator.h"
+#include "UploadBatch.h"
+#include "MipChain.h"
+#include "Ktx2Texture.h"
+#include "ThreadPool.h"
+#include "TextureStreamer.h"
+#include "PipelineCache.h"
+#include "Mesh.h"
+#include "VertexFormat.h"
+#include "SceneFile.h"
+#include "FrustumCuller.h"
 
 class FirstVulkan 
 {
+public:
+	struct settings_t
+	{
+		uint32_t frames_in_flight = 2;	// number of frames the CPU can prepare while the GPU is still working on older ones
+		bool headless = false;			// render into offscreen images, no window, surface or swapchain is created
+		uint64_t frame_count = 0;		// number of frames to render, 0 renders until the window is closed
+		std::string readback_path;		// if set, the last frame is read back and written to this file (PPM)
+		bool benchmark = false;			// measure frame times instead of rendering until the window is closed
+		uint32_t benchmark_frames = 1000;
+		uint32_t benchmark_warmup = 100;	// frames that are rendered before the measurement begins
+		std::string benchmark_output = "benchmark.json";
+		bool gpu_timestamps = true;		// measure GPU times of the frame and the render pass
+		bool pipeline_statistics = false;	// collect pipeline statistics, requires the pipelineStatisticsQuery feature
+		VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;	// MAILBOX and IMMEDIATE fall back to each other, then to FIFO
+		bool async_transfer = true;		// upload on a dedicated transfer queue if the device has one
+		std::vector<std::string> texture_paths = { "../../../textures/texture1.jpg" };	// the first texture is bound to the pipeline
+		bool texture_streaming = false;	// only the small levels are resident at first, detailed levels are loaded when they are sampled. Builds the mip chains on the CPU
+		uint32_t texture_budget_mb = 256;	// VRAM for streamed textures, lowered by VK_EXT_memory_budget if the device is short on memory
+		std::string pipeline_cache_path = "pipeline_cache.bin";	// pipelines compiled by earlier runs, an empty path disables the file
+		std::string mesh_path;			// OBJ file that replaces the built-in quads
+		bool optimize_overdraw = true;	// sort triangle clusters of the mesh outside-in, costs a little vertex cache efficiency
+		std::string scene_path;			// binary scene file, replaces the mesh
+		std::string export_scene_path;	// the vertex and index data is written into a scene file before rendering starts
+		uint32_t instance_count = 1;	// copies of the mesh on a grid, all drawn with one instanced draw
+		bool parallel_recording = false;	// the draw list is recorded into secondary command buffers by the thread pool
+		bool gpu_culling = false;		// a compute pass culls the instances and writes indirect draws, switched with G
+		bool cpu_culling = true;		// only the instances in the frustum are streamed, unless the GPU culls them
+		bool bindless_textures = false;	// all textures in one descriptor array, every draw selects the texture of its material
+	};
+
+private:
+	// CPU phases of a frame that are measured in benchmark mode
+	enum frame_phase_t : uint32_t
+	{
+		PHASE_POLL = 0,
+		PHASE_WAIT,
+		PHASE_UPDATE_MVP,
+		PHASE_STREAM,
+		PHASE_ACQUIRE,
+		PHASE_RECORD,
+		PHASE_SUBMIT,
+		PHASE_PRESENT,
+		PHASE_FRAME,
+		N_PHASES
+	};
+
+	// vertex as it is stored in the vertex buffer, 16 bytes. The formats follow from the member types
 	struct vertex_t
+	{
+		snorm16x4_t pos;		// in the bounds of the vertex data, vertex_dequantization restores it, w is unused
+		unorm8x4_t color;
+		half2_t uv_coord;
+
+		static void get_binding_description(VkVertexInputBindingDescription& description);
+		static void get_attrib_descriptions(std::vector<VkVertexInputAttributeDescription>& descriptions);
+	};
+
+	// per-instance data of the second vertex binding, streamed every frame, 52 bytes
+	struct instance_t
+	{
+		glm::vec4 transform[3];	// rows of an affine 3x4 matrix, places the mesh in the scene
+		unorm8x4_t color;		// multiplied with the vertex color
+
+		static void get_binding_description(VkVertexInputBindingDescription& description);
+		// appends the attributes after the ones of vertex_t
+		static void get_attrib_descriptions(std::vector<VkVertexInputAttributeDescription>& descriptions);
+	};
+
+	// push constants of the cull shader
+	struct cull_constants_t
+	{
+		glm::vec4 planes[6];		// frustum planes in scene space, normalized, the inside is positive
+		glm::vec4 bounds;			// bounding sphere of the mesh before the instance transform
+		uint32_t instance_count;
+		uint32_t draw_count;
+		uint32_t padding[2];
+	};
+
+	// uniform buffer of the vertex shader, the instance transform is applied between the two matrices
+	struct scene_uniforms_t
+	{
+		glm::mat4 view_projection;	// includes the rotation of the whole scene
+		glm::mat4 mesh;				// dequantization and placement of the mesh in the unit cube
+	};
+
+	// vertex with full precision, vertex data is built with it and quantized for the vertex buffer
+	struct unpacked_vertex_t
 	{
 		glm::vec3 pos;
 		glm::vec4 color;
 		glm::vec2 uv_coord;
+	};
 
-		static void get_binding_description(VkVertexInputBindingDescription& description);
-		static void get_attrib_descriptions(std::vector<VkVertexInputAttributeDescription>& descriptions);
+	// draws are stored in scene files as they are used
+	typedef SceneFile::draw_t draw_t;
+
+	// consecutive draw slots with the same index type, drawn with one multi-draw indirect call
+	struct draw_range_t
+	{
+		VkIndexType index_type;
+		uint32_t first_slot;
+		uint32_t n_slots;
+	};
+	typedef MemoryAllocator::allocation_t allocation_t;
+
+	// host memory that is imported as the source of a copy, released when the upload has finished
+	struct host_import_t
+	{
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+	};
+
+	// sampled texture, all levels are in SHADER_READ_ONLY_OPTIMAL after the upload
+	struct texture_t
+	{
+		VkImage image;
+		allocation_t memory;
+		VkImageView view;
+		VkImageLayout layout;
+		VkFormat format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mip_levels;
+		uint32_t base_level;	// level of the source the image starts with, streamed textures drop their detailed levels
+	};
+
+	// texture that has been decoded by a worker thread and can be staged as it is
+	struct decoded_texture_t
+	{
+		Ktx2Texture data;
+		bool blit_mipmaps;		// only level 0 is decoded, the other levels are blitted by the GPU
+	};
+
+	// decoded texture that a worker thread copies into staging memory, the copy commands are recorded afterwards
+	struct staged_texture_t
+	{
+		size_t index;
+		std::shared_ptr<decoded_texture_t> decoded;		// shared with the worker
+		uint32_t base_level;
+		StagingRing::span_t staging;
+		std::future<void> copied;
+	};
+
+	// streamed texture image that replaces the current image as soon as its upload has finished
+	struct texture_swap_t
+	{
+		uint32_t texture;
+		texture_t replacement;
+	};
+
+	// replaced texture image, frames that were recorded before the swap may still sample it
+	struct retired_texture_t
+	{
+		texture_t texture;
+		uint64_t retire_frame;
+	};
+
+	// precompressed variant of a texture, <texture>.<encoding>.ktx2
+	struct ktx2_candidate_t
+	{
+		const char* suffix;
+		VkFormat format;
+	};
+
+	// surface properties, formats and present modes are queried once
+	struct swapchain_support_t
+	{
+		VkSurfaceCapabilitiesKHR capabilities;		// updated whenever the swapchain is (re)created
+		std::vector<VkSurfaceFormatKHR> formats;
+		std::vector<VkPresentModeKHR> present_modes;
+	};
+
+	// queue families the queues are created from, families are shared if the device has no dedicated ones
+	struct queue_families_t
+	{
+		uint32_t graphics;		// graphics and present
+		uint32_t transfer;
+		uint32_t compute;
+	};
+
+	// secondary command buffer with its own pool, a pool must not be used by two threads at once
+	struct recorder_t
+	{
+		VkCommandPool cmd_pool;
+		VkCommandBuffer cmd_buffer;
+	};
+
+	// every frame in flight owns its own synchronization objects and command buffer
+	struct frame_t
+	{
+		VkSemaphore semaphore_img_aviable;		// first render step
+		VkSemaphore semaphore_rendering_done;	// second render step
+		VkFence fence_in_flight;				// signaled as soon as the GPU has finished the frame
+		VkCommandPool cmd_pool;
+		VkCommandBuffer cmd_buffer;
+		VkDescriptorSet descriptor_set;			// texture descriptors change while other frames are in flight
+		uint64_t descriptor_version;			// texture_descriptor_version the set was written with
+		std::vector<recorder_t> recorders;		// parallel recording, one per worker thread
+		VkDescriptorSet cull_descriptor_set;	// the frame's slots of the instance, culled instance and indirect buffers
+		VkDescriptorSet bindless_descriptor_set;	// set 1 with bindless textures, all textures
 	};
 
 private:
@@ -26,33 +232,118 @@ private:
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swapchain;
 	uint32_t n_images_swapchain;
+	swapchain_support_t swapchain_support;
+	VkFormat color_format;
+	VkColorSpaceKHR color_space;
+	VkPresentModeKHR present_mode;
 	VkImageView* image_views;
 	VkFramebuffer* fbos_swapchain;
-	VkShaderModule shadermodule_main_vert, shadermodule_main_frag;
+	VkImage* offscreen_images;				// headless mode: replace the swapchain images
+	allocation_t* offscreen_memory;
+	uint32_t last_image_index;				// image of the last submitted frame
+	VkShaderModule shadermodule_main_vert, shadermodule_main_frag, shadermodule_cull_comp, shadermodule_bindless_vert, shadermodule_bindless_frag;
 	VkPipelineLayout pipeline_layout;
 	VkRenderPass renderpass;
 	VkPipeline pipeline;
+	PipelineCache pipeline_cache;
 	VkCommandPool cmd_pool;
-	VkCommandBuffer* cmd_buffers;
-	VkSemaphore semaphore_img_aviable;		// first render step
-	VkSemaphore semaphore_rendering_done;	// second render step
-	VkQueue queue;
+	queue_families_t queue_families;
+	VkQueue queue;							// graphics queue
+	VkQueue transfer_queue;
+	VkQueue compute_queue;
+
+	settings_t settings;
+	frame_t* frames;
+	uint32_t n_frames_in_flight;
+	uint32_t current_frame;
+	VkFence* fences_images_in_flight;		// fence of the frame that is currently rendering into the swapchain image
+	uint64_t frame_number;					// number of frames rendered so far
+
+	MemoryAllocator allocator;				// every buffer and image memory is sub-allocated from here
+	UploadBatch upload_batch;				// copies and layout transitions are recorded here and submitted at once
+	FrameBenchmark benchmark;
+	GpuProfiler gpu_profiler;
+	uint32_t gpu_scope_frame;
+	uint32_t gpu_scope_renderpass;
+	uint32_t gpu_scope_cull;
+	uint32_t gpu_series_begin;				// first benchmark series of the GPU profiler
+	double gpu_frame_ms;					// last resolved GPU time of a frame
 
 	VkBuffer vertex_buffer;
 	VkBuffer index_buffer;
 	VkBuffer uniform_buffer;
-	VkDeviceMemory vertex_buffer_memory;
-	VkDeviceMemory index_buffer_memory;
-	VkDeviceMemory uniform_buffer_memory;
+	allocation_t vertex_buffer_memory;
+	allocation_t index_buffer_memory;
+	allocation_t uniform_buffer_memory;
+
+	// uniform streaming: one persistently mapped buffer, every frame in flight owns one slot of it
+	uint8_t* uniform_buffer_mapped;
+	VkDeviceSize uniform_alignment;			// minUniformBufferOffsetAlignment of the device
+	VkDeviceSize uniform_slot_size;			// bytes per frame slot
+	VkDeviceSize uniform_head;				// next free byte of the current frame's slot
+	VkDeviceSize uniform_slot_end;			// end of the current frame's slot
+	uint32_t mvp_offset;					// dynamic offset of this frame's scene uniforms
+
+	// instance streaming: one persistently mapped vertex buffer, every frame in flight owns one slot of it
+	VkBuffer instance_buffer;
+	allocation_t instance_buffer_memory;
+	VkDeviceSize instance_slot_size;		// bytes per frame slot, all instances, aligned for storage buffer descriptors
+	FrustumCuller frustum_culler;			// the instances in structure-of-arrays layout
+	std::vector<uint32_t> visible_instances;
+	uint32_t visible_instance_count;		// instances in the current frame's slot
 
-	VkImage texture1_image;
-	VkDeviceMemory texture1_memory;
-	VkImageView texture1_view;
-	VkImageLayout texture1_layout = VK_IMAGE_LAYOUT_PREINITIALIZED;
-	VkSampler texture1_sampler;
+	// GPU culling: the cull pass copies the visible instances into the frame's slot of the culled instance
+	// buffer and counts them in the frame's indirect draws, which start from a copy of the template
+	bool gpu_culling;
+	bool cull_key_down;						// G was pressed in the last frame
+	cull_constants_t cull_constants;
+	VkDescriptorSetLayout cull_descriptor_set_layout;
+	VkDescriptorPool cull_descriptor_pool;
+	VkPipelineLayout cull_pipeline_layout;
+	VkPipeline cull_pipeline;
+	VkBuffer culled_instance_buffer;
+	allocation_t culled_instance_buffer_memory;
+	VkBuffer indirect_buffer;
+	allocation_t indirect_buffer_memory;
+	VkBuffer indirect_template_buffer;		// one command per draw without instances, host visible
+	allocation_t indirect_template_memory;
+	VkDeviceSize indirect_slot_size;
+
+	/* The draws are recorded in slots that are grouped by index type, a range of slots shares the binding of
+	   the index buffer and is drawn by one multi-draw indirect call. The indirect commands are in slot order. */
+	std::vector<uint32_t> draw_slots;		// draw of every slot
+	std::vector<draw_range_t> draw_ranges;
+	bool multi_draw_indirect;				// the multiDrawIndirect feature is enabled
+	uint32_t max_draw_indirect_count;
+
+	// VK_EXT_external_memory_host, vertex and index data of a scene file is copied by the GPU straight out of the mapping
+	VkDeviceSize host_import_alignment;		// minImportedHostPointerAlignment, 0 if the extension is not enabled
+
+	/* Bindless textures: a partially bound, update-after-bind array of all textures in set 1. Every
+	   frame in flight still owns a set, streamed textures swap views that older frames may sample. */
+	bool bindless_textures;					// settings.bindless_textures, unless descriptor indexing or draw parameters are not supported
+	VkDescriptorSetLayout bindless_descriptor_set_layout;
+	VkDescriptorPool bindless_descriptor_pool;
+	VkBuffer draw_texture_buffer;			// texture of every draw slot, read with gl_DrawID
+	allocation_t draw_texture_memory;
+	PFN_vkGetMemoryHostPointerPropertiesEXT get_memory_host_pointer_properties;
+	std::vector<host_import_t> host_imports;
+
+	ThreadPool thread_pool;					// decodes textures, records secondary command buffers
+	bool parallel_recording;				// settings.parallel_recording, unless pipeline statistics can't be inherited
+	std::vector<texture_t> textures;
+	VkSampler texture_sampler;				// shared by all textures
+	uint64_t texture_descriptor_version;	// incremented whenever a texture view changes
+
+	// texture streaming
+	TextureStreamer texture_streamer;
+	std::vector<decoded_texture_t> texture_sources;		// every level stays in CPU memory, levels are uploaded again when they are needed
+	std::vector<texture_swap_t> texture_swaps;			// images of the streaming upload in flight
+	std::vector<retired_texture_t> retired_textures;
+	bool memory_budget_supported;			// VK_EXT_memory_budget is enabled
 
 	VkImage depth_image;
-	VkDeviceMemory depth_memory;
+	allocation_t depth_memory;
 	VkImageView depth_image_view;
 
 
@@ -62,23 +353,40 @@ private:
 	uint32_t width;
 	uint32_t height; 
 
-	static constexpr VkFormat COLOR_FORMAT = VK_FORMAT_B8G8R8A8_UNORM; // TODO: check if valid
+	static constexpr VkFormat COLOR_FORMAT = VK_FORMAT_B8G8R8A8_UNORM; // preferred format, used as it is in headless mode
+	static constexpr VkDeviceSize UNIFORM_SLOT_SIZE = 64 * 1024;		// uniform data that can be streamed per frame
+	static constexpr uint32_t TEXTURE_PINNED_EXTENT = 64;				// streamed textures keep the levels up to this size resident
+	static constexpr VkDeviceSize TEXTURE_UPLOAD_SIZE = 16 * 1024 * 1024;	// streamed per update, fits into the staging ring without a flush
+	static constexpr uint64_t MEMORY_BUDGET_INTERVAL = 60;				// frames between two queries of the memory budget
+	static constexpr size_t MAX_FEEDBACK_TRIANGLES = 4096;				// triangles of the mesh the texture usage feedback looks at
+	static constexpr size_t MIN_DRAWS_PER_SLICE = 32;					// smaller slices of the draw list cost more to hand over than to record
+	static constexpr uint32_t CULL_GROUP_SIZE = 64;						// local_size_x of the cull shader
+	static constexpr uint32_t MAX_BINDLESS_TEXTURES = 1024;				// size of the texture array of bindless.frag
 
 	std::vector<vertex_t> vertices;
 	std::vector<uint32_t> indices;
-	glm::mat4 MVP;
+	std::vector<uint8_t> index_data;	// indices of all draws as they are stored in the index buffer
+	std::vector<draw_t> draws;
+	SceneFile scene;					// stays mapped, its vertices are read by the texture usage feedback
+	glm::mat4 view_projection;			// of the current frame, the texture usage feedback projects with it
+	glm::mat4 mesh_matrix;
+	glm::mat4 mesh_transform;			// centers a loaded mesh and scales it into the unit cube
+	glm::mat4 vertex_dequantization;	// maps the quantized positions back into the bounds of the vertex data
 	VkDescriptorSetLayout descriptor_set_layout;
 	VkDescriptorPool descriptor_pool;
-	VkDescriptorSet descriptor_set;
 	double t_app_start;
 
 	void vulkan_create_app_info(void);
 	void vulkan_create_instance(void);
 	void vulkan_create_glfw_window_surface(void);
+	void vulkan_find_queue_families(VkPhysicalDevice physical_device);
 	void vulkan_create_device(void);
 	void vulkan_create_queues(void);
 	void vulkan_check_surface_support(void);
+	void vulkan_query_swapchain_support(void);
+	void vulkan_choose_swapchain_config(void);
 	void vulkan_create_swapchain(void);
+	void vulkan_create_offscreen_images(void);
 	void vulkan_create_image_views(void); 
 	void vulkan_create_render_pass(void);
 	void vulkan_create_shader_modules(void);
@@ -87,51 +395,79 @@ private:
 	void vulkan_create_framebuffers(void);
 	void vulkan_create_command_pool(void);
 	void vulkan_create_command_buffers(void);
-	void vulkan_create_semaphores(void);
-	void vulkan_load_texture(void);
+	void vulkan_create_sync_objects(void);
+	void vulkan_create_image_fences(void);
+	static decoded_texture_t decode_texture(const std::string& path, const std::vector<ktx2_candidate_t>& candidates, bool blit_mipmaps);
+	static VkDeviceSize get_staging_size(const decoded_texture_t& decoded, uint32_t base_level);
+	static void stage_texture(const decoded_texture_t& decoded, uint32_t base_level, uint8_t* staging);
+	void vulkan_upload_texture(const decoded_texture_t& decoded, uint32_t base_level, texture_t& texture);
+	void vulkan_upload_texture(const decoded_texture_t& decoded, uint32_t base_level, const StagingRing::span_t& staging, texture_t& texture);
+	void vulkan_destroy_texture(texture_t& texture);
+	void vulkan_load_textures(const std::vector<std::string>& paths);
+	VkDeviceSize vulkan_query_texture_budget(void);
+	void vulkan_update_texture_descriptors(frame_t& frame);
 	void vulkan_create_vertex_buffer(void);
 	void vulkan_create_uniform_buffer(void);
+	void vulkan_create_instance_buffer(void);
 	void vulkan_create_descriptor_pool(void);
 	void vulkan_create_descriptor_set(void);
-	void vulkan_record_command_buffers(void);
+	void vulkan_create_cull_pipeline(void);
+	void vulkan_create_cull_descriptor_sets(void);
+	void vulkan_record_culling(VkCommandBuffer cmd_buffer);
+	void vulkan_record_command_buffer(VkCommandBuffer cmd_buffer, uint32_t image_index);
+	// binds the state and records draws [first_draw, first_draw + n_draws) inside the render pass
+	// draws the slots [first_slot, first_slot + n_slots)
+	void vulkan_record_draws(VkCommandBuffer cmd_buffer, size_t first_slot, size_t n_slots);
+	void vulkan_record_secondary(recorder_t& recorder, uint32_t image_index, size_t first_slot, size_t n_slots);
+	void vulkan_record_parallel(VkCommandBuffer cmd_buffer, uint32_t image_index);
 	void vulkan_recrate_swapchain(void);
-	uint32_t vulkan_find_mem_type_index(uint32_t type_filter, VkMemoryPropertyFlags properties);
-	void vulkan_create_buffer(VkDeviceSize size, VkBufferUsageFlags usage_flags, VkBuffer& buffer, VkMemoryPropertyFlags mem_flags, VkDeviceMemory& device_mem);
-	void vulkan_create_depth_image(VkPhysicalDevice physicalDevice, VkQueue queue);
-	void vulkan_copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
-	void vulkan_change_layout(VkCommandPool cmd_pool, VkQueue queue, VkImage img, VkFormat format, VkImageLayout& old_layout, VkImageLayout new_layout);
-	void vulkan_write_buffer_to_image(VkCommandPool cmd_pool, VkQueue queue, VkBuffer buff, int w, int h);
+	void vulkan_create_buffer(VkDeviceSize size, VkBufferUsageFlags usage_flags, VkBuffer& buffer, VkMemoryPropertyFlags mem_flags, allocation_t& allocation, MemoryAllocator::strategy_t strategy = MemoryAllocator::STRATEGY_BUDDY);
+	void vulkan_destroy_buffer(VkBuffer buffer, allocation_t& allocation);
+	void vulkan_create_depth_image(VkPhysicalDevice physicalDevice);
+	void vulkan_copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize src_offset = 0);
+	void vulkan_change_layout(VkImage img, VkFormat format, VkImageLayout& old_layout, VkImageLayout new_layout, uint32_t mip_levels = 1);
+	void vulkan_write_buffer_to_image(VkBuffer buff, VkImage img, int w, int h, VkDeviceSize src_offset = 0, uint32_t mip_level = 0);
 	bool vulkan_is_format_supported(VkPhysicalDevice device, VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags flags);
 	VkFormat vulkan_find_supported_format(VkPhysicalDevice device, const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags flags);
 	VkFormat vulkan_find_depth_format(VkPhysicalDevice physical_device);
 	bool vulkan_is_stencil_format(VkFormat format);
 	void vulkan_init(void);
+	void load_mesh(const std::string& path);
+	void quantize_vertices(const std::vector<unpacked_vertex_t>& unpacked);
+	// indices are relative to first_vertex, 16 bit indices are used if n_vertices fits
+	void add_draw(const uint32_t* indices, size_t count, uint32_t first_vertex, uint32_t n_vertices, uint32_t material = 0);
+	void load_scene(const std::string& path);
+	void export_scene(const std::string& path);
+
+	// vertex and index data of the draws, out of the scene file if one is loaded
+	const vertex_t* get_vertex_data(void) const { return this->scene.is_loaded() ? reinterpret_cast<const vertex_t*>(this->scene.get_vertex_data()) : this->vertices.data(); }
+	size_t get_vertex_count(void) const { return this->scene.is_loaded() ? this->scene.get_vertex_count() : this->vertices.size(); }
+	const uint8_t* get_index_data(void) const { return this->scene.is_loaded() ? this->scene.get_index_data() : this->index_data.data(); }
+	size_t get_index_data_size(void) const { return this->scene.is_loaded() ? this->scene.get_index_data_size() : this->index_data.size(); }
+	uint32_t get_index(const draw_t& draw, uint32_t i) const;
 
 	template<typename T>
-	void create_and_upload_buffer(std::vector<T> data, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& mem)
+	void create_and_upload_buffer(const T* data, size_t count, VkBufferUsageFlags usage, VkBuffer& buffer, allocation_t& mem)
 	{
-		VkDeviceSize buffer_size = data.size() * sizeof(T);
-
-		// create staging buffer
-		VkBuffer staging_buffer;
-		VkDeviceMemory staging_buffer_memory = {};	// GPU buffer must read from staging buffer
-		this->vulkan_create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, staging_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer_memory);
+		VkDeviceSize buffer_size = count * sizeof(T);
 
-		// load data into the staging buffer
-		void* _data;
-		vkMapMemory(this->device, staging_buffer_memory, 0, buffer_size, 0, &_data);
-		memcpy(_data, data.data(), buffer_size);
-		vkUnmapMemory(this->device, staging_buffer_memory);
+		// the data is written straight into the staging ring of the upload batch
+		StagingRing::span_t staging = this->upload_batch.stage(buffer_size);
+		memcpy(staging.data, data, buffer_size);
 		// create vertex buffer														// GPU must write to vertex buffer						// Buffer is in VRAM
 		this->vulkan_create_buffer(buffer_size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mem);
 
-		// copy staging buffer to vertex buffer
-		this->vulkan_copy_buffer(staging_buffer, buffer, buffer_size);
+		// copy staging memory to vertex buffer, the ring memory is reused when the upload batch has finished
+		this->vulkan_copy_buffer(staging.buffer, buffer, buffer_size, staging.offset);
 
-		// destroy temporary staging buffer
-		vkDestroyBuffer(this->device, staging_buffer, nullptr);
-		vkFreeMemory(this->device, staging_buffer_memory, nullptr);
+		// the buffer is read by the input assembler of the graphics queue
+		VkAccessFlags dst_access = 0;
+		if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)	dst_access |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)	dst_access |= VK_ACCESS_INDEX_READ_BIT;
+		this->upload_batch.transfer_ownership(buffer, dst_access, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 	}
+	// the GPU copies directly out of host memory, returns false if the memory can't be imported
+	bool import_and_upload_buffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, allocation_t& mem);
 
 	void glfw_on_window_resize(GLFWwindow* window, int width, int height);
 	void glfw_init(void);
@@ -139,19 +475,34 @@ private:
 	void vulkan_destroy(void);
 	void glfw_destroy(void);
 
+	void uniform_stream_begin_frame(uint32_t frame_index);
+	uint32_t uniform_stream_write(const void* data, VkDeviceSize size);
+
 	void update_mvp(void);
+	void update_instances(void);
+	// the texture a draw samples, the first one unless bindless textures select it by material
+	uint32_t get_draw_texture(const draw_t& draw) const;
+	// index of the draw's first index in the index buffer
+	static uint32_t get_draw_first_index(const draw_t& draw);
+	uint32_t estimate_texture_base_level(uint32_t texture);
+	void texture_streaming_update(void);
 	void draw_frame(void);
+	void benchmark_phase(frame_phase_t phase, double& t_phase_begin);
+	void gpu_profiler_collect(uint32_t frame_index);
+
+	void save_ppm(const char* path, const std::vector<uint8_t>& pixels);
 
 	void print_deviceinfo(const VkPhysicalDevice* devices, size_t n);
 	void print_instance_layers(const VkLayerProperties* layers, size_t n);
 	void print_instance_extensions(const VkExtensionProperties* extensions, size_t n);
 
-	size_t read_shader(const char* path, std::vector<char>& buff);
-	VkResult create_shader_moudle(const std::vector<char>& code, VkShaderModule* shader_module);
+	VkResult create_shader_moudle(const uint32_t* code, size_t size, VkShaderModule* shader_module);
 
 public:
 	FirstVulkan(void);
+	FirstVulkan(const settings_t& settings);
 	virtual ~FirstVulkan(void);
 
 	void run(void);
+	void read_back_frame(std::vector<uint8_t>& pixels);
 };
\ No newline at end of file
@@ -0,0 +1,39 @@
+# Writes SPIR-V binaries as constexpr uint32_t arrays into a C++ header, the shader modules are
+# created from the executable's data without any file access.
+#   cmake -DOUTPUT=<header> -DINPUTS=<a.spv;b.spv> -P embed_spirv.cmake
+# main_vert.spv becomes SPIRV_MAIN_VERT, SPIRV_MAIN_VERT_SIZE holds the size in bytes.
+
+set(content "// generated by cmake/embed_spirv.cmake from the GLSL shaders in shader/, do not edit\n#pragma once\n\n#include <cstdint>\n#include <cstddef>\n")
+
+foreach(input ${INPUTS})
+	get_filename_component(name "${input}" NAME_WE)
+	string(MAKE_C_IDENTIFIER "${name}" name)
+	string(TOUPPER "SPIRV_${name}" name)
+
+	file(READ "${input}" hex HEX)
+	string(LENGTH "${hex}" n_hex)
+	math(EXPR remainder "${n_hex} % 8")
+	if(n_hex EQUAL 0 OR NOT remainder EQUAL 0)
+		message(FATAL_ERROR "${input} is not a SPIR-V binary, its size is not a multiple of 4 bytes")
+	endif()
+	math(EXPR n_bytes "${n_hex} / 2")
+
+	# SPIR-V words are little endian, the hex dump lists the bytes in file order
+	string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1, " words "${hex}")
+	# eight words per line, CMake's regular expressions have no repetition counts
+	set(word "0x[0-9a-f]+, ")
+	string(REGEX REPLACE "(${word}${word}${word}${word}${word}${word}${word}${word})" "\\1\n\t" words "${words}")
+	string(REPLACE ", \n" ",\n" words "${words}")
+	string(STRIP "${words}" words)
+	string(REGEX REPLACE ",$" "" words "${words}")
+
+	string(APPEND content "\nconstexpr size_t ${name}_SIZE = ${n_bytes};\nconstexpr uint32_t ${name}[${n_bytes} / 4] = {\n\t${words}\n};\n")
+endforeach()
+
+# the header is only replaced if the shaders changed, files including it are not rebuilt otherwise
+if(EXISTS "${OUTPUT}")
+	file(READ "${OUTPUT}" old_content)
+endif()
+if(NOT "${old_content}" STREQUAL "${content}")
+	file(WRITE "${OUTPUT}" "${content}")
+endif()
@@ -1,2 +0,0 @@
-C:/VulkanSDK/1.2.170.0/Bin/glslangValidator.exe -V ./shader/main.vert -o ./shader/spir-v/main_vert.spv
-C:/VulkanSDK/1.2.170.0/Bin/glslangValidator.exe -V ./shader/main.frag -o ./shader/spir-v/main_frag.spv
\ No newline at end of file
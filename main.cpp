@@ -1,8 +1,101 @@
 #include "VulkanApp.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
-int main()
+int main(int argc, char** argv)
 {
-	FirstVulkan app;
+	FirstVulkan::settings_t settings;
+	bool present_mode_set = false;
+	bool textures_set = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+			settings.frames_in_flight = static_cast<uint32_t>(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--headless") == 0)
+			settings.headless = true;
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			settings.frame_count = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--readback") == 0 && i + 1 < argc)
+			settings.readback_path = argv[++i];
+		else if (strcmp(argv[i], "--benchmark") == 0)
+			settings.benchmark = true;
+		else if (strcmp(argv[i], "--benchmark-frames") == 0 && i + 1 < argc)
+			settings.benchmark_frames = static_cast<uint32_t>(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--benchmark-warmup") == 0 && i + 1 < argc)
+			settings.benchmark_warmup = static_cast<uint32_t>(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--benchmark-output") == 0 && i + 1 < argc)
+			settings.benchmark_output = argv[++i];
+		else if (strcmp(argv[i], "--no-gpu-timestamps") == 0)
+			settings.gpu_timestamps = false;
+		else if (strcmp(argv[i], "--pipeline-statistics") == 0)
+			settings.pipeline_statistics = true;
+		else if (strcmp(argv[i], "--no-async-transfer") == 0)
+			settings.async_transfer = false;
+		else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc)
+		{
+			// every --texture adds one texture, the default texture is replaced
+			if (!textures_set)
+				settings.texture_paths.clear();
+			textures_set = true;
+			settings.texture_paths.push_back(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc)
+			settings.pipeline_cache_path = argv[++i];
+		else if (strcmp(argv[i], "--no-pipeline-cache") == 0)
+			settings.pipeline_cache_path.clear();
+		else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+			settings.mesh_path = argv[++i];
+		else if (strcmp(argv[i], "--no-overdraw-optimization") == 0)
+			settings.optimize_overdraw = false;
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+			settings.instance_count = std::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "--no-cpu-culling") == 0)
+			settings.cpu_culling = false;
+		else if (strcmp(argv[i], "--gpu-culling") == 0)
+			settings.gpu_culling = true;
+		else if (strcmp(argv[i], "--bindless") == 0)
+			settings.bindless_textures = true;
+		else if (strcmp(argv[i], "--parallel-recording") == 0)
+			settings.parallel_recording = true;
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+			settings.scene_path = argv[++i];
+		else if (strcmp(argv[i], "--export-scene") == 0 && i + 1 < argc)
+			settings.export_scene_path = argv[++i];
+		else if (strcmp(argv[i], "--texture-streaming") == 0)
+			settings.texture_streaming = true;
+		else if (strcmp(argv[i], "--no-texture-streaming") == 0)
+			settings.texture_streaming = false;
+		else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+			settings.texture_budget_mb = static_cast<uint32_t>(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc)
+		{
+			present_mode_set = true;
+			const char* mode = argv[++i];
+			if (strcmp(mode, "immediate") == 0)			settings.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+			else if (strcmp(mode, "mailbox") == 0)		settings.present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+			else if (strcmp(mode, "fifo-relaxed") == 0)	settings.present_mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+			else										settings.present_mode = VK_PRESENT_MODE_FIFO_KHR;
+		}
+	}
+
+	// the frame count of a benchmark comes from benchmark_frames, 0 would render forever
+	if (settings.benchmark && settings.benchmark_frames == 0)
+	{
+		std::cerr << "--benchmark-frames must be at least 1" << std::endl;
+		return 1;
+	}
+
+	// benchmarks must not be limited by the refresh rate of the display
+	if (settings.benchmark && !present_mode_set)
+		settings.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+
+	// headless runs must terminate on their own
+	if (settings.headless && settings.frame_count == 0 && !settings.benchmark)
+		settings.frame_count = 1000;
+
+	FirstVulkan app(settings);
 	app.run();
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,21 @@
+#version 460 core
+#extension GL_ARB_separate_shader_objects : enable // is requiered to use GLSL shaders in vulkan
+
+/* Bindless variant of main.frag. All textures are elements of one descriptor array, bindless.vert
+   selects the texture of the draw's material. Materials switch textures without binding another
+   descriptor set, elements that are not written are never selected. */
+
+const uint MAX_TEXTURES = 1024;		// MAX_BINDLESS_TEXTURES of the application
+
+layout (location = 0) in vec4 frag_color;
+layout (location = 1) in vec2 frag_uvCoords;
+layout (location = 2) flat in uint frag_texture;	// the same for the whole draw, every draw of a multi-draw is an invocation group of its own
+
+layout (location = 0) out vec4 out_color;
+
+layout (set = 1, binding = 0) uniform sampler2D textures[MAX_TEXTURES];
+
+void main()
+{
+	out_color = texture(textures[frag_texture], frag_uvCoords) * frag_color;
+}
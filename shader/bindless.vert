@@ -0,0 +1,44 @@
+#version 460 core
+#extension GL_ARB_separate_shader_objects : enable	// is requiered to use GLSL shaders in vulkan
+
+/* Bindless variant of main.vert. Draws of one multi-draw indirect call can have different
+   materials, the texture of the draw is looked up with gl_DrawID and handed to bindless.frag. */
+
+layout (location = 0) in vec3 a_Pos;
+layout (location = 1) in vec4 a_Color;
+layout (location = 2) in vec2 a_uvCoords;
+layout (location = 3) in vec4 a_InstanceRow0;	// per instance, affine 3x4 transform
+layout (location = 4) in vec4 a_InstanceRow1;
+layout (location = 5) in vec4 a_InstanceRow2;
+layout (location = 6) in vec4 a_InstanceColor;
+
+layout (location = 0) out vec4 frag_color;
+layout (location = 1) out vec2 frag_uvCoords;
+layout (location = 2) flat out uint frag_texture;
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 view_projection;
+	mat4 mesh;
+} ubo;
+
+layout (std430, set = 1, binding = 1) readonly buffer DrawTextures
+{
+	uint draw_textures[];	// one per draw slot
+};
+
+layout (push_constant) uniform Draws
+{
+	uint first_slot;		// slot of the first draw of the call, gl_DrawID counts from there
+} draws;
+
+void main()
+{
+	// a row vector times a 3x4 matrix dots the position with every row
+	mat3x4 instance = mat3x4(a_InstanceRow0, a_InstanceRow1, a_InstanceRow2);
+	vec3 world_pos = (ubo.mesh * vec4(a_Pos, 1.0f)) * instance;
+	gl_Position = ubo.view_projection * vec4(world_pos, 1.0f);
+	frag_color = a_Color * a_InstanceColor;
+	frag_uvCoords = a_uvCoords;
+	frag_texture = draw_textures[draws.first_slot + gl_DrawID];
+}
@@ -4,18 +4,26 @@
 layout (location = 0) in vec3 a_Pos;
 layout (location = 1) in vec4 a_Color;
 layout (location = 2) in vec2 a_uvCoords;
+layout (location = 3) in vec4 a_InstanceRow0;	// per instance, affine 3x4 transform
+layout (location = 4) in vec4 a_InstanceRow1;
+layout (location = 5) in vec4 a_InstanceRow2;
+layout (location = 6) in vec4 a_InstanceColor;
 
 layout (location = 0) out vec4 frag_color;
 layout (location = 1) out vec2 frag_uvCoords;
 
 layout (binding = 0) uniform UBO 
 {
-	mat4 MVP;
+	mat4 view_projection;
+	mat4 mesh;
 } ubo;
 
 void main()
 {
-	gl_Position = ubo.MVP * vec4(a_Pos, 1.0f);
-	frag_color = a_Color;
+	// a row vector times a 3x4 matrix dots the position with every row
+	mat3x4 instance = mat3x4(a_InstanceRow0, a_InstanceRow1, a_InstanceRow2);
+	vec3 world_pos = (ubo.mesh * vec4(a_Pos, 1.0f)) * instance;
+	gl_Position = ubo.view_projection * vec4(world_pos, 1.0f);
+	frag_color = a_Color * a_InstanceColor;
 	frag_uvCoords = a_uvCoords;
 }
\ No newline at end of file
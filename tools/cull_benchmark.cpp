@@ -0,0 +1,81 @@
+/* Microbenchmark of the CPU frustum culler: random spheres in a cube around the camera are culled
+   with every instruction set the CPU supports, the throughput is reported in objects per nanosecond.
+   usage: cull_benchmark [--objects N] [--iterations N] */
+#include "FrustumCuller.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <glm/gtc/matrix_transform.hpp>
+
+int main(int argc, char** argv)
+{
+	uint32_t n_objects = 1 << 20;
+	uint32_t n_iterations = 200;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--objects") == 0 && i + 1 < argc)
+			n_objects = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+		else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+			n_iterations = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+		else
+		{
+			std::cerr << "usage: cull_benchmark [--objects N] [--iterations N]" << std::endl;
+			return 1;
+		}
+	}
+
+	// the camera of the application inside a cube of objects, the frustum contains only a part of them
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> position(-4.0f, 4.0f);
+	std::uniform_real_distribution<float> size(0.01f, 0.1f);
+	FrustumCuller culler;
+	culler.resize(n_objects);
+	for (uint32_t i = 0; i < n_objects; i++)
+		culler.set_bounds(i, glm::vec3(position(random), position(random), position(random)), size(random));
+
+	glm::mat4 view = glm::lookAt(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.01f, 100.0f);
+	projection[1][1] *= -1.0f;
+	glm::vec4 planes[6];
+	FrustumCuller::extract_planes(projection * view, planes);
+
+	std::vector<uint32_t> reference(n_objects);
+	uint32_t n_reference = culler.cull(planes, reference.data(), FrustumCuller::ISA_SCALAR);
+	std::cout << n_objects << " objects, " << n_reference << " visible, " << n_iterations << " iterations" << std::endl;
+
+	std::vector<uint32_t> visible(n_objects);
+	for (uint32_t isa = 0; isa < FrustumCuller::N_ISAS; isa++)
+	{
+		const char* name = FrustumCuller::get_isa_name(static_cast<FrustumCuller::isa_t>(isa));
+		if (!FrustumCuller::is_supported(static_cast<FrustumCuller::isa_t>(isa)))
+		{
+			std::cout << name << ": not supported" << std::endl;
+			continue;
+		}
+
+		// every instruction set must return the same list as the scalar loop
+		uint32_t n_visible = culler.cull(planes, visible.data(), static_cast<FrustumCuller::isa_t>(isa));
+		if (n_visible != n_reference || !std::equal(reference.begin(), reference.begin() + n_reference, visible.begin()))
+		{
+			std::cerr << name << ": visible list differs from the scalar loop" << std::endl;
+			return 1;
+		}
+
+		// the fastest iteration is reported, the others were disturbed by the system
+		double best = 1e30;
+		for (uint32_t i = 0; i < n_iterations; i++)
+		{
+			auto t_start = std::chrono::high_resolution_clock::now();
+			n_visible = culler.cull(planes, visible.data(), static_cast<FrustumCuller::isa_t>(isa));
+			auto t_end = std::chrono::high_resolution_clock::now();
+			best = std::min(best, std::chrono::duration<double, std::nano>(t_end - t_start).count());
+		}
+		std::cout << name << ": " << best / 1e6 << " ms, " << n_objects / best << " objects/ns" << std::endl;
+	}
+	return 0;
+}
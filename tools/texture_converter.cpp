@@ -0,0 +1,248 @@
+/* Offline converter: turns JPEG/PNG textures into KTX2 files with a full mip chain.
+   usage: texture_converter <input> <output.ktx2> [--format bc7|rgba8]
+   BC7 is encoded with mode 6 only (one subset, RGBA endpoints, 4-bit indices). */
+#include "Ktx2Texture.h"
+#include "MipChain.h"
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cfloat>
+#include <algorithm>
+#include <cmath>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+static const uint32_t BC7_WEIGHTS_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// writes the lowest n_bits of value into a 128 bit block, least significant bit first
+static void write_bits(uint8_t* block, uint32_t& bit, uint32_t value, uint32_t n_bits)
+{
+	for (uint32_t i = 0; i < n_bits; i++, bit++)
+	{
+		if (value & (1u << i))
+			block[bit / 8] |= static_cast<uint8_t>(1u << (bit % 8));
+	}
+}
+
+// 7 bit endpoint with a shared p-bit, the p-bit with the smaller error is chosen
+static void quantize_endpoint(const float color[4], uint32_t quantized[4], uint32_t& p_bit)
+{
+	float best_error = FLT_MAX;
+	for (uint32_t p = 0; p < 2; p++)
+	{
+		uint32_t q[4];
+		float error = 0.0f;
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			int value = (int)std::lround((color[c] - p) / 2.0f);
+			q[c] = (uint32_t)(value < 0 ? 0 : (value > 127 ? 127 : value));
+			float d = (float)((q[c] << 1) | p) - color[c];
+			error += d * d;
+		}
+		if (error < best_error)
+		{
+			best_error = error;
+			p_bit = p;
+			memcpy(quantized, q, sizeof(q));
+		}
+	}
+}
+
+/* Mode 6 block: the endpoints are the extremes of the pixels projected onto the principal
+   axis of the block, every pixel gets the closest of the 16 interpolated colors. */
+static void encode_bc7_block(const uint8_t pixels[16][4], uint8_t* block)
+{
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (uint32_t i = 0; i < 16; i++)
+		for (uint32_t c = 0; c < 4; c++)
+			mean[c] += pixels[i][c] / 16.0f;
+
+	float covariance[4][4] = {};
+	for (uint32_t i = 0; i < 16; i++)
+		for (uint32_t a = 0; a < 4; a++)
+			for (uint32_t b = 0; b < 4; b++)
+				covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+
+	// power iteration for the principal axis
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (uint32_t iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		for (uint32_t a = 0; a < 4; a++)
+			for (uint32_t b = 0; b < 4; b++)
+				next[a] += covariance[a][b] * axis[b];
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (length < 1e-6f)
+			break;
+		for (uint32_t c = 0; c < 4; c++)
+			axis[c] = next[c] / length;
+	}
+
+	float t_min = FLT_MAX, t_max = -FLT_MAX;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (uint32_t c = 0; c < 4; c++)
+			t += (pixels[i][c] - mean[c]) * axis[c];
+		t_min = std::fmin(t_min, t);
+		t_max = std::fmax(t_max, t);
+	}
+
+	float endpoints[2][4];
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = std::fmin(std::fmax(mean[c] + axis[c] * t_min, 0.0f), 255.0f);
+		endpoints[1][c] = std::fmin(std::fmax(mean[c] + axis[c] * t_max, 0.0f), 255.0f);
+	}
+
+	uint32_t quantized[2][4], p_bits[2];
+	quantize_endpoint(endpoints[0], quantized[0], p_bits[0]);
+	quantize_endpoint(endpoints[1], quantized[1], p_bits[1]);
+
+	// colors of the palette as the decoder reconstructs them
+	uint32_t palette[16][4];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			uint32_t e0 = (quantized[0][c] << 1) | p_bits[0];
+			uint32_t e1 = (quantized[1][c] << 1) | p_bits[1];
+			palette[i][c] = (e0 * (64 - BC7_WEIGHTS_4[i]) + e1 * BC7_WEIGHTS_4[i] + 32) >> 6;
+		}
+	}
+
+	uint32_t indices[16];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		uint32_t best_error = UINT32_MAX;
+		for (uint32_t j = 0; j < 16; j++)
+		{
+			uint32_t error = 0;
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				int d = (int)palette[j][c] - (int)pixels[i][c];
+				error += (uint32_t)(d * d);
+			}
+			if (error < best_error)
+			{
+				best_error = error;
+				indices[i] = j;
+			}
+		}
+	}
+
+	// the most significant bit of the first index is implicitly 0, swap the endpoints if needed
+	if (indices[0] & 8)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+			std::swap(quantized[0][c], quantized[1][c]);
+		std::swap(p_bits[0], p_bits[1]);
+		for (uint32_t i = 0; i < 16; i++)
+			indices[i] = 15 - indices[i];
+	}
+
+	memset(block, 0, 16);
+	uint32_t bit = 0;
+	write_bits(block, bit, 1u << 6, 7);		// mode 6
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		write_bits(block, bit, quantized[0][c], 7);
+		write_bits(block, bit, quantized[1][c], 7);
+	}
+	write_bits(block, bit, p_bits[0], 1);
+	write_bits(block, bit, p_bits[1], 1);
+	write_bits(block, bit, indices[0], 3);
+	for (uint32_t i = 1; i < 16; i++)
+		write_bits(block, bit, indices[i], 4);
+}
+
+static void encode_bc7(const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<uint8_t>& blocks)
+{
+	uint32_t blocks_x = (width + 3) / 4;
+	uint32_t blocks_y = (height + 3) / 4;
+	blocks.resize((size_t)blocks_x * blocks_y * 16);
+
+	for (uint32_t by = 0; by < blocks_y; by++)
+	{
+		for (uint32_t bx = 0; bx < blocks_x; bx++)
+		{
+			// pixels outside of the image repeat the border
+			uint8_t pixels[16][4];
+			for (uint32_t y = 0; y < 4; y++)
+			{
+				uint32_t py = std::min(by * 4 + y, height - 1);
+				for (uint32_t x = 0; x < 4; x++)
+				{
+					uint32_t px = std::min(bx * 4 + x, width - 1);
+					memcpy(pixels[y * 4 + x], rgba + ((size_t)py * width + px) * 4, 4);
+				}
+			}
+			encode_bc7_block(pixels, blocks.data() + ((size_t)by * blocks_x + bx) * 16);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cerr << "usage: texture_converter <input> <output.ktx2> [--format bc7|rgba8]" << std::endl;
+		return 1;
+	}
+
+	VkFormat format = VK_FORMAT_BC7_UNORM_BLOCK;
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+		{
+			const char* name = argv[++i];
+			if (strcmp(name, "rgba8") == 0)		format = VK_FORMAT_R8G8B8A8_UNORM;
+			else if (strcmp(name, "bc7") == 0)	format = VK_FORMAT_BC7_UNORM_BLOCK;
+			else
+			{
+				std::cerr << "Unknown format " << name << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	int w, h, c;
+	stbi_uc* img_data = stbi_load(argv[1], &w, &h, &c, 4);
+	if (img_data == nullptr)
+	{
+		std::cerr << "Unable to load " << argv[1] << std::endl;
+		return 1;
+	}
+
+	// the mip chain is built from the uncompressed image, every level is compressed on its own
+	uint32_t n_levels = MipChain::get_level_count(w, h);
+	std::vector<uint8_t> chain(MipChain::get_chain_size(w, h, n_levels));
+	memcpy(chain.data(), img_data, (size_t)w * h * 4);
+	stbi_image_free(img_data);
+	MipChain::generate_rgba8(chain.data(), w, h, n_levels);
+
+	Ktx2Texture texture;
+	texture.create(format, w, h);
+	std::vector<uint8_t> blocks;
+	for (uint32_t level = 0; level < n_levels; level++)
+	{
+		const uint8_t* level_data = chain.data() + MipChain::get_level_offset(w, h, level);
+		uint32_t level_width = MipChain::get_level_extent(w, level);
+		uint32_t level_height = MipChain::get_level_extent(h, level);
+		if (format == VK_FORMAT_BC7_UNORM_BLOCK)
+		{
+			encode_bc7(level_data, level_width, level_height, blocks);
+			texture.add_level(blocks.data(), blocks.size());
+		}
+		else
+		{
+			texture.add_level(level_data, (VkDeviceSize)level_width * level_height * 4);
+		}
+	}
+	texture.save(argv[2]);
+
+	std::cout << argv[1] << ": " << w << "x" << h << ", " << n_levels << " levels -> " << argv[2] << std::endl;
+	return 0;
+}